@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "AllocProfiler.hpp"
+#include "ArrayList.hpp"
+#include "Interpreter.hpp"
+#include "Builtins.hpp"
+#include "SSABuilder.hpp" // for opcodes
+
+struct AllocSite {
+    ExecFunction *function; // NULL for allocations made while no script was running
+    int instruction;
+    AllocKind kind;
+    unsigned long samples;
+    unsigned long bytes; // total size of the sampled allocations
+};
+
+int allocProfilerCountdown = 0;
+static int sampleInterval = ALLOC_PROFILER_DEFAULT_INTERVAL;
+static uint32_t randomState = 1;
+static ArrayList<AllocSite> sites;
+
+// open addressing hash table of indices in sites, or -1 for empty slots; the size is always a power of 2
+static int *siteTable = NULL;
+static uint32_t siteTableSize = 0;
+
+static inline uint32_t hashSite(ExecFunction *function, int instruction, AllocKind kind)
+{
+    uintptr_t key = (uintptr_t) function ^ ((uintptr_t) instruction << 2) ^ (uintptr_t) kind;
+    return (uint32_t) ((key * 2654435761u) ^ (key >> 16));
+}
+
+static void rebuildSiteTable(uint32_t size)
+{
+    free(siteTable);
+    siteTable = (int*) malloc(size * sizeof(int));
+    siteTableSize = size;
+    for (uint32_t i = 0; i < size; i++)
+        siteTable[i] = -1;
+
+    for (uint32_t i = 0; i < sites.size(); i++)
+    {
+        const AllocSite *site = sites.getPtr(i);
+        uint32_t slot = hashSite(site->function, site->instruction, site->kind) & (size - 1);
+        while (siteTable[slot] >= 0)
+            slot = (slot + 1) & (size - 1);
+        siteTable[slot] = i;
+    }
+}
+
+static AllocSite *findSite(ExecFunction *function, int instruction, AllocKind kind)
+{
+    // keep the table at most half full
+    if (2 * (sites.size() + 1) > siteTableSize)
+    {
+        rebuildSiteTable(siteTableSize ? siteTableSize * 2 : 64);
+    }
+
+    uint32_t slot = hashSite(function, instruction, kind) & (siteTableSize - 1);
+    while (siteTable[slot] >= 0)
+    {
+        AllocSite *site = sites.getPtr(siteTable[slot]);
+        if (site->function == function && site->instruction == instruction && site->kind == kind)
+            return site;
+        slot = (slot + 1) & (siteTableSize - 1);
+    }
+
+    AllocSite newSite = {function, instruction, kind, 0, 0};
+    siteTable[slot] = sites.size();
+    sites.append(newSite);
+    return sites.getPtr(sites.size() - 1);
+}
+
+// Picks the number of allocations until the next sample uniformly from 1 to 2 * sampleInterval - 1, so that the mean
+// is sampleInterval. A fixed interval would keep sampling the same sites in loops that allocate periodically.
+static int nextCountdown()
+{
+    // xorshift32
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    return 1 + randomState % (2 * sampleInterval - 1);
+}
+
+void AllocProfiler_Record(AllocKind kind, size_t bytes)
+{
+    allocProfilerCountdown = nextCountdown();
+
+    ExecFunction *function;
+    int instruction;
+    if (!Interpreter_GetAllocationSite(&function, &instruction))
+    {
+        function = NULL;
+        instruction = -1;
+    }
+
+    AllocSite *site = findSite(function, instruction, kind);
+    site->samples++;
+    site->bytes += bytes;
+}
+
+void AllocProfiler_Start(int interval)
+{
+    AllocProfiler_Clear();
+    sampleInterval = (interval > 0) ? interval : ALLOC_PROFILER_DEFAULT_INTERVAL;
+    allocProfilerCountdown = nextCountdown();
+}
+
+void AllocProfiler_Stop()
+{
+    allocProfilerCountdown = 0;
+}
+
+void AllocProfiler_Clear()
+{
+    allocProfilerCountdown = 0;
+    sites.clear();
+    free(siteTable);
+    siteTable = NULL;
+    siteTableSize = 0;
+}
+
+static int compareSites(const void *a, const void *b)
+{
+    unsigned long bytesA = ((const AllocSite*) a)->bytes, bytesB = ((const AllocSite*) b)->bytes;
+    return (bytesA < bytesB) - (bytesA > bytesB);
+}
+
+int AllocProfiler_SortSites()
+{
+    if (sites.size() == 0) return 0;
+
+    qsort(sites.getPtr(0), sites.size(), sizeof(AllocSite), compareSites);
+    rebuildSiteTable(siteTableSize);
+    return sites.size();
+}
+
+void AllocProfiler_GetSite(int index, AllocSiteInfo *info)
+{
+    const AllocSite *site = sites.getPtr(index);
+    info->functionName = NULL;
+    info->fileName = NULL;
+    info->instruction = site->instruction;
+    info->operation = "(none)";
+    info->kind = site->kind;
+    info->count = site->samples * sampleInterval;
+    info->bytes = site->bytes * sampleInterval;
+
+    if (site->function)
+    {
+        const ExecInstruction *inst = &site->function->instructions[site->instruction];
+        info->functionName = site->function->functionName;
+        info->fileName = site->function->interpreter->fileName;
+        if (inst->opCode == OP_CALL_BUILTIN)
+            info->operation = getBuiltinName(inst->callTarget);
+        else if (inst->opCode == OP_CALL_METHOD)
+            info->operation = getMethodName(inst->callTarget);
+        else
+            info->operation = getOpCodeName((OpCode) inst->opCode);
+    }
+}
+
+void AllocProfiler_PrintReport(int maxEntries)
+{
+    static const char *kindNames[] = {"object", "list", "string"};
+    int numSites = AllocProfiler_SortSites();
+
+    printf("Allocation sites (sampled once every %i allocations on average):\n", sampleInterval);
+    printf("%12s %10s %7s  %-20s %s\n", "bytes", "count", "type", "operation", "site");
+    for (int i = 0; i < numSites && i < maxEntries; i++)
+    {
+        AllocSiteInfo info;
+        AllocProfiler_GetSite(i, &info);
+        printf("%12lu %10lu %7s  %-20s ", info.bytes, info.count, kindNames[info.kind], info.operation);
+        if (info.functionName)
+            printf("%s() in %s, instruction %i\n", info.functionName, info.fileName, info.instruction);
+        else
+            printf("(no script running)\n");
+    }
+}
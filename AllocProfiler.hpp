@@ -0,0 +1,64 @@
+#ifndef ALLOC_PROFILER_HPP
+#define ALLOC_PROFILER_HPP
+
+#include <stddef.h>
+#include "depends.h"
+#include "ralloc.h" // for unlikely()
+
+/**
+ * Sampling profiler that attributes allocations of objects, lists and strings to the script instruction that made
+ * them: an OP_MKOBJECT or OP_MKLIST, an operator that concatenates strings or lists, or a call to a builtin or method
+ * that allocates. Allocations made by a script function are attributed to that function, not to its callers.
+ *
+ * Only one in every N allocations on average is recorded, so that a running profiler doesn't slow scripts down much.
+ * The counts and bytes reported for each site are scaled up by N, so they're estimates unless N is 1.
+ */
+
+enum AllocKind {
+    ALLOC_OBJECT,
+    ALLOC_LIST,
+    ALLOC_STRING,
+};
+
+// number of allocations between samples if none is given
+#define ALLOC_PROFILER_DEFAULT_INTERVAL 16
+
+// description of an allocation site, filled in by AllocProfiler_GetSite()
+typedef struct {
+    const char *functionName; // NULL for allocations made while no script was running
+    const char *fileName;
+    int instruction;          // index of the instruction in the function, or -1
+    const char *operation;    // name of the opcode, builtin or method that allocated
+    AllocKind kind;
+    unsigned long count;      // estimated number of allocations
+    unsigned long bytes;      // estimated number of bytes allocated
+} AllocSiteInfo;
+
+// allocations left until the next sample, or 0 if the profiler isn't running
+extern int allocProfilerCountdown;
+
+// starts profiling, discarding the results of any previous run
+void AllocProfiler_Start(int sampleInterval);
+void AllocProfiler_Stop();
+
+// Sorts the allocation sites by bytes allocated, largest first, and returns the number of sites. Call this before
+// AllocProfiler_GetSite().
+int AllocProfiler_SortSites();
+void AllocProfiler_GetSite(int index, AllocSiteInfo *info);
+
+// prints the sites that allocated the most memory
+void AllocProfiler_PrintReport(int maxEntries);
+
+// discards all results; must be called before the functions they refer to are freed
+void AllocProfiler_Clear();
+
+// records an allocation; only call it when AllocProfiler_ShouldSample() returns true
+void AllocProfiler_Record(AllocKind kind, size_t bytes);
+
+// called for every allocation, so this has to be cheap when the profiler isn't running
+static inline bool AllocProfiler_ShouldSample()
+{
+    return unlikely(allocProfilerCountdown > 0) && --allocProfilerCountdown == 0;
+}
+
+#endif
@@ -58,6 +58,12 @@ public:
         return numElements;
     }
 
+    // returns the number of elements the list can hold without reallocating
+    inline uint32_t getCapacity() const
+    {
+        return capacity;
+    }
+
     // returns the element at index
     inline T get(uint32_t index) const
     {
@@ -88,6 +94,13 @@ public:
         ++numElements;
     }
 
+    // removes the last element from the list and returns it
+    inline T removeLast()
+    {
+        --numElements;
+        return array[numElements];
+    }
+
     // inserts the given value into the list at index i, moving everything after it forward
     // runs in linear (not constant) time
     inline void insert(uint32_t pos, const T &newElem)
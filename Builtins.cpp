@@ -4,12 +4,16 @@
 #include <string.h>
 #include <math.h>
 #include <errno.h>
+#include <ctype.h>
 #include "globals.h"
 #include "Builtins.hpp"
 #include "ScriptVariant.hpp"
 #include "List.hpp"
 #include "ObjectHeap.hpp"
+#include "HeapSnapshot.hpp"
+#include "AllocProfiler.hpp"
 #include "FakeEngineTypes.hpp"
+#include "ScriptUtils.h"
 
 static bool builtinsInited = false;
 static List<unsigned int> builtinIndices;
@@ -19,13 +23,13 @@ static ScriptVariant globalsObject = {{.ptrVal = NULL}, .vt = VT_EMPTY};
 extern int script_arg_count;
 extern char **script_args;
 
-// mark the globals object as referenced for GC purposes
-void pushGlobalVariantsToGC()
+// the globals object is a garbage collection root
+void visitGlobalVariants(RootVisitor visitor, void *data)
 {
     // this check is necessary because the globals object might not be initialized yet
     if (globalsObject.vt == VT_OBJECT)
     {
-        GarbageCollector_PushGray(globalsObject.objVal);
+        visitor(&globalsObject, ROOT_GLOBALS_OBJECT, NULL, 0, data);
     }
 }
 
@@ -83,7 +87,7 @@ CCResult builtin_get_args(int numParams, ScriptVariant *params, ScriptVariant *r
         stringVar.strVal = StrCache_Pop(len);
         stringVar.vt = VT_STR;
         snprintf(StrCache_Get(stringVar.strVal), len + 1, "%s", script_args[i]);
-        StrCache_SetHash(stringVar.strVal);
+        stringVar.strVal = StrCache_Intern(stringVar.strVal);
         ObjectHeap_SetListMember(list, i, &stringVar);
     }
 
@@ -263,6 +267,163 @@ CCResult builtin_globals(int numParams, ScriptVariant *params, ScriptVariant *re
     return CC_OK;
 }
 
+// sets a member of an object using a C string as the key
+static void setObjectMember(int object, const char *key, const ScriptVariant *value)
+{
+    ScriptVariant keyVar;
+    ScriptVariant_ParseStringConstant(&keyVar, (char*) key);
+    ObjectHeap_SetObjectMember(object, &keyVar, value);
+    ScriptVariant_Unref(&keyVar);
+}
+
+// sets a member of an object to an integer
+static void setIntegerMember(int object, const char *key, int32_t value)
+{
+    ScriptVariant var;
+    var.lVal = value;
+    var.vt = VT_INTEGER;
+    setObjectMember(object, key, &var);
+}
+
+// sets a member of an object to a new string with the given contents
+static void setStringMember(int object, const char *key, const char *value)
+{
+    ScriptVariant var;
+    int len = strlen(value);
+    var.strVal = StrCache_Pop(len);
+    var.vt = VT_STR;
+    memcpy(StrCache_Get(var.strVal), value, len + 1);
+    var.strVal = StrCache_Intern(var.strVal);
+    setObjectMember(object, key, &var);
+}
+
+// sets a member of an object to a list of integers
+static void setHistogramMember(int object, const char *key, const unsigned int *histogram, int numBuckets)
+{
+    ScriptVariant listVar, bucketVar;
+    listVar.objVal = ObjectHeap_CreateNewList(numBuckets);
+    listVar.vt = VT_LIST;
+    bucketVar.vt = VT_INTEGER;
+    for (int i = 0; i < numBuckets; i++)
+    {
+        bucketVar.lVal = histogram[i];
+        ObjectHeap_SetListMember(listVar.objVal, i, &bucketVar);
+    }
+    setObjectMember(object, key, &listVar);
+}
+
+// heap_snapshot(path)
+// writes a snapshot of the object heap to a file, for use with "runscript --heap-analyze" (see HeapSnapshot.hpp)
+CCResult builtin_heap_snapshot(int numParams, ScriptVariant *params, ScriptVariant *retval)
+{
+    if (numParams != 1)
+    {
+        printf("Error: heap_snapshot(path) requires exactly 1 parameter\n");
+        return CC_FAIL;
+    }
+    else if (params[0].vt != VT_STR)
+    {
+        printf("Error: heap_snapshot(path): parameter must be a string\n");
+        return CC_FAIL;
+    }
+
+    retval->vt = VT_EMPTY;
+    return HeapSnapshot_Write(StrCache_Get(params[0].strVal));
+}
+
+// heap_stats()
+// returns an object with statistics about the object heap and the garbage collector (see HeapStats in ObjectHeap.hpp)
+CCResult builtin_heap_stats(int numParams, ScriptVariant *params, ScriptVariant *retval)
+{
+    if (numParams != 0)
+    {
+        printf("Error: heap_stats() takes no parameters\n");
+        return CC_FAIL;
+    }
+
+    HeapStats stats;
+    ObjectHeap_GetStats(&stats);
+
+    int object = ObjectHeap_CreateNewObject(16);
+    setIntegerMember(object, "objects", stats.liveObjects);
+    setIntegerMember(object, "lists", stats.liveLists);
+    setIntegerMember(object, "object_bytes", stats.objectBytes);
+    setIntegerMember(object, "list_bytes", stats.listBytes);
+    setIntegerMember(object, "persistent", stats.persistentContainers);
+    setIntegerMember(object, "temporary", stats.temporaryContainers);
+    setIntegerMember(object, "gc_cycles", stats.gcCycles);
+    setIntegerMember(object, "promotions", stats.promotions);
+    setIntegerMember(object, "temp_refs_high_water", stats.tempRefsHighWater);
+    setHistogramMember(object, "mark_time_histogram", stats.markTimeHistogram, GC_HISTOGRAM_BUCKETS);
+    setHistogramMember(object, "sweep_time_histogram", stats.sweepTimeHistogram, GC_HISTOGRAM_BUCKETS);
+
+    retval->objVal = object;
+    retval->vt = VT_OBJECT;
+    return CC_OK;
+}
+
+// alloc_profile_start([sample_interval])
+// starts the allocation profiler, recording one in every sample_interval allocations (see AllocProfiler.hpp)
+CCResult builtin_alloc_profile_start(int numParams, ScriptVariant *params, ScriptVariant *retval)
+{
+    if (numParams > 1)
+    {
+        printf("Error: alloc_profile_start([sample_interval]) takes at most 1 parameter\n");
+        return CC_FAIL;
+    }
+    else if (numParams == 1 && (params[0].vt != VT_INTEGER || params[0].lVal <= 0))
+    {
+        printf("Error: alloc_profile_start(sample_interval): parameter must be a positive integer\n");
+        return CC_FAIL;
+    }
+
+    AllocProfiler_Start(numParams ? params[0].lVal : ALLOC_PROFILER_DEFAULT_INTERVAL);
+    retval->vt = VT_EMPTY;
+    return CC_OK;
+}
+
+// alloc_profile_stop()
+// Stops the allocation profiler and returns a list of allocation sites, largest first. Each site is an object with
+// the keys function, file, instruction, operation, type ("object", "list" or "string"), count and bytes.
+CCResult builtin_alloc_profile_stop(int numParams, ScriptVariant *params, ScriptVariant *retval)
+{
+    static const char *kindNames[] = {"object", "list", "string"};
+    if (numParams != 0)
+    {
+        printf("Error: alloc_profile_stop() takes no parameters\n");
+        return CC_FAIL;
+    }
+
+    // stop first so that building the result isn't profiled
+    AllocProfiler_Stop();
+    int numSites = AllocProfiler_SortSites();
+    int list = ObjectHeap_CreateNewList(numSites);
+    for (int i = 0; i < numSites; i++)
+    {
+        AllocSiteInfo info;
+        AllocProfiler_GetSite(i, &info);
+
+        ScriptVariant siteVar;
+        siteVar.objVal = ObjectHeap_CreateNewObject(8);
+        siteVar.vt = VT_OBJECT;
+        if (info.functionName)
+        {
+            setStringMember(siteVar.objVal, "function", info.functionName);
+            setStringMember(siteVar.objVal, "file", info.fileName);
+        }
+        setIntegerMember(siteVar.objVal, "instruction", info.instruction);
+        setStringMember(siteVar.objVal, "operation", info.operation);
+        setStringMember(siteVar.objVal, "type", kindNames[info.kind]);
+        setIntegerMember(siteVar.objVal, "count", info.count);
+        setIntegerMember(siteVar.objVal, "bytes", info.bytes);
+        ObjectHeap_SetListMember(list, i, &siteVar);
+    }
+
+    retval->objVal = list;
+    retval->vt = VT_LIST;
+    return CC_OK;
+}
+
 // string_char_at(string, index)
 // returns the character (as an integer)
 CCResult builtin_string_char_at(int numParams, ScriptVariant *params, ScriptVariant *retval)
@@ -283,7 +444,7 @@ CCResult builtin_string_char_at(int numParams, ScriptVariant *params, ScriptVari
         return CC_FAIL;
     }
 
-    const char *string = StrCache_Get(params[0].strVal);
+    const char *string = StrCache_GetData(params[0].strVal);
     int index = params[1].lVal;
 
     if (index < 0)
@@ -330,6 +491,13 @@ CCResult builtin_to_decimal(int numParams, ScriptVariant *params, ScriptVariant
     else if (params[0].vt == VT_STR)
     {
         // Parse double-precision floating point value from string.
+        if (parseDecimal(StrCache_GetData(params[0].strVal), StrCache_Len(params[0].strVal), &retval->dblVal))
+        {
+            retval->vt = VT_DECIMAL;
+            return CC_OK;
+        }
+
+        // strtod() handles everything the fast path doesn't, like hexadecimal and very large or precise values
         const char *str = StrCache_Get(params[0].strVal);
         char *endptr;
         errno = 0;
@@ -402,10 +570,19 @@ CCResult builtin_to_integer(int numParams, ScriptVariant *params, ScriptVariant
         {
             // Parse 32-bit int from string. Accept values that would fit in a 32-bit signed or unsigned int, but
             // not anything that would overflow 32 bits.
+            int64_t int64val;
+            if (parseInteger(StrCache_GetData(params[0].strVal), StrCache_Len(params[0].strVal), &int64val) &&
+                int64val >= INT32_MIN && int64val <= UINT32_MAX)
+            {
+                retval->lVal = (int32_t) int64val;
+                retval->vt = VT_INTEGER;
+                return CC_OK;
+            }
+
             const char *str = StrCache_Get(params[0].strVal);
             char *endptr;
             errno = 0;
-            int64_t int64val = strtoll(str, &endptr, 10);
+            int64val = strtoll(str, &endptr, 10);
             if (errno == ERANGE || int64val < INT32_MIN || int64val > UINT32_MAX)
             {
                 printf("Error: '%s' is too large or small to fit in a 32-bit integer\n", str);
@@ -448,16 +625,226 @@ CCResult builtin_to_string(int numParams, ScriptVariant *params, ScriptVariant *
         *retval = params[0];
         return CC_OK;
     }
+    else if (params[0].vt == VT_INTEGER && StrCache_SmallInteger(params[0].lVal) >= 0)
+    {
+        retval->strVal = StrCache_SmallInteger(params[0].lVal);
+        retval->vt = VT_STR;
+        return CC_OK;
+    }
 
     int length = ScriptVariant_ToString(&params[0], NULL, 0);
     int strCacheIndex = StrCache_Pop(length);
     ScriptVariant_ToString(&params[0], StrCache_Get(strCacheIndex), length + 1);
-    StrCache_SetHash(strCacheIndex);
+    strCacheIndex = StrCache_Intern(strCacheIndex);
     retval->strVal = strCacheIndex;
     retval->vt = VT_STR;
     return CC_OK;
 }
 
+// Output of format(), which is built in two passes over the format string: one with a NULL buffer that only measures
+// the result and checks the arguments, and one that writes it into a string of exactly that length.
+struct FormatOutput {
+    char *buffer;
+    int length;
+
+    inline void append(const char *str, int count)
+    {
+        if (buffer) memcpy(buffer + length, str, count);
+        length += count;
+    }
+
+    inline void fill(char c, int count)
+    {
+        if (count <= 0) return;
+        if (buffer) memset(buffer + length, c, count);
+        length += count;
+    }
+};
+
+// width and precision of a format() placeholder can't be larger than this
+#define FORMAT_MAX_WIDTH 255
+
+// writes the result of format() to buffer, or just measures it if buffer is NULL; returns its length, or -1 if the
+// format string or the arguments are invalid
+static int formatValues(char *buffer, int formatString, int numArgs, const ScriptVariant *args)
+{
+    FormatOutput out = {buffer, 0};
+    const char *format = StrCache_GetData(formatString);
+    int formatLength = StrCache_Len(formatString);
+    int argIndex = 0;
+
+    for (int i = 0; i < formatLength;)
+    {
+        const char *percent = (const char*) memchr(format + i, '%', formatLength - i);
+        int end = percent ? percent - format : formatLength;
+        out.append(format + i, end - i);
+        if (end == formatLength) break;
+        i = end + 1;
+
+        if (i < formatLength && format[i] == '%')
+        {
+            out.append("%", 1);
+            i++;
+            continue;
+        }
+
+        bool leftAlign = false, zeroPad = false;
+        int width = 0, precision = -1;
+        for (; i < formatLength && (format[i] == '-' || format[i] == '0'); i++)
+        {
+            if (format[i] == '-') leftAlign = true;
+            else zeroPad = true;
+        }
+        for (; i < formatLength && format[i] >= '0' && format[i] <= '9' && width <= FORMAT_MAX_WIDTH; i++)
+        {
+            width = width * 10 + (format[i] - '0');
+        }
+        if (i < formatLength && format[i] == '.')
+        {
+            for (precision = 0, i++; i < formatLength && format[i] >= '0' && format[i] <= '9' &&
+                                     precision <= FORMAT_MAX_WIDTH; i++)
+            {
+                precision = precision * 10 + (format[i] - '0');
+            }
+        }
+
+        if (width > FORMAT_MAX_WIDTH || precision > FORMAT_MAX_WIDTH)
+        {
+            printf("Error: format(): width and precision can't be larger than %i\n", FORMAT_MAX_WIDTH);
+            return -1;
+        }
+        else if (i == formatLength)
+        {
+            printf("Error: format(): incomplete placeholder at the end of the format string\n");
+            return -1;
+        }
+        else if (argIndex == numArgs)
+        {
+            printf("Error: format(): not enough arguments for the format string\n");
+            return -1;
+        }
+
+        const ScriptVariant *arg = &args[argIndex++];
+        char conversion = format[i++];
+        if (conversion == 's' || conversion == 'j')
+        {
+            // strings and JSON can be any length, so they're written straight to the output
+            int itemLength = (conversion == 's') ? ScriptVariant_ToString(arg, NULL, 0) :
+                                                   ScriptVariant_ToJSON(arg, NULL, 0);
+            if (precision >= 0 && itemLength > precision)
+            {
+                itemLength = precision;
+            }
+            if (!leftAlign) out.fill(' ', width - itemLength);
+            if (out.buffer)
+            {
+                if (conversion == 's')
+                    ScriptVariant_ToString(arg, out.buffer + out.length, itemLength + 1);
+                else
+                    ScriptVariant_ToJSON(arg, out.buffer + out.length, itemLength + 1);
+            }
+            out.length += itemLength;
+            if (leftAlign) out.fill(' ', width - itemLength);
+            continue;
+        }
+
+        // large enough for any double with the maximum precision
+        char number[320 + FORMAT_MAX_WIDTH];
+        int numberLength;
+        double decimalValue;
+        if ((conversion == 'd' || conversion == 'x') && arg->vt == VT_INTEGER)
+        {
+            numberLength = (conversion == 'd') ? formatInteger(number, arg->lVal) :
+                                                 snprintf(number, sizeof(number), "%x", (unsigned int) arg->lVal);
+        }
+        else if (conversion == 'f' && ScriptVariant_DecimalValue(arg, &decimalValue) == CC_OK)
+        {
+            numberLength = (precision < 0 || precision == 6) ? formatDecimal(number, decimalValue) : -1;
+            if (numberLength < 0)
+            {
+                numberLength = snprintf(number, sizeof(number), "%.*f", precision < 0 ? 6 : precision, decimalValue);
+            }
+        }
+        else if (conversion == 'd' || conversion == 'x' || conversion == 'f')
+        {
+            printf("Error: format(): argument %i must be %s for the '%%%c' placeholder\n",
+                argIndex, (conversion == 'f') ? "a number" : "an integer", conversion);
+            return -1;
+        }
+        else
+        {
+            printf("Error: format(): unknown placeholder '%%%c'\n", conversion);
+            return -1;
+        }
+
+        if (leftAlign)
+        {
+            out.append(number, numberLength);
+            out.fill(' ', width - numberLength);
+        }
+        else if (zeroPad)
+        {
+            // zeros go after the sign
+            int sign = (number[0] == '-') ? 1 : 0;
+            out.append(number, sign);
+            out.fill('0', width - numberLength);
+            out.append(number + sign, numberLength - sign);
+        }
+        else
+        {
+            out.fill(' ', width - numberLength);
+            out.append(number, numberLength);
+        }
+    }
+
+    if (argIndex < numArgs)
+    {
+        printf("Error: format(): %i arguments given for %i placeholders\n", numArgs, argIndex);
+        return -1;
+    }
+    return out.length;
+}
+
+// format(fmt, ...)
+// Returns fmt with each placeholder replaced by the next argument, similar to C's sprintf(). A placeholder is '%',
+// optionally followed by '-' to align left or '0' to pad numbers with zeros, a minimum width, and '.' and a precision,
+// then one of these:
+//      s: the value converted to a string; the precision is the maximum length
+//      j: the value as JSON, with strings quoted and escaped
+//      d: an integer
+//      x: an integer in hexadecimal
+//      f: a number as a decimal, with precision digits after the point (6 by default)
+// "%%" is a literal '%'.
+CCResult builtin_format(int numParams, ScriptVariant *params, ScriptVariant *retval)
+{
+    if (numParams < 1)
+    {
+        printf("Error: format(fmt, ...) requires at least 1 parameter\n");
+        return CC_FAIL;
+    }
+    else if (params[0].vt != VT_STR)
+    {
+        printf("Error: format(fmt, ...): first parameter must be a string\n");
+        return CC_FAIL;
+    }
+
+    // measure the result first so that it's only allocated once
+    int length = formatValues(NULL, params[0].strVal, numParams - 1, params + 1);
+    if (length < 0)
+    {
+        return CC_FAIL;
+    }
+
+    int result = StrCache_Pop(length);
+    char *buffer = StrCache_Get(result);
+    formatValues(buffer, params[0].strVal, numParams - 1, params + 1);
+    buffer[length] = '\0';
+
+    retval->strVal = StrCache_Intern(result);
+    retval->vt = VT_STR;
+    return CC_OK;
+}
+
 // char_from_integer(ascii)
 // returns a 1-character string with the character described by the ASCII value
 CCResult builtin_char_from_integer(int numParams, ScriptVariant *params, ScriptVariant *retval)
@@ -473,13 +860,7 @@ CCResult builtin_char_from_integer(int numParams, ScriptVariant *params, ScriptV
         return CC_FAIL;
     }
 
-    int stringIndex = StrCache_Pop(1);
-    char *string = StrCache_Get(stringIndex);
-    string[0] = params[0].lVal;
-    string[1] = 0;
-    StrCache_SetHash(stringIndex);
-
-    retval->strVal = stringIndex;
+    retval->strVal = StrCache_Char(params[0].lVal);
     retval->vt = VT_STR;
 
     return CC_OK;
@@ -523,12 +904,13 @@ CCResult builtin_file_read(int numParams, ScriptVariant *params, ScriptVariant *
 
     if (ferror(fp))
     {
-        printf("Error: failed to read from file '%s'\n", path);
+        // creating the new string may have moved the path
+        printf("Error: failed to read from file '%s'\n", StrCache_Get(params[0].strVal));
         fclose(fp);
         return CC_FAIL;
     }
 
-    StrCache_SetHash(stringIndex);
+    stringIndex = StrCache_Intern(stringIndex);
     retval->strVal = stringIndex;
     retval->vt = VT_STR;
 
@@ -617,7 +999,6 @@ CCResult method_substring(int numParams, ScriptVariant *params, ScriptVariant *r
     }
 
     int sourceLength = StrCache_Len(params[0].strVal);
-    const char *sourceString = StrCache_Get(params[0].strVal);
     int start = params[1].lVal;
     int end = (numParams > 2) ? params[2].lVal : sourceLength;
     int length = end - start;
@@ -625,7 +1006,7 @@ CCResult method_substring(int numParams, ScriptVariant *params, ScriptVariant *r
     if (start < 0 || start >= sourceLength)
     {
         printf("Error: start position %i is not a valid index in the string '%s' with length %i\n",
-            start, sourceString, sourceLength);
+            start, StrCache_Get(params[0].strVal), sourceLength);
         return CC_FAIL;
     }
     else if (end < start)
@@ -636,17 +1017,253 @@ CCResult method_substring(int numParams, ScriptVariant *params, ScriptVariant *r
     else if (end > sourceLength)
     {
         printf("Error: end (%i) is beyond the end of the string '%s' with length %i\n",
-            end, sourceString, sourceLength);
+            end, StrCache_Get(params[0].strVal), sourceLength);
+        return CC_FAIL;
+    }
+
+    retval->strVal = StrCache_Slice(params[0].strVal, start, length);
+    retval->vt = VT_STR;
+    return CC_OK;
+}
+
+// Checks the parameters of a string method that takes between minArgs and maxArgs arguments, of which the first
+// numStringArgs must be strings. Prints an error and returns false if they're wrong.
+static bool checkStringMethod(const char *usage, int numParams, ScriptVariant *params,
+                              int minArgs, int maxArgs, int numStringArgs)
+{
+    // this is a method, so we're guaranteed at least 1 param, so accessing params[0] here is safe
+    if (params[0].vt != VT_STR)
+    {
+        printf("Error: only strings have the %s method\n", usage);
+        return false;
+    }
+    // the string the method is called on is included in numParams, so use numParams-1 in the error message
+    else if (numParams - 1 < minArgs || numParams - 1 > maxArgs)
+    {
+        printf("Error: the %s method takes %i to %i arguments, not %i\n", usage, minArgs, maxArgs, numParams - 1);
+        return false;
+    }
+
+    for (int i = 1; i <= numStringArgs && i < numParams; i++)
+    {
+        if (params[i].vt != VT_STR)
+        {
+            printf("Error: argument %i of the %s method must be a string\n", i, usage);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Returns the position of the first occurrence of needle in haystack at or after start, or -1 if there isn't one.
+// memchr() is vectorized by the C library, so it's used to skip ahead to each candidate first character.
+static int findString(const char *haystack, int haystackLength, const char *needle, int needleLength, int start)
+{
+    if (needleLength == 0)
+        return start;
+    else if (haystackLength - start < needleLength)
+        return -1;
+
+    const char *pos = haystack + start;
+    const char *last = haystack + haystackLength - needleLength; // last position the needle could start at
+    while (pos <= last)
+    {
+        pos = (const char*) memchr(pos, needle[0], last - pos + 1);
+        if (pos == NULL)
+            return -1;
+        else if (memcmp(pos + 1, needle + 1, needleLength - 1) == 0)
+            return pos - haystack;
+        pos++;
+    }
+    return -1;
+}
+
+// counts the non-overlapping occurrences of needle, which must not be empty, in haystack
+static int countString(const char *haystack, int haystackLength, const char *needle, int needleLength)
+{
+    int count = 0;
+    for (int pos = findString(haystack, haystackLength, needle, needleLength, 0); pos >= 0;
+         pos = findString(haystack, haystackLength, needle, needleLength, pos + needleLength))
+    {
+        count++;
+    }
+    return count;
+}
+
+// string.index_of(substring[, start])
+// returns the position of the first occurrence of substring at or after start, or -1 if there isn't one
+CCResult method_index_of(int numParams, ScriptVariant *params, ScriptVariant *retval)
+{
+    if (!checkStringMethod("index_of(substring[, start])", numParams, params, 1, 2, 1))
+    {
+        return CC_FAIL;
+    }
+    else if (numParams > 2 && params[2].vt != VT_INTEGER)
+    {
+        printf("Error: the start position for index_of() must be an integer\n");
+        return CC_FAIL;
+    }
+
+    int length = StrCache_Len(params[0].strVal);
+    int start = (numParams > 2) ? params[2].lVal : 0;
+    if (start < 0 || start > length)
+    {
+        printf("Error: start position %i is not a valid index in a string with length %i\n", start, length);
+        return CC_FAIL;
+    }
+
+    retval->lVal = findString(StrCache_GetData(params[0].strVal), length,
+                              StrCache_GetData(params[1].strVal), StrCache_Len(params[1].strVal), start);
+    retval->vt = VT_INTEGER;
+    return CC_OK;
+}
+
+// string.last_index_of(substring)
+// returns the position of the last occurrence of substring, or -1 if there isn't one
+CCResult method_last_index_of(int numParams, ScriptVariant *params, ScriptVariant *retval)
+{
+    if (!checkStringMethod("last_index_of(substring)", numParams, params, 1, 1, 1))
+    {
+        return CC_FAIL;
+    }
+
+    const char *string = StrCache_GetData(params[0].strVal), *needle = StrCache_GetData(params[1].strVal);
+    int length = StrCache_Len(params[0].strVal), needleLength = StrCache_Len(params[1].strVal);
+
+    retval->lVal = (needleLength == 0) ? length : -1;
+    retval->vt = VT_INTEGER;
+    for (int pos = length - needleLength; pos >= 0 && needleLength > 0; pos--)
+    {
+        if (string[pos] == needle[0] && memcmp(string + pos, needle, needleLength) == 0)
+        {
+            retval->lVal = pos;
+            break;
+        }
+    }
+    return CC_OK;
+}
+
+// string.starts_with(prefix)
+// returns 1 if the string starts with prefix, or 0 if it doesn't
+CCResult method_starts_with(int numParams, ScriptVariant *params, ScriptVariant *retval)
+{
+    if (!checkStringMethod("starts_with(prefix)", numParams, params, 1, 1, 1))
+    {
+        return CC_FAIL;
+    }
+
+    int prefixLength = StrCache_Len(params[1].strVal);
+    retval->lVal = prefixLength <= StrCache_Len(params[0].strVal) &&
+                   memcmp(StrCache_GetData(params[0].strVal), StrCache_GetData(params[1].strVal), prefixLength) == 0;
+    retval->vt = VT_INTEGER;
+    return CC_OK;
+}
+
+// string.trim()
+// returns the string without any whitespace at its start or end
+CCResult method_trim(int numParams, ScriptVariant *params, ScriptVariant *retval)
+{
+    if (!checkStringMethod("trim()", numParams, params, 0, 0, 0))
+    {
+        return CC_FAIL;
+    }
+
+    const char *string = StrCache_GetData(params[0].strVal);
+    int start = 0, end = StrCache_Len(params[0].strVal);
+    while (start < end && isspace((unsigned char) string[start])) start++;
+    while (end > start && isspace((unsigned char) string[end - 1])) end--;
+
+    if (start == 0 && end == StrCache_Len(params[0].strVal))
+        retval->strVal = params[0].strVal;
+    else
+        retval->strVal = StrCache_Slice(params[0].strVal, start, end - start);
+    retval->vt = VT_STR;
+    return CC_OK;
+}
+
+// string.split(separator)
+// returns a list of the parts of the string between occurrences of separator
+CCResult method_split(int numParams, ScriptVariant *params, ScriptVariant *retval)
+{
+    if (!checkStringMethod("split(separator)", numParams, params, 1, 1, 1))
+    {
+        return CC_FAIL;
+    }
+    else if (StrCache_Len(params[1].strVal) == 0)
+    {
+        printf("Error: the separator for split() can't be empty\n");
+        return CC_FAIL;
+    }
+
+    int string = params[0].strVal, separator = params[1].strVal;
+    int length = StrCache_Len(string), separatorLength = StrCache_Len(separator);
+
+    // count the parts first so that the list is only allocated once
+    int numParts = countString(StrCache_GetData(string), length, StrCache_GetData(separator), separatorLength) + 1;
+    int list = ObjectHeap_CreateNewList(numParts);
+
+    int start = 0;
+    for (int i = 0; i < numParts; i++)
+    {
+        // creating a part can move the contents of short strings, so get them again each time
+        int end = (i == numParts - 1) ? length :
+            findString(StrCache_GetData(string), length, StrCache_GetData(separator), separatorLength, start);
+        ScriptVariant part;
+        part.strVal = StrCache_Slice(string, start, end - start);
+        part.vt = VT_STR;
+        ObjectHeap_SetListMember(list, i, &part);
+        start = end + separatorLength;
+    }
+
+    retval->objVal = list;
+    retval->vt = VT_LIST;
+    return CC_OK;
+}
+
+// string.replace(old, new)
+// returns a copy of the string with every occurrence of old replaced by new
+CCResult method_replace(int numParams, ScriptVariant *params, ScriptVariant *retval)
+{
+    if (!checkStringMethod("replace(old, new)", numParams, params, 2, 2, 2))
+    {
+        return CC_FAIL;
+    }
+    else if (StrCache_Len(params[1].strVal) == 0)
+    {
+        printf("Error: the string to replace can't be empty\n");
         return CC_FAIL;
     }
 
-    int newStrIndex = StrCache_Pop(length);
-    char *newString = StrCache_Get(newStrIndex);
-    memcpy(newString, sourceString + start, length);
-    newString[length] = '\0';
-    StrCache_SetHash(newStrIndex);
+    int string = params[0].strVal, oldString = params[1].strVal, newString = params[2].strVal;
+    int length = StrCache_Len(string), oldLength = StrCache_Len(oldString), newLength = StrCache_Len(newString);
+    int count = countString(StrCache_GetData(string), length, StrCache_GetData(oldString), oldLength);
+    if (count == 0)
+    {
+        retval->strVal = string;
+        retval->vt = VT_STR;
+        return CC_OK;
+    }
+
+    int result = StrCache_Pop(length + count * (newLength - oldLength));
+
+    // StrCache_Pop() can move the contents of short strings, so get them afterwards
+    const char *src = StrCache_GetData(string), *oldData = StrCache_GetData(oldString);
+    const char *newData = StrCache_GetData(newString);
+    char *dst = StrCache_Get(result);
+    int start = 0;
+    for (int i = 0; i < count; i++)
+    {
+        int pos = findString(src, length, oldData, oldLength, start);
+        memcpy(dst, src + start, pos - start);
+        dst += pos - start;
+        memcpy(dst, newData, newLength);
+        dst += newLength;
+        start = pos + oldLength;
+    }
+    memcpy(dst, src + start, length - start);
+    dst[length - start] = '\0';
 
-    retval->strVal = newStrIndex;
+    retval->strVal = StrCache_Intern(result);
     retval->vt = VT_STR;
     return CC_OK;
 }
@@ -695,6 +1312,60 @@ CCResult method_remove(int numParams, ScriptVariant *params, ScriptVariant *retv
     return builtin_list_remove(numParams, params, retval);
 }
 
+// list.join(separator)
+// returns a string of the elements of the list, converted to strings if they aren't already, with separator between
+// each of them
+CCResult method_join(int numParams, ScriptVariant *params, ScriptVariant *retval)
+{
+    if (params[0].vt != VT_LIST)
+    {
+        printf("Error: only lists have the join() method\n");
+        return CC_FAIL;
+    }
+    else if (numParams != 2)
+    {
+        printf("Error: the join(separator) method takes 1 argument, not %i\n", numParams - 1);
+        return CC_FAIL;
+    }
+    else if (params[1].vt != VT_STR)
+    {
+        printf("Error: the separator for join() must be a string\n");
+        return CC_FAIL;
+    }
+
+    // measure the whole string first so that it's only allocated once
+    ScriptList *list = ObjectHeap_GetList(params[0].objVal);
+    int separatorLength = StrCache_Len(params[1].strVal);
+    int length = 0;
+    ScriptVariant element;
+    for (uint32_t i = 0; i < list->size(); i++)
+    {
+        list->get(&element, i);
+        length += (i > 0 ? separatorLength : 0) +
+                  (element.vt == VT_STR ? StrCache_Len(element.strVal) : ScriptVariant_ToString(&element, NULL, 0));
+    }
+
+    int result = StrCache_Pop(length);
+    char *dst = StrCache_Get(result);
+    const char *separator = StrCache_GetData(params[1].strVal);
+    int offset = 0;
+    for (uint32_t i = 0; i < list->size(); i++)
+    {
+        if (i > 0)
+        {
+            memcpy(dst + offset, separator, separatorLength);
+            offset += separatorLength;
+        }
+        list->get(&element, i);
+        offset += ScriptVariant_ToString(&element, dst + offset, length - offset + 1);
+    }
+    dst[length] = '\0';
+
+    retval->strVal = StrCache_Intern(result);
+    retval->vt = VT_STR;
+    return CC_OK;
+}
+
 // object methods
 CCResult method_has_key(int numParams, ScriptVariant *params, ScriptVariant *retval)
 {
@@ -775,43 +1446,60 @@ CCResult method_move(int numParams, ScriptVariant *params, ScriptVariant *retval
 struct Builtin {
     BuiltinScriptFunction function;
     const char *name;
+    VARTYPE resultType; // type of every value it returns, or VT_EMPTY if that depends on the arguments
 };
 
-#define DEF_BUILTIN(name) { builtin_##name, #name }
+#define DEF_BUILTIN(name) { builtin_##name, #name, VT_EMPTY }
+#define DEF_TYPED_BUILTIN(name, type) { builtin_##name, #name, type }
 // define each builtin IN ALPHABETICAL ORDER or binary search won't work
 static Builtin builtinsArray[] = {
+    DEF_BUILTIN(alloc_profile_start),
+    DEF_TYPED_BUILTIN(alloc_profile_stop, VT_LIST),
     DEF_BUILTIN(cc_constant),
-    DEF_BUILTIN(char_from_integer),
+    DEF_TYPED_BUILTIN(char_from_integer, VT_STR),
     DEF_BUILTIN(create_entity),
     DEF_BUILTIN(create_model),
     DEF_BUILTIN(file_read),
-    DEF_BUILTIN(get_args),
+    DEF_TYPED_BUILTIN(format, VT_STR),
+    DEF_TYPED_BUILTIN(get_args, VT_LIST),
     DEF_BUILTIN(globals),
+    DEF_BUILTIN(heap_snapshot),
+    DEF_TYPED_BUILTIN(heap_stats, VT_OBJECT),
     DEF_BUILTIN(list_append),
     DEF_BUILTIN(list_insert),
     DEF_BUILTIN(list_remove),
     DEF_BUILTIN(log),
     DEF_BUILTIN(log_write),
-    DEF_BUILTIN(string_char_at),
-    DEF_BUILTIN(to_decimal),
-    DEF_BUILTIN(to_integer),
-    DEF_BUILTIN(to_string),
+    DEF_TYPED_BUILTIN(string_char_at, VT_INTEGER),
+    DEF_TYPED_BUILTIN(to_decimal, VT_DECIMAL),
+    DEF_TYPED_BUILTIN(to_integer, VT_INTEGER),
+    DEF_TYPED_BUILTIN(to_string, VT_STR),
 };
 #undef DEF_BUILTIN
+#undef DEF_TYPED_BUILTIN
 
-#define DEF_METHOD(name) { method_##name, #name }
+#define DEF_METHOD(name) { method_##name, #name, VT_EMPTY }
+#define DEF_TYPED_METHOD(name, type) { method_##name, #name, type }
 static Builtin methodsArray[] = {
     DEF_METHOD(append),
-    DEF_METHOD(char_at),
-    DEF_METHOD(has_key),
+    DEF_TYPED_METHOD(char_at, VT_INTEGER),
+    DEF_TYPED_METHOD(has_key, VT_INTEGER),
+    DEF_TYPED_METHOD(index_of, VT_INTEGER),
     DEF_METHOD(insert),
-    DEF_METHOD(keys),
-    DEF_METHOD(length),
+    DEF_TYPED_METHOD(join, VT_STR),
+    DEF_TYPED_METHOD(keys, VT_LIST),
+    DEF_TYPED_METHOD(last_index_of, VT_INTEGER),
+    DEF_TYPED_METHOD(length, VT_INTEGER),
     DEF_METHOD(move),
     DEF_METHOD(remove),
-    DEF_METHOD(substring),
+    DEF_TYPED_METHOD(replace, VT_STR),
+    DEF_TYPED_METHOD(split, VT_LIST),
+    DEF_TYPED_METHOD(starts_with, VT_INTEGER),
+    DEF_TYPED_METHOD(substring, VT_STR),
+    DEF_TYPED_METHOD(trim, VT_STR),
 };
 #undef DEF_METHOD
+#undef DEF_TYPED_METHOD
 
 
 // initialize builtin lists for public use
@@ -853,6 +1541,11 @@ const char *getBuiltinName(int index)
     return builtinsArray[index].name;
 }
 
+VARTYPE getBuiltinResultType(int index)
+{
+    return builtinsArray[index].resultType;
+}
+
 // returns index of method with the given name, or -1 if it doesn't exist
 int getMethodIndex(const char *methodName)
 {
@@ -875,3 +1568,8 @@ const char *getMethodName(int index)
     return methodsArray[index].name;
 }
 
+VARTYPE getMethodResultType(int index)
+{
+    return methodsArray[index].resultType;
+}
+
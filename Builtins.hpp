@@ -3,6 +3,7 @@
 
 #include "depends.h"
 #include "ScriptVariant.hpp"
+#include "ObjectHeap.hpp"
 
 typedef CCResult (*BuiltinScriptFunction)(int numParams, ScriptVariant *params, ScriptVariant *retval);
 
@@ -15,6 +16,10 @@ BuiltinScriptFunction getBuiltinByIndex(int index);
 // returns the name of the function with the given index
 const char *getBuiltinName(int index);
 
+// returns the type of every value the function with the given index returns, or VT_EMPTY if it can return more than
+// one type
+VARTYPE getBuiltinResultType(int index);
+
 // returns index of method with the given name, or -1 if it doesn't exist
 int getMethodIndex(const char *methodName);
 
@@ -24,8 +29,11 @@ const char *getMethodName(int index);
 // returns the method with the given index
 BuiltinScriptFunction getMethodByIndex(int index);
 
-// mark script objects in the global variant list as referenced
-void pushGlobalVariantsToGC();
+// like getBuiltinResultType(), for methods
+VARTYPE getMethodResultType(int index);
+
+// pass the globals object to a garbage collection root visitor
+void visitGlobalVariants(RootVisitor visitor, void *data);
 
 // maps the name of an engine constant to its value
 CCResult scriptConstantValue(const ScriptVariant *nameVar, ScriptVariant *result);
@@ -88,9 +88,62 @@ static uint16_t createSrc(RValue *src)
     return (file << 8) | index;
 }
 
+// returns the form of the instruction's opcode that skips type checks if its operands are known to be integers or
+// known to be decimals, or that skips the index checks of a list access known to be in bounds
+static uint8_t specializedOpCode(Instruction *ssaInst)
+{
+    if (ssaInst->indexInBounds)
+        return (ssaInst->op == OP_GET) ? OP_GET_LIST : OP_SET_LIST;
+
+    bool integers = true, decimals = true;
+    foreach_list(ssaInst->operands, RValue*, iter)
+    {
+        ValueType type = iter.value()->knownType();
+        integers = integers && type == TYPE_INTEGER;
+        decimals = decimals && type == TYPE_DECIMAL;
+    }
+
+    if (integers)
+    {
+        switch (ssaInst->op)
+        {
+            case OP_INC:     return OP_INC_I;
+            case OP_DEC:     return OP_DEC_I;
+            case OP_ADD:     return OP_ADD_II;
+            case OP_SUB:     return OP_SUB_II;
+            case OP_MUL:     return OP_MUL_II;
+            case OP_EQ:      return OP_EQ_II;
+            case OP_NE:      return OP_NE_II;
+            case OP_LT:      return OP_LT_II;
+            case OP_GT:      return OP_GT_II;
+            case OP_GE:      return OP_GE_II;
+            case OP_LE:      return OP_LE_II;
+            case OP_BIT_AND: return OP_BIT_AND_II;
+            case OP_SHR:     return OP_SHR_II;
+            default:         return ssaInst->op;
+        }
+    }
+    else if (decimals)
+    {
+        switch (ssaInst->op)
+        {
+            case OP_ADD: return OP_ADD_DD;
+            case OP_SUB: return OP_SUB_DD;
+            case OP_MUL: return OP_MUL_DD;
+            case OP_DIV: return OP_DIV_DD;
+            case OP_LT:  return OP_LT_DD;
+            case OP_GT:  return OP_GT_DD;
+            case OP_GE:  return OP_GE_DD;
+            case OP_LE:  return OP_LE_DD;
+            default:     return ssaInst->op;
+        }
+    }
+    return ssaInst->op;
+}
+
 void FunctionBuilder::createExecInstruction(ExecInstruction *inst, Instruction *ssaInst)
 {
-    inst->opCode = ssaInst->op;
+    inst->opCode = specializedOpCode(ssaInst);
     if (ssaInst->isFunctionCall())
     {
         // call target
@@ -106,7 +159,10 @@ void FunctionBuilder::createExecInstruction(ExecInstruction *inst, Instruction *
             inst->callTarget = nextCallTargetIndex;
             func->callTargets[nextCallTargetIndex++] = target;
         }
+    }
 
+    if (ssaInst->hasParamList())
+    {
         int numParams = ssaInst->operands.size();
         assert(numParams < 256);
         if (numParams > func->maxCallParams)
@@ -147,6 +203,19 @@ FunctionBuilder::FunctionBuilder(SSABuilder *ssaFunc, ExecBuilder *builder)
     assert(func);
 }
 
+// returns the index of an inline site in the table, adding it and the sites it's inside of if they aren't there yet
+static int inlineSiteIndex(InlineSite *site, ArrayList<InlineSite*> *sites)
+{
+    if (!site) return -1;
+    for (uint32_t i = 0; i < sites->size(); i++)
+    {
+        if (sites->get(i) == site) return i;
+    }
+    inlineSiteIndex(site->caller, sites);
+    sites->append(site);
+    return sites->size() - 1;
+}
+
 void FunctionBuilder::run()
 {
     func->interpreter = execBuilder->interpreter;
@@ -157,11 +226,16 @@ void FunctionBuilder::run()
     foreach_list(ssaFunc->instructionList, Instruction*, iter)
     {
         Instruction *inst = iter.value();
-        if (inst->isFunctionCall())
+        if (inst->hasParamList())
         {
             numParams += inst->operands.size() + 1;
             if (inst->op == OP_CALL) ++numCalls;
         }
+        // the result of a call is written even if it's unused, so count destinations as well as sources
+        if (inst->isExpression() && inst->asExpression()->value()->reg >= numTemps)
+        {
+            numTemps = inst->asExpression()->value()->reg + 1;
+        }
         foreach_list(inst->operands, RValue*, srcIter)
         {
             if (srcIter.value()->isTemporary())
@@ -185,6 +259,32 @@ void FunctionBuilder::run()
         if (inst->seqIndex < 0) continue;
         createExecInstruction(&(func->instructions[inst->seqIndex]), inst);
     }
+
+    // record which function each inlined instruction came from
+    ArrayList<InlineSite*> sites;
+    foreach_list(ssaFunc->instructionList, Instruction*, iter)
+    {
+        Instruction *inst = iter.value();
+        if (inst->seqIndex >= 0 && inst->inlineSite)
+        {
+            if (!func->instructionSites)
+            {
+                func->instructionSites = new int[func->numInstructions];
+                for (int i = 0; i < func->numInstructions; i++)
+                    func->instructionSites[i] = -1;
+            }
+            func->instructionSites[inst->seqIndex] = inlineSiteIndex(inst->inlineSite, &sites);
+        }
+    }
+    if (sites.size() > 0)
+    {
+        func->inlineSites = new ExecInlineSite[sites.size()];
+        for (uint32_t i = 0; i < sites.size(); i++)
+        {
+            func->inlineSites[i].function = sites.get(i)->function;
+            func->inlineSites[i].caller = inlineSiteIndex(sites.get(i)->caller, &sites);
+        }
+    }
 }
 
 static void printSrc(uint16_t src)
@@ -241,7 +341,8 @@ void ExecBuilder::printInstructions()
             printf("%i: ", i);
 
             // destination
-            if (inst->opCode >= OP_MOV && inst->opCode <= OP_GET)
+            if ((inst->opCode >= OP_MOV && inst->opCode <= OP_GET) ||
+                (inst->opCode >= OP_CHECK_INT && inst->opCode <= OP_GET_LIST))
             {
                 printf("temp[%i] := ", inst->dst);
             }
@@ -271,6 +372,11 @@ void ExecBuilder::printInstructions()
                 }
 
                 printf("%s ", functionName);
+            }
+
+            if (inst->opCode == OP_CALL || inst->opCode == OP_CALL_BUILTIN || inst->opCode == OP_CALL_METHOD ||
+                inst->opCode == OP_CONCAT)
+            {
                 uint16_t paramCount16 = func->callParams[inst->paramsIndex];
                 assert(paramCount16 >> 8 == FILE_NONE);
                 int paramCount = paramCount16 & 0xff;
@@ -287,7 +393,8 @@ void ExecBuilder::printInstructions()
             }
 
             // jump target
-            if (inst->opCode >= OP_JMP && inst->opCode <= OP_BRANCH_EQUAL)
+            if ((inst->opCode >= OP_JMP && inst->opCode <= OP_BRANCH_EQUAL) ||
+                (inst->opCode >= OP_FORLOOP_LT && inst->opCode <= OP_FORLOOP_GE))
             {
                 printf("=> %i", inst->jumpTarget);
             }
@@ -10,6 +10,7 @@ public:
     List<SSABuilder*> ssaFunctions;
     List<ExecFunction*> execFunctions;
     List<ScriptVariant*> constants;
+    List<int> constantIndices; // index in constants of each constant, by the name from constantKey() in ImportCache
     GlobalState globals;
     Interpreter *interpreter;
 public:
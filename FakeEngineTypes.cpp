@@ -17,7 +17,7 @@ CCResult Model::getScriptProperty(int propertyNameIndex, ScriptVariant *result)
         char *newString = StrCache_Get(newStrIndex);
         memcpy(newString, this->name, length);
         newString[length] = '\0';
-        StrCache_SetHash(newStrIndex);
+        newStrIndex = StrCache_Intern(newStrIndex);
         result->strVal = newStrIndex;
         result->vt = VT_STR;
         return CC_OK;
@@ -0,0 +1,604 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "globals.h"
+#include "HeapSnapshot.hpp"
+#include "Interpreter.hpp"
+#include "ObjectHeap.hpp"
+#include "ArrayList.hpp"
+
+#define SNAPSHOT_HEADER "chronoscript heap snapshot 1"
+
+// ------------------------------------ WRITING ------------------------------------
+
+static const char *rootKindNames[] = {
+    "temp",
+    "param",
+    "call param",
+    "global",
+    "constant",
+    "globals()",
+};
+
+static void writeRoot(const ScriptVariant *var, RootKind kind, const char *owner, int slot, void *data)
+{
+    FILE *fp = (FILE*) data;
+    if (var->vt != VT_OBJECT && var->vt != VT_LIST) return;
+
+    if (kind == ROOT_GLOBALS_OBJECT)
+        fprintf(fp, "R %i %s\n", var->objVal, rootKindNames[kind]);
+    else if (kind == ROOT_GLOBAL || kind == ROOT_CONSTANT)
+        fprintf(fp, "R %i %s %i in %s\n", var->objVal, rootKindNames[kind], slot, owner);
+    else
+        fprintf(fp, "R %i %s %i of %s()\n", var->objVal, rootKindNames[kind], slot, owner);
+}
+
+CCResult HeapSnapshot_Write(const char *path)
+{
+    FILE *fp = fopen(path, "w");
+    if (fp == NULL)
+    {
+        printf("Error: failed to open '%s' to write a heap snapshot\n", path);
+        return CC_FAIL;
+    }
+
+    fprintf(fp, SNAPSHOT_HEADER "\n");
+    Interpreter_VisitRoots(writeRoot, fp);
+    ObjectHeap_WriteSnapshot(fp);
+
+    bool writeFailed = ferror(fp);
+    if (fclose(fp) != 0 || writeFailed)
+    {
+        printf("Error: failed to write heap snapshot to '%s'\n", path);
+        return CC_FAIL;
+    }
+    return CC_OK;
+}
+
+// ------------------------------------ READING ------------------------------------
+
+struct SnapshotNode {
+    int heapIndex;
+    bool isList;
+    bool persistent;
+    int refcount;
+    unsigned long shallowSize;
+    uint32_t firstEdge; // index in HeapSnapshot::edges of this container's first reference
+};
+
+// a reference from a container (or from a root) to a container
+struct SnapshotEdge {
+    int target; // heap index while loading, node index after linking
+    char *label;
+};
+
+class HeapSnapshot {
+public:
+    // Node 0 is a virtual root that refers to every real root, and the other nodes are the containers. The references
+    // of the virtual root are the roots, and the references of any other node are the edges from its firstEdge to the
+    // next node's firstEdge.
+    ArrayList<SnapshotNode> nodes;
+    ArrayList<SnapshotEdge> roots;
+    ArrayList<SnapshotEdge> edges;
+
+    // results of analyze(), all indexed by node
+    int *idom; // immediate dominator, or -1 if not reachable from a root
+    unsigned long *retainedSize;
+    int *retainedCount;
+    const char **pathLabel; // label of the reference to this node on a shortest path from a root
+    int *pathParent; // source of that reference
+
+    HeapSnapshot();
+    ~HeapSnapshot();
+
+    // read a snapshot from a file; returns false on error
+    bool load(const char *path);
+
+    // compute dominators, retained sizes and paths from the roots
+    void analyze();
+
+    // print the path from a root to a node
+    void printPath(int node);
+
+private:
+    inline uint32_t numReferences(int node);
+    inline SnapshotEdge *reference(int node, uint32_t i);
+    void link();
+};
+
+HeapSnapshot::HeapSnapshot()
+    : idom(NULL), retainedSize(NULL), retainedCount(NULL), pathLabel(NULL), pathParent(NULL)
+{
+    SnapshotNode virtualRoot = {-1, false, true, 0, 0, 0};
+    nodes.append(virtualRoot);
+}
+
+HeapSnapshot::~HeapSnapshot()
+{
+    for (uint32_t i = 0; i < roots.size(); i++)
+        free(roots.get(i).label);
+    for (uint32_t i = 0; i < edges.size(); i++)
+        free(edges.get(i).label);
+    free(idom);
+    free(retainedSize);
+    free(retainedCount);
+    free(pathLabel);
+    free(pathParent);
+}
+
+inline uint32_t HeapSnapshot::numReferences(int node)
+{
+    if (node == 0)
+        return roots.size();
+    uint32_t end = ((uint32_t)node + 1 < nodes.size()) ? nodes.getPtr(node + 1)->firstEdge : edges.size();
+    return end - nodes.getPtr(node)->firstEdge;
+}
+
+inline SnapshotEdge *HeapSnapshot::reference(int node, uint32_t i)
+{
+    return (node == 0) ? roots.getPtr(i) : edges.getPtr(nodes.getPtr(node)->firstEdge + i);
+}
+
+// reads a line of any length into a growable buffer and strips the newline; returns false at the end of the file
+static bool readLine(FILE *fp, char **buffer, size_t *capacity)
+{
+    size_t length = 0;
+    while (fgets(*buffer + length, *capacity - length, fp))
+    {
+        length += strlen(*buffer + length);
+        if ((*buffer)[length - 1] == '\n')
+        {
+            (*buffer)[length - 1] = '\0';
+            return true;
+        }
+        else if (length + 1 < *capacity) // last line of the file has no newline
+        {
+            return true;
+        }
+        *capacity *= 2;
+        *buffer = (char*) realloc(*buffer, *capacity);
+    }
+    return length > 0;
+}
+
+bool HeapSnapshot::load(const char *path)
+{
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL)
+    {
+        printf("Error: failed to open heap snapshot '%s'\n", path);
+        return false;
+    }
+
+    size_t capacity = 256;
+    char *line = (char*) malloc(capacity);
+    bool success = readLine(fp, &line, &capacity) && strcmp(line, SNAPSHOT_HEADER) == 0;
+    if (!success)
+    {
+        printf("Error: '%s' is not a heap snapshot\n", path);
+    }
+
+    int lineNumber = 1;
+    while (success && readLine(fp, &line, &capacity))
+    {
+        ++lineNumber;
+        int index, labelStart = 0;
+        if ((line[0] == 'R' || line[0] == 'E') && sscanf(line + 1, " %i %n", &index, &labelStart) == 1 && labelStart)
+        {
+            SnapshotEdge edge = {index, strdup(line + 1 + labelStart)};
+            if (line[0] == 'R')
+                roots.append(edge);
+            else if (nodes.size() > 1)
+                edges.append(edge);
+            else
+                success = false;
+        }
+        else if (line[0] == 'C')
+        {
+            char type[8];
+            unsigned long shallowSize;
+            int persistent, refcount;
+            if (sscanf(line + 1, " %i %7s %lu %i %i", &index, type, &shallowSize, &persistent, &refcount) == 5)
+            {
+                SnapshotNode node = {index, strcmp(type, "list") == 0, persistent != 0, refcount, shallowSize,
+                                     edges.size()};
+                nodes.append(node);
+            }
+            else success = false;
+        }
+        else success = false;
+
+        if (!success)
+        {
+            printf("Error: invalid record in heap snapshot '%s', line %i\n", path, lineNumber);
+        }
+    }
+
+    free(line);
+    fclose(fp);
+    if (success)
+    {
+        link();
+    }
+    return success;
+}
+
+// convert the targets of references from heap indices to node indices
+void HeapSnapshot::link()
+{
+    int maxHeapIndex = 0;
+    for (uint32_t i = 1; i < nodes.size(); i++)
+    {
+        if (nodes.get(i).heapIndex > maxHeapIndex)
+            maxHeapIndex = nodes.get(i).heapIndex;
+    }
+
+    int *nodeForHeapIndex = (int*) malloc((maxHeapIndex + 1) * sizeof(int));
+    for (int i = 0; i <= maxHeapIndex; i++)
+        nodeForHeapIndex[i] = -1;
+    for (uint32_t i = 1; i < nodes.size(); i++)
+        nodeForHeapIndex[nodes.get(i).heapIndex] = i;
+
+    for (uint32_t i = 0; i < nodes.size(); i++)
+    {
+        for (uint32_t j = 0; j < numReferences(i); j++)
+        {
+            SnapshotEdge *edge = reference(i, j);
+            edge->target = (edge->target >= 0 && edge->target <= maxHeapIndex) ? nodeForHeapIndex[edge->target] : -1;
+        }
+    }
+    free(nodeForHeapIndex);
+}
+
+// -------------------------------------- ANALYSIS --------------------------------------
+
+void HeapSnapshot::analyze()
+{
+    int numNodes = nodes.size();
+    idom = (int*) malloc(numNodes * sizeof(int));
+    retainedSize = (unsigned long*) calloc(numNodes, sizeof(unsigned long));
+    retainedCount = (int*) calloc(numNodes, sizeof(int));
+    pathLabel = (const char**) calloc(numNodes, sizeof(const char*));
+    pathParent = (int*) malloc(numNodes * sizeof(int));
+    for (int i = 0; i < numNodes; i++)
+    {
+        idom[i] = -1;
+        pathParent[i] = -1;
+    }
+
+    // find a shortest path from the roots to each node with a breadth-first search
+    int *queue = (int*) malloc(numNodes * sizeof(int));
+    int queueStart = 0, queueEnd = 0;
+    queue[queueEnd++] = 0;
+    pathParent[0] = 0;
+    while (queueStart < queueEnd)
+    {
+        int node = queue[queueStart++];
+        for (uint32_t i = 0; i < numReferences(node); i++)
+        {
+            SnapshotEdge *edge = reference(node, i);
+            if (edge->target >= 0 && pathParent[edge->target] < 0)
+            {
+                pathParent[edge->target] = node;
+                pathLabel[edge->target] = edge->label;
+                queue[queueEnd++] = edge->target;
+            }
+        }
+    }
+
+    // number the reachable nodes in reverse postorder with an iterative depth-first search
+    int *rpoNumber = (int*) malloc(numNodes * sizeof(int));
+    int *nodeForRPO = (int*) malloc(numNodes * sizeof(int));
+    uint32_t *nextReference = (uint32_t*) calloc(numNodes, sizeof(uint32_t));
+    int *stack = queue; // the queue is no longer needed
+    int stackSize = 0, numReachable = 0;
+    for (int i = 0; i < numNodes; i++)
+        rpoNumber[i] = -1;
+    stack[stackSize++] = 0;
+    rpoNumber[0] = 0; // any non-negative value marks the node as visited until it's numbered for real
+    while (stackSize > 0)
+    {
+        int node = stack[stackSize - 1];
+        if (nextReference[node] < numReferences(node))
+        {
+            int target = reference(node, nextReference[node]++)->target;
+            if (target >= 0 && rpoNumber[target] < 0)
+            {
+                rpoNumber[target] = 0;
+                stack[stackSize++] = target;
+            }
+        }
+        else
+        {
+            // nodes are popped in postorder
+            nodeForRPO[numReachable++] = node;
+            --stackSize;
+        }
+    }
+    for (int i = 0; i < numReachable / 2; i++)
+    {
+        int temp = nodeForRPO[i];
+        nodeForRPO[i] = nodeForRPO[numReachable - 1 - i];
+        nodeForRPO[numReachable - 1 - i] = temp;
+    }
+    for (int i = 0; i < numReachable; i++)
+        rpoNumber[nodeForRPO[i]] = i;
+
+    // list the predecessors of each reachable node, by reverse postorder number
+    int *predStart = (int*) calloc(numReachable + 1, sizeof(int));
+    for (int i = 0; i < numReachable; i++)
+    {
+        int node = nodeForRPO[i];
+        for (uint32_t j = 0; j < numReferences(node); j++)
+        {
+            int target = reference(node, j)->target;
+            if (target >= 0) ++predStart[rpoNumber[target] + 1];
+        }
+    }
+    for (int i = 0; i < numReachable; i++)
+        predStart[i + 1] += predStart[i];
+    int *preds = (int*) malloc((predStart[numReachable] + 1) * sizeof(int));
+    int *predFill = (int*) nextReference; // reuse as the insertion point for each node's predecessors
+    memcpy(predFill, predStart, numReachable * sizeof(int));
+    for (int i = 0; i < numReachable; i++)
+    {
+        int node = nodeForRPO[i];
+        for (uint32_t j = 0; j < numReferences(node); j++)
+        {
+            int target = reference(node, j)->target;
+            if (target >= 0) preds[predFill[rpoNumber[target]]++] = i;
+        }
+    }
+
+    // compute immediate dominators, by reverse postorder number, using the iterative algorithm from Cooper, Harvey
+    // and Kennedy's "A Simple, Fast Dominance Algorithm"
+    int *doms = (int*) malloc(numReachable * sizeof(int));
+    for (int i = 0; i < numReachable; i++)
+        doms[i] = -1;
+    doms[0] = 0;
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (int b = 1; b < numReachable; b++)
+        {
+            int newIdom = -1;
+            for (int j = predStart[b]; j < predStart[b + 1]; j++)
+            {
+                int p = preds[j];
+                if (doms[p] < 0) continue;
+                if (newIdom < 0)
+                {
+                    newIdom = p;
+                    continue;
+                }
+                // intersect
+                int finger1 = p, finger2 = newIdom;
+                while (finger1 != finger2)
+                {
+                    while (finger1 > finger2) finger1 = doms[finger1];
+                    while (finger2 > finger1) finger2 = doms[finger2];
+                }
+                newIdom = finger1;
+            }
+            if (doms[b] != newIdom)
+            {
+                doms[b] = newIdom;
+                changed = true;
+            }
+        }
+    }
+
+    // a node's retained size is its own size plus the retained sizes of the nodes it immediately dominates; since
+    // a dominator always comes before the nodes it dominates in reverse postorder, one backward pass adds them up
+    for (int b = numReachable - 1; b >= 0; b--)
+    {
+        int node = nodeForRPO[b];
+        idom[node] = nodeForRPO[doms[b]];
+        retainedSize[node] += nodes.getPtr(node)->shallowSize;
+        retainedCount[node] += (node != 0);
+        if (b > 0)
+        {
+            retainedSize[idom[node]] += retainedSize[node];
+            retainedCount[idom[node]] += retainedCount[node];
+        }
+    }
+
+    free(doms);
+    free(preds);
+    free(predStart);
+    free(nextReference);
+    free(nodeForRPO);
+    free(rpoNumber);
+    free(queue);
+}
+
+void HeapSnapshot::printPath(int node)
+{
+    if (pathParent[node] != 0)
+    {
+        printPath(pathParent[node]);
+        printf(" -> ");
+    }
+    printf("%s", pathLabel[node]);
+}
+
+// totals over every container in a snapshot
+struct SnapshotTotals {
+    int objects;
+    int lists;
+    unsigned long objectBytes;
+    unsigned long listBytes;
+    int unreachable;
+    unsigned long unreachableBytes;
+};
+
+static void computeTotals(HeapSnapshot *snapshot, SnapshotTotals *totals)
+{
+    memset(totals, 0, sizeof(*totals));
+    for (uint32_t i = 1; i < snapshot->nodes.size(); i++)
+    {
+        const SnapshotNode *node = snapshot->nodes.getPtr(i);
+        if (node->isList)
+        {
+            ++totals->lists;
+            totals->listBytes += node->shallowSize;
+        }
+        else
+        {
+            ++totals->objects;
+            totals->objectBytes += node->shallowSize;
+        }
+        if (snapshot->idom[i] < 0)
+        {
+            ++totals->unreachable;
+            totals->unreachableBytes += node->shallowSize;
+        }
+    }
+}
+
+// for sorting things by memory use, largest first
+struct SizeSortEntry {
+    long size;
+    int index;
+};
+
+static int compareSizes(const void *a, const void *b)
+{
+    long sizeA = ((const SizeSortEntry*) a)->size, sizeB = ((const SizeSortEntry*) b)->size;
+    if (sizeA < 0) sizeA = -sizeA;
+    if (sizeB < 0) sizeB = -sizeB;
+    return (sizeA < sizeB) - (sizeA > sizeB);
+}
+
+CCResult HeapSnapshot_PrintAnalysis(const char *path, int maxEntries)
+{
+    HeapSnapshot snapshot;
+    if (!snapshot.load(path)) return CC_FAIL;
+    snapshot.analyze();
+
+    SnapshotTotals totals;
+    computeTotals(&snapshot, &totals);
+    printf("Heap snapshot '%s': %i containers using %lu bytes\n", path, totals.objects + totals.lists,
+           totals.objectBytes + totals.listBytes);
+    printf("  objects: %i containers, %lu bytes\n", totals.objects, totals.objectBytes);
+    printf("  lists: %i containers, %lu bytes\n", totals.lists, totals.listBytes);
+    printf("  not reachable from any root: %i containers, %lu bytes\n", totals.unreachable, totals.unreachableBytes);
+
+    // roots, sorted by retained size
+    int numRoots = snapshot.roots.size();
+    SizeSortEntry *entries = (SizeSortEntry*) malloc((snapshot.nodes.size() + numRoots) * sizeof(SizeSortEntry));
+    int numEntries = 0;
+    for (int i = 0; i < numRoots; i++)
+    {
+        int target = snapshot.roots.get(i).target;
+        if (target < 0) continue;
+        entries[numEntries].size = snapshot.retainedSize[target];
+        entries[numEntries++].index = i;
+    }
+    qsort(entries, numEntries, sizeof(*entries), compareSizes);
+    printf("\nRoots retaining the most memory:\n");
+    printf("%12s %10s  %s\n", "retained", "containers", "root");
+    for (int i = 0; i < numEntries && i < maxEntries; i++)
+    {
+        const SnapshotEdge *root = snapshot.roots.getPtr(entries[i].index);
+        printf("%12lu %10i  %s\n", snapshot.retainedSize[root->target], snapshot.retainedCount[root->target],
+               root->label);
+    }
+
+    // containers, sorted by retained size
+    numEntries = 0;
+    for (uint32_t i = 1; i < snapshot.nodes.size(); i++)
+    {
+        if (snapshot.idom[i] < 0) continue;
+        entries[numEntries].size = snapshot.retainedSize[i];
+        entries[numEntries++].index = i;
+    }
+    qsort(entries, numEntries, sizeof(*entries), compareSizes);
+    printf("\nContainers retaining the most memory:\n");
+    printf("%12s %10s %8s %8s %6s  %s\n", "retained", "containers", "shallow", "index", "type", "path");
+    for (int i = 0; i < numEntries && i < maxEntries; i++)
+    {
+        int node = entries[i].index;
+        const SnapshotNode *container = snapshot.nodes.getPtr(node);
+        printf("%12lu %10i %8lu %8i %6s  ", snapshot.retainedSize[node], snapshot.retainedCount[node],
+               container->shallowSize, container->heapIndex, container->isList ? "list" : "object");
+        snapshot.printPath(node);
+        printf("\n");
+    }
+
+    free(entries);
+    return CC_OK;
+}
+
+CCResult HeapSnapshot_PrintDiff(const char *oldPath, const char *newPath, int maxEntries)
+{
+    HeapSnapshot oldSnapshot, newSnapshot;
+    if (!oldSnapshot.load(oldPath) || !newSnapshot.load(newPath)) return CC_FAIL;
+    oldSnapshot.analyze();
+    newSnapshot.analyze();
+
+    SnapshotTotals oldTotals, newTotals;
+    computeTotals(&oldSnapshot, &oldTotals);
+    computeTotals(&newSnapshot, &newTotals);
+    printf("Changes from heap snapshot '%s' to '%s':\n", oldPath, newPath);
+    printf("  objects: %i -> %i (%+i), %lu -> %lu bytes (%+li)\n", oldTotals.objects, newTotals.objects,
+           newTotals.objects - oldTotals.objects, oldTotals.objectBytes, newTotals.objectBytes,
+           (long) newTotals.objectBytes - (long) oldTotals.objectBytes);
+    printf("  lists: %i -> %i (%+i), %lu -> %lu bytes (%+li)\n", oldTotals.lists, newTotals.lists,
+           newTotals.lists - oldTotals.lists, oldTotals.listBytes, newTotals.listBytes,
+           (long) newTotals.listBytes - (long) oldTotals.listBytes);
+    printf("  not reachable from any root: %i -> %i (%+i), %lu -> %lu bytes (%+li)\n", oldTotals.unreachable,
+           newTotals.unreachable, newTotals.unreachable - oldTotals.unreachable, oldTotals.unreachableBytes,
+           newTotals.unreachableBytes, (long) newTotals.unreachableBytes - (long) oldTotals.unreachableBytes);
+
+    // Match roots by their descriptions. Roots are numbered with the new roots first, then the old roots that have
+    // no match in the new snapshot.
+    int numOldRoots = oldSnapshot.roots.size(), numNewRoots = newSnapshot.roots.size();
+    long *oldRetainedByRoot = (long*) calloc(numNewRoots + numOldRoots, sizeof(long));
+    bool *oldMatched = (bool*) calloc(numOldRoots + 1, sizeof(bool));
+    SizeSortEntry *entries = (SizeSortEntry*) malloc((numNewRoots + numOldRoots + 1) * sizeof(SizeSortEntry));
+    int numEntries = 0;
+    for (int i = 0; i < numNewRoots; i++)
+    {
+        const SnapshotEdge *root = newSnapshot.roots.getPtr(i);
+        if (root->target < 0) continue;
+        for (int j = 0; j < numOldRoots; j++)
+        {
+            const SnapshotEdge *oldRoot = oldSnapshot.roots.getPtr(j);
+            if (!oldMatched[j] && oldRoot->target >= 0 && strcmp(oldRoot->label, root->label) == 0)
+            {
+                oldMatched[j] = true;
+                oldRetainedByRoot[i] = oldSnapshot.retainedSize[oldRoot->target];
+                break;
+            }
+        }
+        entries[numEntries].size = (long) newSnapshot.retainedSize[root->target] - oldRetainedByRoot[i];
+        entries[numEntries++].index = i;
+    }
+    for (int j = 0; j < numOldRoots; j++)
+    {
+        const SnapshotEdge *oldRoot = oldSnapshot.roots.getPtr(j);
+        if (oldMatched[j] || oldRoot->target < 0) continue;
+        oldRetainedByRoot[numNewRoots + j] = oldSnapshot.retainedSize[oldRoot->target];
+        entries[numEntries].size = -oldRetainedByRoot[numNewRoots + j];
+        entries[numEntries++].index = numNewRoots + j;
+    }
+    qsort(entries, numEntries, sizeof(*entries), compareSizes);
+
+    printf("\nRoots whose retained memory changed the most:\n");
+    printf("%12s %12s %12s  %s\n", "old", "new", "change", "root");
+    for (int i = 0; i < numEntries && i < maxEntries && entries[i].size != 0; i++)
+    {
+        int root = entries[i].index;
+        const char *label = (root < numNewRoots) ? newSnapshot.roots.get(root).label
+                                                 : oldSnapshot.roots.get(root - numNewRoots).label;
+        long oldSize = oldRetainedByRoot[root];
+        printf("%12li %12li %+12li  %s\n", oldSize, oldSize + entries[i].size, entries[i].size, label);
+    }
+
+    free(entries);
+    free(oldMatched);
+    free(oldRetainedByRoot);
+    return CC_OK;
+}
@@ -0,0 +1,31 @@
+#ifndef HEAP_SNAPSHOT_HPP
+#define HEAP_SNAPSHOT_HPP
+
+#include "depends.h"
+
+/**
+ * A heap snapshot is a text file listing every live container in the object heap with its index, type, shallow size
+ * (the bytes allocated by the container itself, not counting strings or other containers), persistent flag, refcount
+ * and references to other containers, along with every garbage collection root that refers to a container. The format
+ * is one record per line:
+ *
+ *   R <index> <description of root>
+ *   C <index> <object|list> <shallow size> <persistent> <refcount>
+ *   E <index of referenced container> <key or [list index]>
+ *
+ * where each E line belongs to the C line before it. Snapshots are written by the heap_snapshot() builtin or by the
+ * host calling HeapSnapshot_Write(), and are read by "runscript --heap-analyze" and "runscript --heap-diff".
+ */
+
+// writes a snapshot of the current heap to a file
+CCResult HeapSnapshot_Write(const char *path);
+
+// Prints a summary of a snapshot: totals, the roots that retain the most memory, and the containers with the largest
+// retained sizes. The retained size of a container is the memory that would be freed if it were freed, i.e. the total
+// shallow size of the containers it dominates in the reference graph.
+CCResult HeapSnapshot_PrintAnalysis(const char *path, int maxEntries);
+
+// prints the change in the totals and in the memory retained by each root between two snapshots
+CCResult HeapSnapshot_PrintDiff(const char *oldPath, const char *newPath, int maxEntries);
+
+#endif
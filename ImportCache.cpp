@@ -21,12 +21,28 @@
 #include "RegAlloc.hpp"
 #include "Builtins.hpp"
 #include "ExecBuilder.hpp"
+#include "AllocProfiler.hpp"
+#include "ArrayList.hpp"
 #include "pp_parser.h"
 
 //#define IC_DEBUG 1
 
 List<Interpreter*> compiledScripts; // names are lowercased, forward-slashed paths
 
+// an uncompiled copy of a function that can be inlined into the scripts that import it
+struct InlineTemplate {
+    Interpreter *interpreter; // script the function belongs to
+    ExecFunction *function;
+    SSABuilder *body;
+};
+
+// Functions are compiled before the scripts importing them are linked, so the scripts compiled during the current
+// top-level compileFile() call leave copies of their inlinable functions here. The copies are freed when that call
+// returns.
+static ArrayList<InlineTemplate> inlineTemplates;
+static void *inlineTemplateMemCtx = NULL;
+static int compileDepth = 0;
+
 /**
  * Reads a script file into an allocated buffer.  Be sure to call free() on the
  * returned buffer when you are done with it!
@@ -118,7 +134,15 @@ bool compile(SSABuilder *func)
 
     // optimization passes
     func->foldConstantCalls();
+    func->propagateConstants();
+    func->fuseConcatenations();
+    func->numberValues();
+    func->hoistLoopInvariants();
     func->removeDeadCode();
+    func->inferTypes();
+    if (!func->checkDeclaredTypes()) return false;
+    func->reduceStrength();
+    func->eliminateBoundsChecks();
 
     func->prepareForRegAlloc();
 #if DEBUG_RA
@@ -168,6 +192,8 @@ bool compile(SSABuilder *func)
     func->printInstructionList();
 #endif
 
+    func->fuseCountedLoops();
+
     // give instructions their final indices
     int nextIndex = 0;
     foreach_list(func->instructionList, Instruction*, iter)
@@ -242,8 +268,148 @@ bool link(SSABuilder *func, List<ExecFunction*> *localFunctions, List<Interprete
     return true;
 }
 
-void linkConstants(SSABuilder *func, List<ScriptVariant*> *constants)
+// gives up the references that a template holds to its string constants
+static void releaseTemplate(SSABuilder *body)
+{
+    foreach_list(body->constantList, Constant*, iter)
+    {
+        ScriptVariant *var = &iter.value()->constValue;
+        if (var->vt == VT_STR)
+        {
+            StrCache_Unref(var->strVal);
+        }
+    }
+}
+
+// returns the SSA form of the function that a linked call goes to if it can be inlined, or NULL if it can't
+static SSABuilder *inlinableCallee(FunctionCall *call, ExecBuilder *execBuilder)
+{
+    SSABuilder *callee = NULL;
+    if (execBuilder->ssaFunctions.findByName(call->functionName))
+    {
+        callee = execBuilder->ssaFunctions.retrieve();
+        if (!callee->isInlinable(false)) return NULL;
+    }
+    else
+    {
+        for (uint32_t i = 0; i < inlineTemplates.size(); i++)
+        {
+            if (inlineTemplates.get(i).function == call->functionRef)
+                callee = inlineTemplates.get(i).body;
+        }
+    }
+
+    // the parameters of a function called with the wrong number of arguments aren't all defined
+    if (callee && callee->paramCount != call->operands.size()) return NULL;
+    return callee;
+}
+
+// Replaces calls to small functions with copies of their bodies. Only functions that don't call other script functions
+// are inlined, so recursive functions never are, and every call inlined is one less call left to inline. A function
+// can become inlinable once the calls it makes are inlined, so this goes over the script until nothing changes.
+static void inlineCalls(ExecBuilder *execBuilder)
+{
+    bool changed;
+    do
+    {
+        changed = false;
+        foreach_list(execBuilder->ssaFunctions, SSABuilder*, funcIter)
+        {
+            SSABuilder *func = funcIter.value();
+            ArrayList<FunctionCall*> calls;
+            foreach_list(func->instructionList, Instruction*, iter)
+            {
+                if (iter.value()->op == OP_CALL)
+                    calls.append(iter.value()->asFunctionCall());
+            }
+            for (uint32_t i = 0; i < calls.size(); i++)
+            {
+                SSABuilder *callee = inlinableCallee(calls.get(i), execBuilder);
+                if (callee && callee != func)
+                {
+                    //printf("inlined call to %s in %s\n", callee->functionName, func->functionName);
+                    func->inlineCall(calls.get(i), callee);
+                    changed = true;
+                }
+            }
+        }
+    } while (changed);
+}
+
+// keeps copies of the functions that importing scripts can inline, since compiling changes the originals
+static void saveInlineTemplates(ExecBuilder *execBuilder)
+{
+    foreach_list(execBuilder->ssaFunctions, SSABuilder*, iter)
+    {
+        SSABuilder *func = iter.value();
+        if (!func->isInlinable(true)) continue;
+        if (!inlineTemplateMemCtx)
+            inlineTemplateMemCtx = ralloc_context(NULL);
+        InlineTemplate entry = {
+            execBuilder->interpreter,
+            execBuilder->interpreter->getFunctionNamed(func->functionName),
+            func->clone(inlineTemplateMemCtx)
+        };
+        inlineTemplates.append(entry);
+    }
+}
+
+// forgets the templates of a script that failed to compile, since its functions are about to be freed
+static void removeInlineTemplates(Interpreter *interpreter)
+{
+    for (uint32_t i = inlineTemplates.size(); i > 0; i--)
+    {
+        if (inlineTemplates.get(i - 1).interpreter == interpreter)
+        {
+            releaseTemplate(inlineTemplates.get(i - 1).body);
+            inlineTemplates.remove(i - 1);
+        }
+    }
+}
+
+static void freeInlineTemplates()
+{
+    for (uint32_t i = 0; i < inlineTemplates.size(); i++)
+    {
+        releaseTemplate(inlineTemplates.get(i).body);
+    }
+    inlineTemplates.clear();
+    ralloc_free(inlineTemplateMemCtx);
+    inlineTemplateMemCtx = NULL;
+}
+
+// Returns a name for a constant value, allocated with malloc. Two constants get the same name if they have the same
+// type and are equal, so that they can share a slot in the constants array.
+static char *constantKey(const ScriptVariant *var)
+{
+    char buf[64];
+    switch (var->vt)
+    {
+        case VT_STR:
+        {
+            const char *str = StrCache_Get(var->strVal);
+            char *key = (char*) malloc(strlen(str) + 2);
+            key[0] = 's';
+            strcpy(key + 1, str);
+            return key;
+        }
+        case VT_INTEGER:
+            snprintf(buf, sizeof(buf), "i%d", var->lVal);
+            break;
+        case VT_DECIMAL:
+            snprintf(buf, sizeof(buf), "d%a", var->dblVal);
+            break;
+        default:
+            snprintf(buf, sizeof(buf), "%d:%p", var->vt, var->ptrVal);
+            break;
+    }
+    return strdup(buf);
+}
+
+void linkConstants(SSABuilder *func, ExecBuilder *execBuilder)
 {
+    List<ScriptVariant*> *constants = &execBuilder->constants;
+    List<int> *constantIndices = &execBuilder->constantIndices;
     foreach_list(func->instructionList, Instruction*, instIter)
     {
         Instruction *inst = instIter.value();
@@ -251,30 +417,28 @@ void linkConstants(SSABuilder *func, List<ScriptVariant*> *constants)
         {
             if (!srcIter.value()->isConstant()) continue;
             Constant *c = srcIter.value()->asConstant();
-            int i = 0;
+            if (c->id >= 0) continue;
+
             // try to use an existing constant
-            foreach_plist(constants, ScriptVariant*, constIter)
+            char *key = constantKey(&c->constValue);
+            if (constantIndices->findByName(key))
             {
-                if (c->constValue.vt == constIter.value()->vt &&
-                    ScriptVariant_IsEqual(&c->constValue, constIter.value()))
-                {
-                    c->id = i;
-                    break;
-                }
-                i++;
+                c->id = constantIndices->retrieve();
             }
             // constant doesn't exist yet; add it to the list
-            if (c->id < 0)
+            else
             {
-                assert(i == constants->size());
+                c->id = constants->size();
                 constants->gotoLast();
                 constants->insertAfter(&c->constValue);
-                c->id = i;
+                constantIndices->gotoLast();
+                constantIndices->insertAfter(c->id, key);
                 if (c->constValue.vt == VT_STR)
                 {
                     StrCache_Ref(c->constValue.strVal);
                 }
             }
+            free(key);
         }
     }
     // get the string cache to free unused string constants
@@ -300,6 +464,7 @@ Interpreter *compileFile(const char *filename)
     pp_context ppContext;
     List<Interpreter*> imports;
     int numImports;
+    compileDepth++;
 
     Parser parser(&ppContext, &execBuilder, scriptText, 1, filename);
     parser.parseText();
@@ -325,17 +490,26 @@ Interpreter *compileFile(const char *filename)
     }
     ppContext.clear();
 
+    // every call has to be linked before any can be inlined
+    foreach_list(execBuilder.ssaFunctions, SSABuilder*, iter)
+    {
+        if (!link(iter.value(), &execBuilder.interpreter->functions, &imports)) goto error;
+    }
+    inlineCalls(&execBuilder);
+    saveInlineTemplates(&execBuilder);
+
     foreach_list(execBuilder.ssaFunctions, SSABuilder*, iter)
     {
         SSABuilder *func = iter.value();
-        if (!link(func, &execBuilder.interpreter->functions, &imports)) goto error;
         if (!compile(func)) goto error;
-        linkConstants(func, &execBuilder.constants);
+        linkConstants(func, &execBuilder);
     }
 
     execBuilder.buildExecutable();
     ralloc_free(parser.memCtx);
     free(scriptText);
+    if (--compileDepth == 0)
+        freeInlineTemplates();
 #if DEBUG_EXEC_BUILDER
     execBuilder.printInstructions();
 #endif
@@ -343,6 +517,7 @@ Interpreter *compileFile(const char *filename)
 
 error:
     printf("Failed to compile script '%s'.\n", filename);
+    removeInlineTemplates(execBuilder.interpreter);
     delete execBuilder.interpreter;
     if (compiledScripts.findByName(filename))
     {
@@ -350,6 +525,8 @@ error:
     }
     ralloc_free(parser.memCtx);
     free(scriptText);
+    if (--compileDepth == 0)
+        freeInlineTemplates();
     return NULL;
 }
 
@@ -435,6 +612,8 @@ Interpreter *ImportCache_ImportFile(const char *path)
  */
 void ImportCache_Clear()
 {
+    // the profiler's results refer to the functions that are about to be freed
+    AllocProfiler_Clear();
     foreach_list(compiledScripts, Interpreter*, iter)
     {
         delete iter.value();
@@ -443,3 +622,15 @@ void ImportCache_Clear()
 }
 
 
+
+/**
+ * Passes the globals and constants of every compiled script to a garbage
+ * collection root visitor.
+ */
+void ImportCache_VisitRoots(RootVisitor visitor, void *data)
+{
+    foreach_list(compiledScripts, Interpreter*, iter)
+    {
+        iter.value()->visitRoots(visitor, data);
+    }
+}
@@ -16,6 +16,7 @@ void ImportCache_Init();
 Interpreter *ImportCache_ImportFile(const char *path);
 void ImportCache_Clear();
 ExecFunction *ImportList_GetFunctionPointer(List<Interpreter*> *list, const char *name);
+void ImportCache_VisitRoots(RootVisitor visitor, void *data);
 
 #endif
 
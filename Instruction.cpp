@@ -196,6 +196,28 @@ bool Temporary::isBoolValue()
     }
 }
 
+// knownType: the type this value always has, or TYPE_UNKNOWN
+ValueType RValue::knownType()
+{
+    return TYPE_UNKNOWN;
+}
+
+ValueType Constant::knownType()
+{
+    switch (constValue.vt)
+    {
+        case VT_INTEGER: return TYPE_INTEGER;
+        case VT_DECIMAL: return TYPE_DECIMAL;
+        case VT_STR:     return TYPE_STRING;
+        default:         return TYPE_UNKNOWN;
+    }
+}
+
+ValueType Temporary::knownType()
+{
+    return type;
+}
+
 // empty virtual destructor to silence compiler warnings
 Instruction::~Instruction()
 {
@@ -451,6 +473,8 @@ const char *getOpCodeName(OpCode op)
         case OP_DIV:                 return "div";
         case OP_REM:                 return "rem";
 
+        case OP_CONCAT:              return "concat";
+
         case OP_CALL:                return "call";
         case OP_CALL_BUILTIN:        return "call_builtin";
         case OP_CALL_METHOD:         return "call_method";
@@ -462,6 +486,38 @@ const char *getOpCodeName(OpCode op)
 
         case OP_EXPORT:              return "export";
 
+        case OP_CHECK_INT:           return "check_int";
+        case OP_CHECK_DECIMAL:       return "check_decimal";
+
+        case OP_INC_I:               return "inc_i";
+        case OP_DEC_I:               return "dec_i";
+        case OP_ADD_II:              return "add_ii";
+        case OP_SUB_II:              return "sub_ii";
+        case OP_MUL_II:              return "mul_ii";
+        case OP_EQ_II:               return "eq_ii";
+        case OP_NE_II:               return "ne_ii";
+        case OP_LT_II:               return "lt_ii";
+        case OP_GT_II:               return "gt_ii";
+        case OP_GE_II:               return "ge_ii";
+        case OP_LE_II:               return "le_ii";
+        case OP_BIT_AND_II:          return "bit_and_ii";
+        case OP_SHR_II:              return "shr_ii";
+        case OP_ADD_DD:              return "add_dd";
+        case OP_SUB_DD:              return "sub_dd";
+        case OP_MUL_DD:              return "mul_dd";
+        case OP_DIV_DD:              return "div_dd";
+        case OP_LT_DD:               return "lt_dd";
+        case OP_GT_DD:               return "gt_dd";
+        case OP_GE_DD:               return "ge_dd";
+        case OP_LE_DD:               return "le_dd";
+        case OP_GET_LIST:            return "get_list";
+        case OP_SET_LIST:            return "set_list";
+
+        case OP_FORLOOP_LT:          return "forloop_lt";
+        case OP_FORLOOP_LE:          return "forloop_le";
+        case OP_FORLOOP_GT:          return "forloop_gt";
+        case OP_FORLOOP_GE:          return "forloop_ge";
+
         case OP_ERR:                 return "???";
     }
 
@@ -4,11 +4,40 @@
 #include "ScriptObject.hpp"
 #include "ObjectHeap.hpp"
 #include "Builtins.hpp"
+#include "ImportCache.hpp"
+#include "StrCache.hpp"
 #include "SSABuilder.hpp" // for opcodes
 
 typedef CCResult (*UnaryOperation)(ScriptVariant *dst, const ScriptVariant *src);
 typedef CCResult (*BinaryOperation)(ScriptVariant *dst, const ScriptVariant *src1, const ScriptVariant *src2);
 
+// A script function that is currently executing. Frames are linked from the innermost call outward so that the
+// garbage collector can find every temporary and parameter that is still in use.
+struct ExecFrame {
+    ExecFunction *function;
+    ScriptVariant *temps;
+    ScriptVariant *params;
+    ScriptVariant *callParams;
+    int index; // instruction being executed; only updated before instructions that can allocate
+    ExecFrame *caller;
+};
+
+static ExecFrame *currentFrame = NULL;
+
+// Prints the function that the instruction at the given index is part of, after the functions that were inlined into
+// it to make that instruction, innermost first, as if they had been called. The first line starts with 'prefix'.
+static void printBacktraceEntry(ExecFunction *function, int index, const char *prefix)
+{
+    int site = function->instructionSites ? function->instructionSites[index] : -1;
+    for (; site >= 0; site = function->inlineSites[site].caller)
+    {
+        ExecFunction *inlined = function->inlineSites[site].function;
+        printf("%s %s() in %s\n", prefix, inlined->functionName, inlined->interpreter->fileName);
+        prefix = "called from";
+    }
+    printf("%s %s() in %s\n", prefix, function->functionName, function->interpreter->fileName);
+}
+
 // does the actual work of executing the script
 static CCResult execFunction(ExecFunction *function, ScriptVariant *params, ScriptVariant *retval)
 {
@@ -48,7 +77,13 @@ static CCResult execFunction(ExecFunction *function, ScriptVariant *params, Scri
         ScriptVariant_Div,
         ScriptVariant_Rem,
     };
-    
+
+    // the garbage collector scans every register of every frame, so they can't be left uninitialized
+    memset(temps, 0, function->numTemps * sizeof(ScriptVariant));
+    memset(callParams, 0, function->maxCallParams * sizeof(ScriptVariant));
+    ExecFrame frame = {function, temps, params, callParams, 0, currentFrame};
+    currentFrame = &frame;
+
     #define fetchSrc(dst, src) { \
             if (unlikely((src >> 8) > FILE_CONSTANT))\
             {\
@@ -57,6 +92,11 @@ static CCResult execFunction(ExecFunction *function, ScriptVariant *params, Scri
             else dst = &srcFiles[src >> 8][src & 0xff];\
         }
     #define fetchDst() dst = &temps[inst->dst];
+    // only checked after instructions that can allocate, so that other instructions don't pay for it
+    #define gcSafepoint() { \
+            if (unlikely(GarbageCollector_ShouldCollect()))\
+                Interpreter_CollectGarbage();\
+        }
 
     while(1)
     {
@@ -96,6 +136,44 @@ static CCResult execFunction(ExecFunction *function, ScriptVariant *params, Scri
                 }
                 break;
 
+            // counted loops; the counter is known to be an integer
+            case OP_FORLOOP_LT:
+                fetchSrc(src0, inst->src0);
+                fetchSrc(src1, inst->src1);
+                if (++src0->lVal < src1->lVal)
+                {
+                    index = inst->jumpTarget;
+                    jumped = true;
+                }
+                break;
+            case OP_FORLOOP_LE:
+                fetchSrc(src0, inst->src0);
+                fetchSrc(src1, inst->src1);
+                if (++src0->lVal <= src1->lVal)
+                {
+                    index = inst->jumpTarget;
+                    jumped = true;
+                }
+                break;
+            case OP_FORLOOP_GT:
+                fetchSrc(src0, inst->src0);
+                fetchSrc(src1, inst->src1);
+                if (--src0->lVal > src1->lVal)
+                {
+                    index = inst->jumpTarget;
+                    jumped = true;
+                }
+                break;
+            case OP_FORLOOP_GE:
+                fetchSrc(src0, inst->src0);
+                fetchSrc(src1, inst->src1);
+                if (--src0->lVal >= src1->lVal)
+                {
+                    index = inst->jumpTarget;
+                    jumped = true;
+                }
+                break;
+
             // return
             case OP_RETURN:
                 if (inst->src0)
@@ -108,6 +186,7 @@ static CCResult execFunction(ExecFunction *function, ScriptVariant *params, Scri
                     retval->vt = VT_EMPTY;
                     retval->ptrVal = NULL;
                 }
+                currentFrame = frame.caller;
                 return CC_OK;
 
             // move
@@ -152,6 +231,7 @@ static CCResult execFunction(ExecFunction *function, ScriptVariant *params, Scri
             case OP_MUL:
             case OP_DIV:
             case OP_REM:
+                frame.index = index;
                 fetchDst();
                 fetchSrc(src0, inst->src0);
                 fetchSrc(src1, inst->src1);
@@ -161,13 +241,184 @@ static CCResult execFunction(ExecFunction *function, ScriptVariant *params, Scri
                         getOpCodeName((OpCode)inst->opCode));
                     goto start_backtrace;
                 }
+                // string concatenation and list addition allocate
+                if (dst->vt == VT_STR || dst->vt == VT_LIST)
+                {
+                    gcSafepoint();
+                }
+                break;
+
+            // integer forms of the ops above, for operands known to be integers when the script was compiled
+            case OP_INC_I:
+                fetchDst();
+                fetchSrc(src0, inst->src0);
+                dst->lVal = src0->lVal + 1;
+                dst->vt = VT_INTEGER;
+                break;
+            case OP_DEC_I:
+                fetchDst();
+                fetchSrc(src0, inst->src0);
+                dst->lVal = src0->lVal - 1;
+                dst->vt = VT_INTEGER;
+                break;
+            case OP_ADD_II:
+                fetchDst();
+                fetchSrc(src0, inst->src0);
+                fetchSrc(src1, inst->src1);
+                dst->lVal = src0->lVal + src1->lVal;
+                dst->vt = VT_INTEGER;
+                break;
+            case OP_SUB_II:
+                fetchDst();
+                fetchSrc(src0, inst->src0);
+                fetchSrc(src1, inst->src1);
+                dst->lVal = src0->lVal - src1->lVal;
+                dst->vt = VT_INTEGER;
+                break;
+            case OP_MUL_II:
+                fetchDst();
+                fetchSrc(src0, inst->src0);
+                fetchSrc(src1, inst->src1);
+                dst->lVal = src0->lVal * src1->lVal;
+                dst->vt = VT_INTEGER;
+                break;
+            case OP_EQ_II:
+                fetchDst();
+                fetchSrc(src0, inst->src0);
+                fetchSrc(src1, inst->src1);
+                dst->lVal = (src0->lVal == src1->lVal);
+                dst->vt = VT_INTEGER;
+                break;
+            case OP_NE_II:
+                fetchDst();
+                fetchSrc(src0, inst->src0);
+                fetchSrc(src1, inst->src1);
+                dst->lVal = (src0->lVal != src1->lVal);
+                dst->vt = VT_INTEGER;
+                break;
+            case OP_LT_II:
+                fetchDst();
+                fetchSrc(src0, inst->src0);
+                fetchSrc(src1, inst->src1);
+                dst->lVal = (src0->lVal < src1->lVal);
+                dst->vt = VT_INTEGER;
+                break;
+            case OP_GT_II:
+                fetchDst();
+                fetchSrc(src0, inst->src0);
+                fetchSrc(src1, inst->src1);
+                dst->lVal = (src0->lVal > src1->lVal);
+                dst->vt = VT_INTEGER;
+                break;
+            case OP_GE_II:
+                fetchDst();
+                fetchSrc(src0, inst->src0);
+                fetchSrc(src1, inst->src1);
+                dst->lVal = (src0->lVal >= src1->lVal);
+                dst->vt = VT_INTEGER;
+                break;
+            case OP_LE_II:
+                fetchDst();
+                fetchSrc(src0, inst->src0);
+                fetchSrc(src1, inst->src1);
+                dst->lVal = (src0->lVal <= src1->lVal);
+                dst->vt = VT_INTEGER;
+                break;
+            case OP_BIT_AND_II:
+                fetchDst();
+                fetchSrc(src0, inst->src0);
+                fetchSrc(src1, inst->src1);
+                dst->lVal = src0->lVal & src1->lVal;
+                dst->vt = VT_INTEGER;
+                break;
+            case OP_SHR_II:
+                fetchDst();
+                fetchSrc(src0, inst->src0);
+                fetchSrc(src1, inst->src1);
+                dst->lVal = ((uint32_t)src0->lVal) >> ((uint32_t)src1->lVal);
+                dst->vt = VT_INTEGER;
+                break;
+
+            // decimal forms, for operands known to be decimals
+            case OP_ADD_DD:
+                fetchDst();
+                fetchSrc(src0, inst->src0);
+                fetchSrc(src1, inst->src1);
+                dst->dblVal = src0->dblVal + src1->dblVal;
+                dst->vt = VT_DECIMAL;
+                break;
+            case OP_SUB_DD:
+                fetchDst();
+                fetchSrc(src0, inst->src0);
+                fetchSrc(src1, inst->src1);
+                dst->dblVal = src0->dblVal - src1->dblVal;
+                dst->vt = VT_DECIMAL;
+                break;
+            case OP_MUL_DD:
+                fetchDst();
+                fetchSrc(src0, inst->src0);
+                fetchSrc(src1, inst->src1);
+                dst->dblVal = src0->dblVal * src1->dblVal;
+                dst->vt = VT_DECIMAL;
+                break;
+            case OP_DIV_DD:
+                fetchDst();
+                fetchSrc(src0, inst->src0);
+                fetchSrc(src1, inst->src1);
+                dst->dblVal = src0->dblVal / src1->dblVal;
+                dst->vt = VT_DECIMAL;
+                break;
+            case OP_LT_DD:
+                fetchDst();
+                fetchSrc(src0, inst->src0);
+                fetchSrc(src1, inst->src1);
+                dst->lVal = (src0->dblVal < src1->dblVal);
+                dst->vt = VT_INTEGER;
+                break;
+            case OP_GT_DD:
+                fetchDst();
+                fetchSrc(src0, inst->src0);
+                fetchSrc(src1, inst->src1);
+                dst->lVal = (src0->dblVal > src1->dblVal);
+                dst->vt = VT_INTEGER;
+                break;
+            case OP_GE_DD:
+                fetchDst();
+                fetchSrc(src0, inst->src0);
+                fetchSrc(src1, inst->src1);
+                dst->lVal = (src0->dblVal >= src1->dblVal);
+                dst->vt = VT_INTEGER;
+                break;
+            case OP_LE_DD:
+                fetchDst();
+                fetchSrc(src0, inst->src0);
+                fetchSrc(src1, inst->src1);
+                dst->lVal = (src0->dblVal <= src1->dblVal);
+                dst->vt = VT_INTEGER;
+                break;
+
+            // string concatenation
+            case OP_CONCAT:
+            {
+                frame.index = index;
+                fetchDst();
+                int numParts = function->callParams[inst->paramsIndex];
+                for (int i = 0; i < numParts; i++)
+                {
+                    fetchSrc(paramTemp, function->callParams[inst->paramsIndex+i+1]);
+                    callParams[i] = *paramTemp;
+                }
+                ScriptVariant_Concat(dst, numParts, callParams);
+                gcSafepoint();
                 break;
+            }
 
             // function call
             case OP_CALL:
             case OP_CALL_BUILTIN:
             case OP_CALL_METHOD:
             {
+                frame.index = index;
                 fetchDst();
                 int numParams = function->callParams[inst->paramsIndex];
                 for (int i = 0; i < numParams; i++)
@@ -205,21 +456,26 @@ static CCResult execFunction(ExecFunction *function, ScriptVariant *params, Scri
                     }
                     goto continue_backtrace;
                 }
+                gcSafepoint();
                 break;
             }
 
             // operations to create/modify/access objects and lists
             case OP_MKOBJECT:
+                frame.index = index;
                 fetchDst();
                 fetchSrc(src0, inst->src0);
                 dst->vt = VT_OBJECT;
                 dst->objVal = ObjectHeap_CreateNewObject(src0->lVal);
+                gcSafepoint();
                 break;
             case OP_MKLIST:
+                frame.index = index;
                 fetchDst();
                 fetchSrc(src0, inst->src0);
                 dst->vt = VT_LIST;
                 dst->objVal = ObjectHeap_CreateNewList((size_t)src0->lVal);
+                gcSafepoint();
                 break;
             case OP_SET:
                 fetchSrc(src0, inst->src0);
@@ -242,6 +498,36 @@ static CCResult execFunction(ExecFunction *function, ScriptVariant *params, Scri
                 }
                 break;
 
+            // list accesses with an index known to be in bounds
+            case OP_SET_LIST:
+                fetchSrc(src0, inst->src0);
+                fetchSrc(src1, inst->src1);
+                fetchSrc(src2, inst->src2);
+                if (likely(src0->vt == VT_LIST))
+                {
+                    ObjectHeap_SetListMember(src0->objVal, (uint32_t)src1->lVal, src2);
+                }
+                else if (CC_FAIL == ScriptVariant_ContainerSet(src0, src1, src2))
+                {
+                    printf("error: SET operation failed\n");
+                    goto start_backtrace;
+                }
+                break;
+            case OP_GET_LIST:
+                fetchDst();
+                fetchSrc(src0, inst->src0);
+                fetchSrc(src1, inst->src1);
+                if (likely(src0->vt == VT_LIST))
+                {
+                    ObjectHeap_GetList(src0->objVal)->getInBounds(dst, (uint32_t)src1->lVal);
+                }
+                else if (CC_FAIL == ScriptVariant_ContainerGet(dst, src0, src1))
+                {
+                    printf("error: GET operation failed\n");
+                    goto start_backtrace;
+                }
+                break;
+
             // write to global variable
             case OP_EXPORT:
                 dst = &function->interpreter->globals[inst->dst];
@@ -250,8 +536,39 @@ static CCResult execFunction(ExecFunction *function, ScriptVariant *params, Scri
                 *dst = *src0;
                 ScriptVariant_Ref(dst);
                 break;
+
+            // type checks for variables declared int or float in strict mode
+            case OP_CHECK_INT:
+                fetchDst();
+                fetchSrc(src0, inst->src0);
+                if (src0->vt != VT_INTEGER)
+                {
+                    printf("error: a value that isn't an integer was assigned to a variable declared 'int'\n");
+                    goto start_backtrace;
+                }
+                *dst = *src0;
+                break;
+            case OP_CHECK_DECIMAL:
+                fetchDst();
+                fetchSrc(src0, inst->src0);
+                if (src0->vt == VT_INTEGER)
+                {
+                    dst->dblVal = src0->lVal;
+                    dst->vt = VT_DECIMAL;
+                }
+                else if (src0->vt == VT_DECIMAL)
+                {
+                    *dst = *src0;
+                }
+                else
+                {
+                    printf("error: a value that isn't a number was assigned to a variable declared 'float'\n");
+                    goto start_backtrace;
+                }
+                break;
             default:
                 printf("error: unknown opcode %i\n", inst->opCode);
+                currentFrame = frame.caller;
                 return CC_FAIL;
         }
         if (!jumped) index++;
@@ -259,18 +576,66 @@ static CCResult execFunction(ExecFunction *function, ScriptVariant *params, Scri
     return CC_OK;
 
 start_backtrace:
-    printf("\n\nAn exception occurred in script function %s() in %s\n",
-        function->functionName,
-        function->interpreter->fileName);
+    printBacktraceEntry(function, index, "\n\nAn exception occurred in script function");
+    currentFrame = frame.caller;
     return CC_FAIL;
 
 continue_backtrace:
-    printf("called from %s() in %s\n",
-        function->functionName,
-        function->interpreter->fileName);
+    printBacktraceEntry(function, index, "called from");
+    currentFrame = frame.caller;
     return CC_FAIL;
 }
 
+void Interpreter_VisitRoots(RootVisitor visitor, void *data)
+{
+    for (ExecFrame *frame = currentFrame; frame != NULL; frame = frame->caller)
+    {
+        ExecFunction *function = frame->function;
+        for (int i = 0; i < function->numTemps; i++)
+        {
+            visitor(&frame->temps[i], ROOT_TEMP, function->functionName, i, data);
+        }
+        for (int i = 0; i < function->maxCallParams; i++)
+        {
+            visitor(&frame->callParams[i], ROOT_CALL_PARAM, function->functionName, i, data);
+        }
+        // the params of any other frame are the callParams of its caller
+        if (frame->caller == NULL && frame->params != NULL)
+        {
+            for (int i = 0; i < function->numParams; i++)
+            {
+                visitor(&frame->params[i], ROOT_PARAM, function->functionName, i, data);
+            }
+        }
+    }
+    ImportCache_VisitRoots(visitor, data);
+    visitGlobalVariants(visitor, data);
+}
+
+bool Interpreter_GetAllocationSite(ExecFunction **function, int *instruction)
+{
+    if (currentFrame == NULL)
+        return false;
+
+    *function = currentFrame->function;
+    *instruction = currentFrame->index;
+    return true;
+}
+
+static void pushRootToGC(const ScriptVariant *var, RootKind kind, const char *owner, int slot, void *data)
+{
+    GarbageCollector_PushVariant(var);
+}
+
+void Interpreter_CollectGarbage()
+{
+    Interpreter_VisitRoots(pushRootToGC, NULL);
+    GarbageCollector_PushExternallyReferenced();
+    GarbageCollector_MarkAll();
+    GarbageCollector_Sweep();
+    StrCache_CollectUnmarked();
+}
+
 ExecFunction *Interpreter::getFunctionNamed(const char *name)
 {
     return functions.findByName(name) ? functions.retrieve() : NULL;
@@ -288,6 +653,18 @@ CCResult Interpreter::runFunction(ExecFunction *function, ScriptVariant *params,
     return result;
 }
 
+void Interpreter::visitRoots(RootVisitor visitor, void *data)
+{
+    for (int i = 0; i < numGlobals; i++)
+    {
+        visitor(&globals[i], ROOT_GLOBAL, fileName, i, data);
+    }
+    for (int i = 0; i < numConstants; i++)
+    {
+        visitor(&constants[i], ROOT_CONSTANT, fileName, i, data);
+    }
+}
+
 Interpreter::~Interpreter()
 {
     // free constants and globals
@@ -319,5 +696,7 @@ ExecFunction::~ExecFunction()
     delete[] callTargets;
     delete[] callParams;
     delete[] instructions;
+    delete[] inlineSites;
+    delete[] instructionSites;
 }
 
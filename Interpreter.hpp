@@ -4,6 +4,7 @@
 #include "depends.h"
 #include "List.hpp"
 #include "ScriptVariant.hpp"
+#include "ObjectHeap.hpp"
 
 enum RegFile {
     FILE_NONE,
@@ -53,6 +54,14 @@ struct ExecInstruction {
     };
 };
 
+struct ExecFunction;
+
+// a copy of a function's code in the code of a function it was inlined into
+struct ExecInlineSite {
+    ExecFunction *function; // the inlined function
+    int caller; // index of the site that the call to it was part of, or -1 if it was in the function's own code
+};
+
 struct ExecFunction {
     char *functionName;
     Interpreter *interpreter;
@@ -63,6 +72,10 @@ struct ExecFunction {
     int maxCallParams; // largest number of parameters to a single call in this function
     int numInstructions;
     ExecInstruction *instructions;
+    // For code inlined from other functions: the index in inlineSites of the site each instruction is part of, or -1
+    // for the function's own code. Both are NULL if nothing was inlined.
+    ExecInlineSite *inlineSites;
+    int *instructionSites;
 
     inline ExecFunction()
         : functionName(NULL),
@@ -73,7 +86,9 @@ struct ExecFunction {
           callParams(NULL),
           maxCallParams(0),
           numInstructions(0),
-          instructions(NULL)
+          instructions(NULL),
+          inlineSites(NULL),
+          instructionSites(NULL)
     {}
 
     // destructor to free all of the above
@@ -100,8 +115,28 @@ public:
 
     ExecFunction *getFunctionNamed(const char *name);
     CCResult runFunction(ExecFunction *function, ScriptVariant *params, ScriptVariant *retval);
+
+    // pass this script's globals and constants to a garbage collection root visitor
+    void visitRoots(RootVisitor visitor, void *data);
 };
 
+/**
+ * Runs a full garbage collection of objects and temporary strings. The roots are the temporaries and parameters of
+ * every script function currently executing, the globals and constants of every compiled script, the globals()
+ * object, and every object or list with a reference from outside the heap, such as a return value the host hasn't
+ * released yet. This is called automatically between instructions when enough has been allocated, and can also be
+ * called by the host between script calls.
+ */
+void Interpreter_CollectGarbage();
+
+// passes the garbage collection roots described above to the visitor, except for the containers with references from
+// outside the heap, which are found by the heap itself
+void Interpreter_VisitRoots(RootVisitor visitor, void *data);
+
+// Finds the instruction responsible for an allocation: the current instruction of the innermost running script
+// function. Returns false if no script is running.
+bool Interpreter_GetAllocationSite(ExecFunction **function, int *instruction);
+
 
 #endif
 
@@ -1,6 +1,7 @@
 // Compiles and runs a script from a file.
 #include <stdio.h>
 #include <errno.h>
+#include <string.h>
 #include "pp_parser.h"
 #include "Parser.hpp"
 #include "List.hpp"
@@ -13,6 +14,8 @@
 #include "StrCache.hpp"
 #include "ScriptObject.hpp"
 #include "ObjectHeap.hpp"
+#include "HeapSnapshot.hpp"
+#include "AllocProfiler.hpp"
 
 int script_arg_count;
 char **script_args;
@@ -69,26 +72,66 @@ io_error:
 }
 #endif
 
+// number of roots, containers or allocation sites listed by --heap-analyze, --heap-diff and --alloc-profile
+#define REPORT_ENTRIES 20
+
 int main(int argc, char **argv)
 {
     if (argc < 2)
     {
         fprintf(stderr, argc < 2 ? "no file specified\n" : "too many arguments\n");
-        fprintf(stderr, "usage: %s script.c\n", argv[0]);
+        fprintf(stderr, "usage: %s [--alloc-profile] [--intern-strings] script.c\n", argv[0]);
+        fprintf(stderr, "       %s --heap-analyze snapshot\n", argv[0]);
+        fprintf(stderr, "       %s --heap-diff old-snapshot new-snapshot\n", argv[0]);
         return 1;
     }
 
+    if (!strcmp(argv[1], "--heap-analyze") && argc == 3)
+    {
+        return HeapSnapshot_PrintAnalysis(argv[2], REPORT_ENTRIES) == CC_OK ? 0 : 1;
+    }
+    else if (!strcmp(argv[1], "--heap-diff") && argc == 4)
+    {
+        return HeapSnapshot_PrintDiff(argv[2], argv[3], REPORT_ENTRIES) == CC_OK ? 0 : 1;
+    }
+
+    bool profileAllocations = false;
+    while (argc > 2 && !strncmp(argv[1], "--", 2))
+    {
+        if (!strcmp(argv[1], "--alloc-profile"))
+        {
+            profileAllocations = true;
+            AllocProfiler_Start(ALLOC_PROFILER_DEFAULT_INTERVAL);
+        }
+        else if (!strcmp(argv[1], "--intern-strings"))
+        {
+            StrCache_SetInternAll(true);
+        }
+        else
+        {
+            fprintf(stderr, "unknown option %s\n", argv[1]);
+            return 1;
+        }
+        ++argv;
+        --argc;
+    }
+
     script_arg_count = argc - 2;
     script_args = argv + 2;
 
     doTest(argv[1]);
     // testFile(argv[1]);
 
+    if (profileAllocations)
+    {
+        AllocProfiler_Stop();
+        printf("\n");
+        AllocProfiler_PrintReport(REPORT_ENTRIES);
+    }
+
     printf("\n");
     ObjectHeap_ListUnfreed();
-    pushGlobalVariantsToGC();
-    GarbageCollector_MarkAll();
-    GarbageCollector_Sweep();
+    Interpreter_CollectGarbage();
     printf("\n");
     ObjectHeap_ListUnfreed();
 
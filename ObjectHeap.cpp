@@ -1,27 +1,29 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 #include "globals.h"
 #include "ScriptObject.hpp"
 #include "ObjectHeap.hpp"
 #include "ScriptList.hpp"
 #include "ArrayList.hpp"
+#include "StrCache.hpp"
+#include "ScriptUtils.h"
+#include "AllocProfiler.hpp"
 
 #define __reallocto(p, t, n, s) \
     p = (t)realloc((p), sizeof(*(p))*(s));\
     memset((p)+(n), 0, sizeof(*(p))*((s)-(n)));
 
-#define HEAP_SIZE_INCREMENT   64
+// initial size of the heap; it doubles in size whenever it runs out of free indices
+#define HEAP_INITIAL_SIZE     64
 
-enum GCColor {
-    GC_COLOR_WHITE,
-    GC_COLOR_GRAY,
-    GC_COLOR_BLACK
-};
+// a collection is requested once this many containers have been created since the last one, or once as many have been
+// created as were alive after the last one, whichever is larger
+#define GC_MIN_THRESHOLD      4096
 
 struct HeapMember {
     ScriptContainer *container;
     bool isList;
-    unsigned char gcColor;
     int refcount;
 };
 
@@ -29,13 +31,38 @@ class ObjectHeap {
 private:
     HeapMember *objects;
     ArrayList<int> tempRefsList;
-    Stack<int> grayStack;
+
+    // Mark state for garbage collection, kept apart from the objects so that the sweep can clear it all at once. An
+    // object is white if its mark bit is clear, gray if its bit is set and it's on the gray stack, and black if its bit
+    // is set and it has been processed.
+    uint32_t *markBits;
+    ArrayList<int> grayStack;
+
     int size; // allocated size of heap (includes unused space, not equal to # of active objects!)
     int top; // top of free_indices stack, equal to (# of free positions - 1)
     int *free_indices; // stack of indices of free objects
+    int numLive; // number of containers currently allocated
+    int allocationsSinceGC; // number of containers created since the last collection
+    int gcThreshold; // value of allocationsSinceGC at which to request a collection
+
+    // statistics for ObjectHeap_GetStats() that can't be computed by looking at the heap
+    unsigned int gcCycles;
+    unsigned int promotions;
+    unsigned int tempRefsHighWater;
+    unsigned int markTimeHistogram[GC_HISTOGRAM_BUCKETS];
+    unsigned int sweepTimeHistogram[GC_HISTOGRAM_BUCKETS];
 
     int pop();
 
+    // add an index to tempRefsList
+    inline void appendTempRef(int index);
+
+    // remove indices of freed or persistent objects from tempRefsList
+    void compactTempRefs();
+
+    // pick the allocation count at which the next collection is requested
+    void resetGCThreshold();
+
 public:
     ObjectHeap();
 
@@ -63,6 +90,18 @@ public:
     // adds a temporary reference for an object if there isn't one already
     void addTemporaryReference(int index);
 
+    // counts a container being made persistent
+    inline void countPromotion()
+    {
+        ++promotions;
+    }
+
+    // fill in a HeapStats structure
+    void getStats(HeapStats *stats);
+
+    // write every live container and its references to other containers (see HeapSnapshot.hpp)
+    void writeSnapshot(FILE *fp);
+
     // returns true if the given index is a list (not a link to a list)
     inline bool isList(int index)
     {
@@ -78,22 +117,31 @@ public:
     // get the list with this index
     inline ScriptList *getList(int index);
 
-    // get the garbage collection color of the object with this index
-    inline int getGCColor(int index)
+    // returns true if the object with this index is gray or black
+    inline bool isMarked(int index)
     {
         assert(objects[index].container != NULL);
-        return objects[index].gcColor;
+        return markBits[index / 32] & (1u << (index % 32));
     }
 
     // add an object to the gray list (for GC)
     void pushGray(int index);
 
+    // add every container with references from outside the heap to the gray list (for GC)
+    void pushExternallyReferenced();
+
+    // returns true if a collection should be run
+    inline bool shouldCollect()
+    {
+        return allocationsSinceGC >= gcThreshold;
+    }
+
     // mark phase of garbage collection
     inline void processOneGraySub(const ScriptVariant *var);
     void processOneGray();
     void markAll();
 
-    // delete all objects whose GC color is white
+    // delete all objects whose GC color is white and turn the rest white
     void sweep();
 
     // list all unfreed objects
@@ -103,9 +151,18 @@ public:
 ObjectHeap::ObjectHeap()
 {
     objects = NULL;
+    markBits = NULL;
     size = 0;
     top = -1;
     free_indices = NULL;
+    numLive = 0;
+    allocationsSinceGC = 0;
+    gcThreshold = GC_MIN_THRESHOLD;
+    gcCycles = 0;
+    promotions = 0;
+    tempRefsHighWater = 0;
+    memset(markTimeHistogram, 0, sizeof(markTimeHistogram));
+    memset(sweepTimeHistogram, 0, sizeof(sweepTimeHistogram));
 }
 
 // init the object heap
@@ -113,13 +170,14 @@ void ObjectHeap::init()
 {
     int i;
     clear(); // just in case
-    objects = (HeapMember*) calloc(HEAP_SIZE_INCREMENT, sizeof(*objects));
-    free_indices = (int*) malloc(HEAP_SIZE_INCREMENT * sizeof(*free_indices));
-    for (i = 0; i < HEAP_SIZE_INCREMENT; i++)
+    objects = (HeapMember*) calloc(HEAP_INITIAL_SIZE, sizeof(*objects));
+    markBits = (uint32_t*) calloc(HEAP_INITIAL_SIZE / 32, sizeof(*markBits));
+    free_indices = (int*) malloc(HEAP_INITIAL_SIZE * sizeof(*free_indices));
+    for (i = 0; i < HEAP_INITIAL_SIZE; i++)
     {
         free_indices[i] = i;
     }
-    size = HEAP_SIZE_INCREMENT;
+    size = HEAP_INITIAL_SIZE;
     top = size - 1;
 }
 
@@ -140,6 +198,12 @@ void ObjectHeap::clear()
         objects = NULL;
     }
 
+    if (markBits)
+    {
+        free(markBits);
+        markBits = NULL;
+    }
+
     if (free_indices)
     {
         free(free_indices);
@@ -148,6 +212,8 @@ void ObjectHeap::clear()
     size = 0;
     top = -1;
     tempRefsList.clear();
+    numLive = 0;
+    resetGCThreshold();
 }
 
 // remove all temporary references and free all non-persistent objects
@@ -166,11 +232,43 @@ void ObjectHeap::clearTemporaryReferences()
                 delete objects[index].container;
                 objects[index].container = NULL;
                 free_indices[++top] = index;
+                --numLive;
             }
         }
     }
 
     tempRefsList.clear();
+    resetGCThreshold();
+}
+
+inline void ObjectHeap::appendTempRef(int index)
+{
+    tempRefsList.append(index);
+    if (tempRefsList.size() > tempRefsHighWater)
+    {
+        tempRefsHighWater = tempRefsList.size();
+    }
+}
+
+void ObjectHeap::compactTempRefs()
+{
+    uint32_t numTempRefs = tempRefsList.size(), numKept = 0;
+    for (uint32_t i = 0; i < numTempRefs; i++)
+    {
+        int index = tempRefsList.get(i);
+        if (objects[index].container != NULL &&
+            (objects[index].refcount == 0 || !objects[index].container->isPersistent()))
+        {
+            tempRefsList.set(numKept++, index);
+        }
+    }
+    tempRefsList.removeRange(numKept, numTempRefs);
+}
+
+void ObjectHeap::resetGCThreshold()
+{
+    allocationsSinceGC = 0;
+    gcThreshold = (numLive > GC_MIN_THRESHOLD) ? numLive : GC_MIN_THRESHOLD;
 }
 
 // creates a new object and returns its index
@@ -181,27 +279,31 @@ int ObjectHeap::pop()
     {
         init();
     }
-    // no free spaces for objects, so expand the heap
+    // no free spaces for objects, so double the size of the heap (growing it by a constant amount would make filling
+    // a large heap take quadratic time)
     if (top < 0)
     {
-        __reallocto(objects, HeapMember*, size, size + HEAP_SIZE_INCREMENT);
-        __reallocto(free_indices, int*, size, size + HEAP_SIZE_INCREMENT);
-        for (i = 0; i < HEAP_SIZE_INCREMENT; i++)
+        int newSize = size * 2;
+        __reallocto(objects, HeapMember*, size, newSize);
+        __reallocto(markBits, uint32_t*, size / 32, newSize / 32);
+        __reallocto(free_indices, int*, size, newSize);
+        for (i = 0; i < newSize - size; i++)
         {
             objects[size + i].container = NULL;
-            free_indices[i] = size + i;
+            free_indices[i] = newSize - 1 - i;
         }
 
-        size += HEAP_SIZE_INCREMENT;
-        top += HEAP_SIZE_INCREMENT;
+        top += newSize - size;
+        size = newSize;
 
         //printf("debug: object heap %p resized to %d \n", this, size);
     }
     i = free_indices[top--];
     assert(objects[i].container == NULL);
     objects[i].refcount = 0;
-    tempRefsList.append(i);
-    objects[i].gcColor = GC_COLOR_WHITE;
+    appendTempRef(i);
+    ++numLive;
+    ++allocationsSinceGC;
     return i;
 }
 
@@ -237,7 +339,7 @@ void ObjectHeap::unref(int index)
     assert(objects[index].refcount >= 0);
     if (objects[index].refcount == 0)
     {
-        tempRefsList.append(index);
+        appendTempRef(index);
     }
 }
 
@@ -265,9 +367,9 @@ ScriptList *ObjectHeap::getList(int index)
 void ObjectHeap::pushGray(int index)
 {
     assert(index >= 0);
-    assert(objects[index].gcColor != GC_COLOR_GRAY);
-    objects[index].gcColor = GC_COLOR_GRAY;
-    grayStack.push(index);
+    assert(!isMarked(index));
+    markBits[index / 32] |= 1u << (index % 32);
+    grayStack.append(index);
 }
 
 inline void ObjectHeap::processOneGraySub(const ScriptVariant *var)
@@ -275,18 +377,22 @@ inline void ObjectHeap::processOneGraySub(const ScriptVariant *var)
     if (var->vt == VT_OBJECT || var->vt == VT_LIST)
     {
         int subIndex = var->objVal;
-        if (objects[subIndex].gcColor == GC_COLOR_WHITE)
+        if (!isMarked(subIndex))
         {
             pushGray(subIndex);
         }
     }
+    else if (var->vt == VT_STR)
+    {
+        // members of non-persistent containers don't hold a reference to their strings
+        StrCache_Mark(var->strVal);
+    }
 }
 
 // process one item from the gray stack
 void ObjectHeap::processOneGray()
 {
-    int index = grayStack.top();
-    grayStack.pop();
+    int index = grayStack.removeLast();
     assert(objects[index].container != NULL);
     if (objects[index].isList)
     {
@@ -309,31 +415,193 @@ void ObjectHeap::processOneGray()
             }
         }
     }
-    objects[index].gcColor = GC_COLOR_BLACK;
+}
+
+static inline void countHeapReference(const ScriptVariant *var, int *externalRefs)
+{
+    if (var->vt == VT_OBJECT || var->vt == VT_LIST)
+    {
+        --externalRefs[var->objVal];
+    }
+}
+
+/* The refcount of a container counts the references to it from globals, constants, persistent containers and the host
+   (such as a return value from an earlier script call that it still holds). Subtracting the references held by
+   persistent containers leaves the ones from outside the heap, so containers with any left are roots. Cycles of
+   persistent containers that nothing else refers to still have none left, so they can be collected. */
+void ObjectHeap::pushExternallyReferenced()
+{
+    if (numLive == 0) return;
+    int *externalRefs = (int*) malloc(size * sizeof(int));
+    for (int i = 0; i < size; i++)
+    {
+        externalRefs[i] = objects[i].container ? objects[i].refcount : 0;
+    }
+
+    for (int i = 0; i < size; i++)
+    {
+        if (objects[i].container == NULL || !objects[i].container->isPersistent()) continue;
+        if (objects[i].isList)
+        {
+            ScriptList *list = static_cast<ScriptList*>(objects[i].container);
+            for (uint32_t j = 0; j < list->size(); j++)
+            {
+                ScriptVariant var;
+                list->get(&var, j);
+                countHeapReference(&var, externalRefs);
+            }
+        }
+        else
+        {
+            ScriptObject *obj = static_cast<ScriptObject*>(objects[i].container);
+            for (size_t j = 0; j < (1u << obj->log2_hashTableSize); j++)
+            {
+                if (obj->hashTable[j].key != -1)
+                {
+                    countHeapReference(&obj->hashTable[j].value, externalRefs);
+                }
+            }
+        }
+    }
+
+    for (int i = 0; i < size; i++)
+    {
+        if (externalRefs[i] > 0 && !isMarked(i))
+        {
+            pushGray(i);
+        }
+    }
+    free(externalRefs);
+}
+
+// returns the histogram bucket for a garbage collection phase that took the given time
+static int histogramBucket(clock_t ticks)
+{
+    double microseconds = (double)ticks * 1000000.0 / CLOCKS_PER_SEC;
+    int bucket = 0;
+    while (bucket < GC_HISTOGRAM_BUCKETS - 1 && microseconds >= (double)(1u << bucket))
+    {
+        ++bucket;
+    }
+    return bucket;
 }
 
 // mark objects until gray stack is empty
 void ObjectHeap::markAll()
 {
-    while (!grayStack.isEmpty())
+    clock_t startTime = clock();
+    while (grayStack.size() != 0)
     {
         processOneGray();
     }
+    ++markTimeHistogram[histogramBucket(clock() - startTime)];
 }
 
-// delete all objects whose GC color is white
+// delete all objects whose GC color is white, and turn the survivors white for the next collection
 void ObjectHeap::sweep()
 {
-    assert(grayStack.isEmpty());
+    assert(grayStack.size() == 0);
+    clock_t startTime = clock();
     for (int i = 0; i < size; i++)
     {
         if (objects[i].container != NULL &&
-            objects[i].gcColor == GC_COLOR_WHITE)
+            !(markBits[i / 32] & (1u << (i % 32))))
         {
             //printf("delete object %i (gc)\n", i);
             delete objects[i].container;
             objects[i].container = NULL;
             free_indices[++top] = i;
+            --numLive;
+        }
+    }
+    if (markBits) // NULL if the heap was never initialized or has been cleared
+        memset(markBits, 0, (size / 32) * sizeof(*markBits));
+
+    compactTempRefs();
+    resetGCThreshold();
+    ++sweepTimeHistogram[histogramBucket(clock() - startTime)];
+    ++gcCycles;
+}
+
+void ObjectHeap::getStats(HeapStats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    for (int i = 0; i < size; i++)
+    {
+        ScriptContainer *container = objects[i].container;
+        if (container == NULL) continue;
+
+        if (objects[i].isList)
+        {
+            ++stats->liveLists;
+            stats->listBytes += container->memoryUsage();
+        }
+        else
+        {
+            ++stats->liveObjects;
+            stats->objectBytes += container->memoryUsage();
+        }
+
+        if (container->isPersistent())
+            ++stats->persistentContainers;
+        else
+            ++stats->temporaryContainers;
+    }
+
+    stats->gcCycles = gcCycles;
+    stats->promotions = promotions;
+    stats->tempRefsHighWater = tempRefsHighWater;
+    memcpy(stats->markTimeHistogram, markTimeHistogram, sizeof(markTimeHistogram));
+    memcpy(stats->sweepTimeHistogram, sweepTimeHistogram, sizeof(sweepTimeHistogram));
+}
+
+void ObjectHeap::writeSnapshot(FILE *fp)
+{
+    char keyBuffer[MAX_STR_VAR_LEN + 3];
+    for (int i = 0; i < size; i++)
+    {
+        ScriptContainer *container = objects[i].container;
+        if (container == NULL) continue;
+
+        fprintf(fp, "C %i %s %u %i %i\n", i, objects[i].isList ? "list" : "object",
+                (unsigned int) container->memoryUsage(), container->isPersistent(), objects[i].refcount);
+        if (objects[i].isList)
+        {
+            ScriptList *list = static_cast<ScriptList*>(container);
+            for (uint32_t j = 0; j < list->size(); j++)
+            {
+                ScriptVariant var;
+                list->get(&var, j);
+                if (var.vt == VT_OBJECT || var.vt == VT_LIST)
+                {
+                    fprintf(fp, "E %i [%u]\n", var.objVal, j);
+                }
+            }
+        }
+        else
+        {
+            ScriptObject *obj = static_cast<ScriptObject*>(container);
+            for (size_t j = 0; j < (1u << obj->log2_hashTableSize); j++)
+            {
+                const ObjectHashNode *node = &obj->hashTable[j];
+                if (node->key == -1 || (node->value.vt != VT_OBJECT && node->value.vt != VT_LIST)) continue;
+
+                // label the reference with the key, escaped so that it fits on one line
+                const char *key = StrCache_Get(node->key);
+                int keyLength = StrCache_Len(node->key);
+                int escapedLength = escapeString(keyBuffer, sizeof(keyBuffer), key, keyLength);
+                if (escapedLength < (int) sizeof(keyBuffer))
+                {
+                    fprintf(fp, "E %i %s\n", node->value.objVal, keyBuffer);
+                }
+                else
+                {
+                    char *longKey = (char*) malloc(escapedLength + 1);
+                    escapeString(longKey, escapedLength + 1, key, keyLength);
+                    fprintf(fp, "E %i %s\n", node->value.objVal, longKey);
+                    free(longKey);
+                }
+            }
         }
     }
 }
@@ -357,6 +625,16 @@ void ObjectHeap::listUnfreed()
 static ObjectHeap theHeap;
 
 // -------------------- PUBLIC API ----------------------
+void ObjectHeap_GetStats(HeapStats *stats)
+{
+    theHeap.getStats(stats);
+}
+
+void ObjectHeap_WriteSnapshot(FILE *fp)
+{
+    theHeap.writeSnapshot(fp);
+}
+
 void ObjectHeap_ClearTemporary()
 {
     theHeap.clearTemporaryReferences();
@@ -370,13 +648,19 @@ void ObjectHeap_ClearAll()
 // returns global index of newly created object (non-persistent)
 int ObjectHeap_CreateNewObject(unsigned int initialSize)
 {
-    return theHeap.popObject(initialSize);
+    int index = theHeap.popObject(initialSize);
+    if (AllocProfiler_ShouldSample())
+        AllocProfiler_Record(ALLOC_OBJECT, theHeap.getContainer(index)->memoryUsage());
+    return index;
 }
 
 // returns global index of newly created list (non-persistent)
 int ObjectHeap_CreateNewList(size_t initialSize)
 {
-    return theHeap.popList(initialSize);
+    int index = theHeap.popList(initialSize);
+    if (AllocProfiler_ShouldSample())
+        AllocProfiler_Record(ALLOC_LIST, theHeap.getContainer(index)->memoryUsage());
+    return index;
 }
 
 // makes temporary object persistent, or refs object if it's already persistent
@@ -386,6 +670,7 @@ void ObjectHeap_Ref(int index)
     if (!container->isPersistent())
     {
         container->makePersistent();
+        theHeap.countPromotion();
     }
 
     theHeap.ref(index);
@@ -423,8 +708,8 @@ bool ObjectHeap_SetObjectMember(int index, const ScriptVariant *key, const Scrip
 
         // a black object can't contain a white value, so make the white value gray
         if ((value->vt == VT_OBJECT || value->vt == VT_LIST) &&
-            theHeap.getGCColor(index) == GC_COLOR_BLACK &&
-            theHeap.getGCColor(value->objVal) == GC_COLOR_WHITE)
+            theHeap.isMarked(index) &&
+            !theHeap.isMarked(value->objVal))
         {
             theHeap.pushGray(value->objVal);
         }
@@ -445,8 +730,8 @@ void ObjectHeap_SetListMember(int index, uint32_t indexInList, const ScriptVaria
 
         // a black object can't contain a white value, so make the white value gray
         if ((value->vt == VT_OBJECT || value->vt == VT_LIST) &&
-            theHeap.getGCColor(index) == GC_COLOR_BLACK &&
-            theHeap.getGCColor(value->objVal) == GC_COLOR_WHITE)
+            theHeap.isMarked(index) &&
+            !theHeap.isMarked(value->objVal))
         {
             theHeap.pushGray(value->objVal);
         }
@@ -467,8 +752,8 @@ bool ObjectHeap_InsertInList(int index, uint32_t indexInList, const ScriptVarian
 
         // a black object can't contain a white value, so make the white value gray
         if ((value->vt == VT_OBJECT || value->vt == VT_LIST) &&
-            theHeap.getGCColor(index) == GC_COLOR_BLACK &&
-            theHeap.getGCColor(value->objVal) == GC_COLOR_WHITE)
+            theHeap.isMarked(index) &&
+            !theHeap.isMarked(value->objVal))
         {
             theHeap.pushGray(value->objVal);
         }
@@ -492,6 +777,21 @@ void GarbageCollector_PushGray(int index)
     theHeap.pushGray(index);
 }
 
+void GarbageCollector_PushVariant(const ScriptVariant *var)
+{
+    theHeap.processOneGraySub(var);
+}
+
+bool GarbageCollector_ShouldCollect()
+{
+    return theHeap.shouldCollect() || StrCache_ShouldCollect();
+}
+
+void GarbageCollector_PushExternallyReferenced()
+{
+    theHeap.pushExternallyReferenced();
+}
+
 void GarbageCollector_MarkAll()
 {
     theHeap.markAll();
@@ -1,20 +1,57 @@
 #ifndef OBJECT_HEAP_HPP
 #define OBJECT_HEAP_HPP
 
+#include <stdio.h>
 #include "ScriptContainer.hpp"
 #include "ScriptObject.hpp"
 #include "ScriptList.hpp"
-#include "Stack.hpp"
 #include "List.hpp"
 #include "ScriptVariant.hpp"
 
 /**
  * All objects are reference counted. The only references counted are from persistent places like global variables or
- * other persistent objects/lists. Objects with refcount 0 are freed when ObjectHeap_ClearTemporary() is called, and
- * not before, since temporary registers can hold references to objects with refcount 0.
+ * other persistent objects/lists, and from the host. Objects with refcount 0 are freed when ObjectHeap_ClearTemporary()
+ * is called, or by a garbage collection that finds them unreachable from the roots (temporary registers, parameters,
+ * globals, and containers with references from outside the heap).
  */
 
+// number of buckets in each garbage collection duration histogram; bucket 0 counts phases that took less than 1
+// microsecond, bucket i counts phases that took at least 2^(i-1) and less than 2^i microseconds, and the last bucket
+// also counts everything longer
+#define GC_HISTOGRAM_BUCKETS 24
+
+// heap and garbage collector statistics, filled in by ObjectHeap_GetStats()
+typedef struct {
+    int liveObjects;                // objects currently allocated
+    int liveLists;                  // lists currently allocated
+    size_t objectBytes;             // memory allocated by live objects
+    size_t listBytes;               // memory allocated by live lists
+    int persistentContainers;       // live objects and lists that have been made persistent
+    int temporaryContainers;        // live objects and lists that haven't
+    unsigned int gcCycles;          // garbage collections run so far
+    unsigned int promotions;        // containers made persistent so far
+    unsigned int tempRefsHighWater; // largest size the list of temporary references has reached
+    unsigned int markTimeHistogram[GC_HISTOGRAM_BUCKETS];
+    unsigned int sweepTimeHistogram[GC_HISTOGRAM_BUCKETS];
+} HeapStats;
+
+// the places a garbage collection root can be found
+enum RootKind {
+    ROOT_TEMP,           // temporary register of a running function
+    ROOT_PARAM,          // parameter of the outermost running function
+    ROOT_CALL_PARAM,     // outgoing call parameter of a running function
+    ROOT_GLOBAL,         // global variable of a script
+    ROOT_CONSTANT,       // constant of a script
+    ROOT_GLOBALS_OBJECT, // the object returned by globals()
+};
+
+// Callback for enumerating garbage collection roots. 'owner' is the name of the function (for registers) or script
+// file (for globals and constants) the root belongs to, and 'slot' is its index there.
+typedef void (*RootVisitor)(const ScriptVariant *var, RootKind kind, const char *owner, int slot, void *data);
+
 // public API
+void ObjectHeap_GetStats(HeapStats *stats);
+void ObjectHeap_WriteSnapshot(FILE *fp);
 void ObjectHeap_ClearTemporary();
 void ObjectHeap_ClearAll();
 int ObjectHeap_CreateNewObject(unsigned int initialSize);
@@ -32,10 +69,20 @@ void ObjectHeap_ListUnfreed();
 // turn a white or black object gray (for garbage collection)
 void GarbageCollector_PushGray(int index);
 
+// mark a root value as reachable: pushes it gray if it's a white container, or marks it if it's a string
+void GarbageCollector_PushVariant(const ScriptVariant *var);
+
+// returns true if enough objects or strings have been allocated since the last collection to start another one
+bool GarbageCollector_ShouldCollect();
+
+// turn every container that is referenced from outside the heap (from globals or by the host) gray
+void GarbageCollector_PushExternallyReferenced();
+
 // process the entire gray stack, marking all objects black or white
 void GarbageCollector_MarkAll();
 
-// delete objects with no outstanding references (call only when all objects are marked)
+// delete objects with no outstanding references and turn the survivors white again (call only when all objects are
+// marked)
 void GarbageCollector_Sweep();
 
 #endif
@@ -94,6 +94,14 @@ void Parser::match()
     {
         Parser_Error(this, error);
     }
+
+    // keep the builder up to date on where it is in the source, for error messages
+    if (bldUtil)
+    {
+        pp_parser *file = theLexer.preprocessor.currentFile();
+        bldUtil->fileName = file->filename;
+        bldUtil->line = file->lexer.theTokenPosition.row;
+    }
 }
 
 /*****************************************************************************
@@ -276,6 +284,7 @@ void Parser::externalDecl2(bool variableonly)
         if (!bldUtil->currentBlock->endsWithJump())
             bldUtil->mkReturn(NULL);
         delete bldUtil;
+        bldUtil = NULL;
         execBuilder->ssaFunctions.insertAfter(bld, bld->functionName);
     }
     else
@@ -284,7 +293,8 @@ void Parser::externalDecl2(bool variableonly)
     }
 }
 
-void Parser::declSpec()
+// returns the type of a variable declared with this type, or VT_EMPTY if it can hold any type
+VARTYPE Parser::declSpec()
 {
     // It's OK though not all below are valid types for our language
     if (check(TOKEN_VOID))
@@ -302,6 +312,7 @@ void Parser::declSpec()
     else if (check(TOKEN_INT))
     {
         match();
+        return strictTypes() ? VT_INTEGER : VT_EMPTY;
     }
     else if (check(TOKEN_LONG))
     {
@@ -310,15 +321,40 @@ void Parser::declSpec()
     else if (check(TOKEN_FLOAT))
     {
         match();
+        return strictTypes() ? VT_DECIMAL : VT_EMPTY;
     }
     else if (check(TOKEN_DOUBLE))
     {
         match();
+        return strictTypes() ? VT_DECIMAL : VT_EMPTY;
     }
     else
     {
         Parser_Error(this, decl_spec);
     }
+    return VT_EMPTY;
+}
+
+// true if "#pragma strict_types" has been seen, so int and float variables are type checked
+bool Parser::strictTypes()
+{
+    return theLexer.preprocessor.ctx->strictTypes;
+}
+
+// Reports an error if a constant is assigned to a variable declared with a type it doesn't have. Other values are
+// checked after type inference, or when the script runs if their type isn't known.
+bool Parser::checkAssignedType(const char *varName, RValue *value)
+{
+    VARTYPE declaredType = bldUtil->declaredType(varName);
+    if (declaredType == VT_EMPTY || !value->isConstant()) return true;
+
+    VARTYPE vt = value->asConstant()->constValue.vt;
+    if (vt == declaredType || (vt == VT_INTEGER && declaredType == VT_DECIMAL)) return true;
+
+    errorWithMessage(error, "'%s' is declared '%s', so it can't be assigned %s",
+        varName, declaredType == VT_INTEGER ? "int" : "float",
+        vt == VT_DECIMAL ? "a decimal" : (vt == VT_STR ? "a string" : "this value"));
+    return false;
 }
 
 // internal decleraton for variables.
@@ -326,9 +362,8 @@ void Parser::decl()
 {
     if (parserSet.first(Productions::decl_spec, theNextToken.theType))
     {
-        //ignore the type of this declaration
-        declSpec();
-        decl2();
+        VARTYPE declaredType = declSpec();
+        decl2(declaredType);
     }
     else
     {
@@ -337,7 +372,7 @@ void Parser::decl()
 }
 
 // this function is used by Parser_Decl for multiple declaration separated by commas
-void Parser::decl2()
+void Parser::decl2(VARTYPE declaredType)
 {
     Token token = theNextToken;
     if (!check(TOKEN_IDENTIFIER))
@@ -363,7 +398,7 @@ void Parser::decl2()
         errorWithMessage(decl, "there is already a global variable named '%s'", token.theSource);
         return;
     }
-    else if (!bldUtil->declareVariable(token.theSource))
+    else if (!bldUtil->declareVariable(token.theSource, declaredType))
     {
         errorWithMessage(decl, "there is already a variable named '%s'", token.theSource);
         return;
@@ -371,6 +406,12 @@ void Parser::decl2()
 
     match();
 
+    // typed variables start out as 0 instead of empty, so that they never hold anything but their type
+    if (declaredType == VT_INTEGER)
+        bldUtil->writeVariable(token.theSource, bldUtil->mkConstInt(0));
+    else if (declaredType == VT_DECIMAL)
+        bldUtil->writeVariable(token.theSource, bldUtil->mkConstFloat(0.0));
+
     // =
     if (parserSet.first(Productions::initializer, theNextToken.theType))
     {
@@ -380,7 +421,7 @@ void Parser::decl2()
         {
             match();
             //Save the initializer
-            if (initialValue)
+            if (initialValue && checkAssignedType(token.theSource, initialValue))
             {
                 bldUtil->writeVariable(token.theSource, initialValue);
             }
@@ -388,11 +429,11 @@ void Parser::decl2()
         else if (check(TOKEN_COMMA))
         {
             match();
-            if (initialValue)
+            if (initialValue && checkAssignedType(token.theSource, initialValue))
             {
                 bldUtil->writeVariable(token.theSource, initialValue);
             }
-            decl2();
+            decl2(declaredType);
         }
         else
         {
@@ -404,7 +445,7 @@ void Parser::decl2()
     else if (check(TOKEN_COMMA))
     {
         match();
-        decl2();
+        decl2(declaredType);
     }
     // ;
     else if (check(TOKEN_SEMICOLON))
@@ -467,11 +508,11 @@ void Parser::parmDecl()
 {
     if (parserSet.first(Productions::decl_spec, theNextToken.theType))
     {
-        declSpec();
+        VARTYPE declaredType = declSpec();
 
         if (check(TOKEN_IDENTIFIER))
         {
-            bldUtil->addParam(theNextToken.theSource);
+            bldUtil->addParam(theNextToken.theSource, declaredType);
             match();
         }
         else if (isKeyword(theNextToken.theType))
@@ -1209,6 +1250,8 @@ RValue *Parser::assignmentExpr2(RValue *lhs)
         {
             result = bldUtil->mkBinaryOp(op, lhs, rhs);
         }
+        if (target->varName && !checkAssignedType(target->varName, result))
+            return result;
         bldUtil->mkAssignment(target, result);
         return result;
     }
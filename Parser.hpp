@@ -48,14 +48,16 @@ private:
     void externalDecl2(bool variableonly);
     RValue *initializer();
     
-    void declSpec();
+    VARTYPE declSpec();
     void decl();
-    void decl2();
+    void decl2(VARTYPE declaredType);
     void funcDeclare();
     void funcDeclare1();
     void parmDecl();
     void paramList();
     void paramList2();
+    bool strictTypes();
+    bool checkAssignedType(const char *varName, RValue *value);
     void stmtList();
     
     void stmt();
@@ -9,6 +9,7 @@
 #include "List.hpp"
 #include "ScriptUtils.h"
 #include "Builtins.hpp"
+#include "ArrayList.hpp"
 
 void BasicBlock::addPred(BasicBlock *newPred)
 {
@@ -45,26 +46,6 @@ void BasicBlock::print()
     }
 }
 
-bool BasicBlock::dominates(BasicBlock *other, BasicBlock *without, int numBlocks)
-{
-    BitSet tested(numBlocks, true);
-    return this->dominates(other, without, &tested);
-}
-
-bool BasicBlock::dominates(BasicBlock *b, BasicBlock *without, BitSet *tested)
-{
-    if (tested->test(b->id)) return true;
-    tested->set(b->id);
-    if (b == this) return true;
-    if (b == without) return false;
-    if (b->preds.isEmpty()) return false; // start block
-    foreach_list(b->preds, BasicBlock*, iter)
-    {
-        if (!this->dominates(iter.value(), without, tested)) return false;
-    }
-    return true;
-}
-
 const char *SSABuilder::getIdentString(const char *variable, BasicBlock *block)
 {
     snprintf(identBuf, sizeof(identBuf), "%s:%i", variable, block->id);
@@ -110,215 +91,2481 @@ RValue *SSABuilder::readVariableRecursive(const char *variable, BasicBlock *bloc
         // incompletePhis[block][variable] ← val
         if (block->incompletePhis.findByName(variable))
         {
-            block->incompletePhis.update(phi);
+            block->incompletePhis.update(phi);
+        }
+        else
+        {
+            block->incompletePhis.gotoLast();
+            block->incompletePhis.insertAfter(phi, variable);
+        }
+        val = phi->value();
+    }
+    else if (block->preds.size() == 1)
+    {
+        // Optimize the common case of one predecessor: No phi needed
+        val = readVariable(variable, block->preds.retrieve());
+    }
+    else
+    {
+        // Break potential cycles with operandless phi
+        Phi *phi = new(memCtx) Phi(valueId());
+        insertInstructionAtStart(phi, block);
+        writeVariable(variable, block, phi->value());
+        val = addPhiOperands(variable, block, phi);
+    }
+    writeVariable(variable, block, val);
+    return val;
+}
+
+RValue *SSABuilder::addPhiOperands(const char *variable, BasicBlock *block, Phi *phi)
+{
+    // Determine operands from predecessors
+    phi->sourceBlocks = ralloc_array(memCtx, BasicBlock*, block->preds.size());
+    int i = 0;
+    foreach_list(block->preds, BasicBlock*, iter)
+    {
+        BasicBlock *pred = iter.value();
+        RValue *operand = readVariable(variable, pred);
+        phi->appendOperand(operand);
+        phi->sourceBlocks[i++] = pred;
+    }
+    return tryRemoveTrivialPhi(phi);
+}
+
+RValue *SSABuilder::tryRemoveTrivialPhi(Phi *phi)
+{
+    // printf("tryRemoveTrivialPhi: "); phi->print();
+    RValue *same = NULL;
+    foreach_list(phi->operands, RValue*, iter)
+    {
+        RValue *op = iter.value();
+        if (op == same || op == phi->value())
+            continue; // Unique value or self−reference
+        if (same != NULL) {
+            // printf("not trivial: "); same->printDst(); printf(" and "); op->printDst(); printf("\n");
+            return phi->value(); // The phi merges at least two values: not trivial
+        }
+        same = op;
+    }
+    if (same == NULL)
+    {
+        same = new(memCtx) Undef(); // The phi is unreachable or in the start block
+    }
+    // printf("trivial phi; replace with "); same->printDst(); printf("\n");
+    // remember all users except the phi itself
+    List<Phi*> phiUsers;
+    foreach_list(phi->value()->users, Instruction*, iter)
+    {
+        Instruction *use = iter.value();
+        if (use->isPhi() && use != phi)
+        {
+            phiUsers.insertAfter(use->asPhi(), NULL);
+        }
+    }
+    phi->value()->replaceBy(same); // Reroute all uses of phi to same and remove phi
+    foreach_list(currentDef, RValue*, iter)
+    {
+        // replace variable value with same
+        if (iter.value() == phi->value())
+            iter.update(same);
+    }
+    
+    // Try to recursively remove all phi users, which might have become trivial
+    foreach_list(phiUsers, Phi*, iter)
+    {
+        tryRemoveTrivialPhi(iter.value());
+    }
+    return same;
+}
+
+void SSABuilder::sealBlock(BasicBlock *block)
+{
+    foreach_list(block->incompletePhis, Phi*, iter)
+    {
+        addPhiOperands(iter.name(), block, iter.value());
+    }
+    block->isSealed = true; // sealedBlocks.add(block)
+}
+
+// create BB and insert after the given block
+BasicBlock *SSABuilder::createBBAfter(BasicBlock *existingBB)
+{
+    BasicBlock *newBB = new(memCtx) BasicBlock(nextBBId++);
+    basicBlockList.gotoLast();
+    basicBlockList.insertAfter(newBB, NULL);
+    if (existingBB) instructionList.setCurrent(existingBB->end);
+
+    // insert start/end instructions into instruction list
+    Instruction *start = new(memCtx) BlockDecl(newBB), *end = new(memCtx) NoOp();
+    instructionList.insertAfter(start, NULL);
+    newBB->start = instructionList.currentNode();
+    instructionList.insertAfter(end, NULL);
+    newBB->end = instructionList.currentNode();
+    return newBB;
+}
+
+// insert instruction at end of basic block
+void SSABuilder::insertInstruction(Instruction *inst, BasicBlock *bb)
+{
+    instructionList.setCurrent(bb->end);
+    instructionList.insertBefore(inst, NULL);
+    inst->block = bb;
+}
+
+// insert instruction at start of basic block
+void SSABuilder::insertInstructionAtStart(Instruction *inst, BasicBlock *bb)
+{
+    instructionList.setCurrent(bb->start);
+    instructionList.insertAfter(inst, NULL);
+    inst->block = bb;
+}
+
+// insert instruction at end of basic block
+Constant *SSABuilder::addConstant(ScriptVariant sv)
+{
+    // TODO: prevent duplicates
+    constantList.gotoLast();
+    Constant *c = new(memCtx) Constant(sv);
+    constantList.insertAfter(c, NULL);
+    return c;
+}
+
+void SSABuilder::printInstructionList()
+{
+    foreach_list(instructionList, Instruction*, iter)
+    {
+        iter.value()->print();
+    }
+}
+
+// replace calls to cc_constant("SOME_ENGINE_CONSTANT_NAME") with the actual constant value
+void SSABuilder::foldConstantCalls()
+{
+    instructionList.gotoFirst();
+    foreach_list(instructionList, Instruction *, iter)
+    {
+        Instruction *inst = iter.value();
+        if (inst->isFunctionCall())
+        {
+            FunctionCall *call = inst->asFunctionCall();
+            if (strcmp(call->functionName, "cc_constant") == 0 && call->operands.size() == 1)
+            {
+                call->operands.gotoFirst();
+                if (call->operands.retrieve()->isConstant())
+                {
+                    ScriptVariant *constantName = &call->operands.retrieve()->asConstant()->constValue;
+                    ScriptVariant constant = {{.ptrVal = NULL}, VT_EMPTY};
+                    if (scriptConstantValue(constantName, &constant) == CC_OK)
+                    {
+                        Constant *constantValue = addConstant(constant);
+                        call->dst->replaceBy(constantValue);
+
+                        // have to remove the call instruction here since DCE doesn't touch function calls
+                        call->operands.retrieve()->unref(call);
+                        iter.remove();
+                    }
+                }
+            }
+        }
+    }
+}
+
+static bool hasStringConstant(Instruction *inst)
+{
+    foreach_list(inst->operands, RValue*, iter)
+    {
+        RValue *src = iter.value();
+        if (src->isConstant() && src->asConstant()->constValue.vt == VT_STR)
+            return true;
+    }
+    return false;
+}
+
+// Returns the addition that value is the result of, if it's only used as the left operand of user, another addition in
+// the same block. Such an addition can be fused with its user.
+static Expression *chainedAddition(RValue *value, Instruction *user)
+{
+    if (!value->isTemporary() || value->users.size() != 1) return NULL;
+    Expression *expr = value->asTemporary()->expr;
+    if (expr->op != OP_ADD || user->op != OP_ADD || expr->block != user->block || user->src(0) != value) return NULL;
+    return expr;
+}
+
+/* Replaces a chain of additions like "x=" + x + ", y=" + y, each of which copies the whole string built so far, with
+   one OP_CONCAT that converts and copies every part once. Once an addition in the chain has a string constant operand,
+   its result is a string, so it and every addition after it are concatenations. */
+void SSABuilder::fuseConcatenations()
+{
+    foreach_list(instructionList, Instruction*, iter)
+    {
+        Instruction *last = iter.value();
+        if (last->op != OP_ADD) continue;
+
+        // start from the end of a chain
+        Temporary *result = last->asExpression()->value();
+        if (result->users.size() == 1 && chainedAddition(result, result->users.firstNode()->value)) continue;
+
+        // walk back to the first addition that's known to concatenate strings
+        Instruction *first = NULL;
+        int numAdditions = 0, numFused = 0;
+        for (Instruction *add = last; add; add = chainedAddition(add->src(0), add))
+        {
+            ++numAdditions;
+            if (hasStringConstant(add))
+            {
+                first = add;
+                numFused = numAdditions;
+            }
+        }
+        if (numFused < 2 || numFused >= 255) continue;
+
+        // Converting an object to a string reads its current contents, so the parts can't be converted later than
+        // the additions would have converted them if anything in between could modify an object.
+        bool hasSideEffects = false;
+        for (Node<Instruction*> *node = iter.node(); node->value != first; node = node->getPrevious())
+        {
+            if (node->value->isFunctionCall() || node->value->op == OP_SET)
+                hasSideEffects = true;
+        }
+        if (hasSideEffects) continue;
+
+        List<RValue*> parts;
+        parts.insertAfter(first->src(0));
+        for (Instruction *add = first; ; add = add->asExpression()->value()->users.firstNode()->value)
+        {
+            parts.gotoLast();
+            parts.insertAfter(add->src(1));
+            if (add == last) break;
+        }
+
+        // the other additions in the chain are left without users, so DCE will remove them
+        foreach_list(last->operands, RValue*, srcIter)
+        {
+            srcIter.value()->unref(last);
+        }
+        last->operands.clear();
+        foreach_list(parts, RValue*, partIter)
+        {
+            last->appendOperand(partIter.value());
+        }
+        last->op = OP_CONCAT;
+    }
+}
+
+void SSABuilder::buildSuccessorLists()
+{
+    foreach_list(basicBlockList, BasicBlock*, iter)
+    {
+        iter.value()->succs.clear();
+    }
+    foreach_list(basicBlockList, BasicBlock*, iter)
+    {
+        BasicBlock *block = iter.value();
+        foreach_list(block->preds, BasicBlock*, predIter)
+        {
+            predIter.value()->succs.insertAfter(block, NULL);
+        }
+    }
+}
+
+// walks up the dominator tree from two blocks until they meet at their closest common dominator
+static BasicBlock *intersectDominators(BasicBlock *a, BasicBlock *b)
+{
+    while (a != b)
+    {
+        while (a->postorderIndex < b->postorderIndex) a = a->idom;
+        while (b->postorderIndex < a->postorderIndex) b = b->idom;
+    }
+    return a;
+}
+
+/* Computes the immediate dominator of every reachable block with the iterative algorithm from "A Simple, Fast
+   Dominance Algorithm" by Cooper, Harvey and Kennedy, which converges in a couple of passes over the blocks in reverse
+   postorder for the kind of control flow a script function has. */
+void SSABuilder::computeDominators()
+{
+    buildSuccessorLists();
+    foreach_list(basicBlockList, BasicBlock*, iter)
+    {
+        iter.value()->idom = NULL;
+        iter.value()->domChildren.clear();
+        iter.value()->postorderIndex = -1;
+        iter.value()->domPreorder = iter.value()->domSubtreeEnd = -1;
+    }
+
+    // number the reachable blocks in postorder with an iterative depth-first search
+    struct SearchState {
+        BasicBlock *block;
+        Node<BasicBlock*> *nextSucc;
+    };
+    ArrayList<SearchState> stack;
+    ArrayList<BasicBlock*> postorder;
+    BasicBlock *startBlock = basicBlockList.firstNode()->value;
+    SearchState start = {startBlock, startBlock->succs.firstNode()};
+    startBlock->postorderIndex = 0; // marks it visited until it gets its real index
+    stack.append(start);
+    while (stack.size() > 0)
+    {
+        SearchState *state = stack.getPtr(stack.size() - 1);
+        if (state->nextSucc == NULL)
+        {
+            state->block->postorderIndex = postorder.size();
+            postorder.append(state->block);
+            stack.removeLast();
+            continue;
+        }
+        BasicBlock *succ = state->nextSucc->value;
+        state->nextSucc = state->nextSucc->getNext();
+        if (succ->postorderIndex < 0)
+        {
+            SearchState next = {succ, succ->succs.firstNode()};
+            succ->postorderIndex = 0;
+            stack.append(next);
+        }
+    }
+
+    // the start block is its own dominator while the algorithm runs
+    startBlock->idom = startBlock;
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (int i = (int) postorder.size() - 2; i >= 0; i--)
+        {
+            BasicBlock *block = postorder.get(i);
+            BasicBlock *newIdom = NULL;
+            foreach_list(block->preds, BasicBlock*, predIter)
+            {
+                BasicBlock *pred = predIter.value();
+                if (pred->idom == NULL) continue; // unreachable, or not processed yet
+                newIdom = newIdom ? intersectDominators(pred, newIdom) : pred;
+            }
+            if (newIdom != block->idom)
+            {
+                block->idom = newIdom;
+                changed = true;
+            }
+        }
+    }
+    startBlock->idom = NULL;
+
+    for (uint32_t i = 0; i < postorder.size(); i++)
+    {
+        BasicBlock *block = postorder.get(i);
+        if (block->idom)
+        {
+            block->idom->domChildren.insertAfter(block, NULL);
+        }
+    }
+
+    // Number the dominator tree in preorder. The blocks a block dominates are its subtree, which is numbered from the
+    // block itself to domSubtreeEnd, so BasicBlock::dominates() is just a range check.
+    struct TreeState {
+        BasicBlock *block;
+        Node<BasicBlock*> *nextChild;
+    };
+    ArrayList<TreeState> treeStack;
+    int nextPreorder = 0;
+    TreeState root = {startBlock, startBlock->domChildren.firstNode()};
+    startBlock->domPreorder = nextPreorder++;
+    treeStack.append(root);
+    while (treeStack.size() > 0)
+    {
+        TreeState *state = treeStack.getPtr(treeStack.size() - 1);
+        if (state->nextChild == NULL)
+        {
+            state->block->domSubtreeEnd = nextPreorder - 1;
+            treeStack.removeLast();
+            continue;
+        }
+        BasicBlock *child = state->nextChild->value;
+        state->nextChild = state->nextChild->getNext();
+        TreeState childState = {child, child->domChildren.firstNode()};
+        child->domPreorder = nextPreorder++;
+        treeStack.append(childState);
+    }
+}
+
+// true if the expression always computes the same value from the same operands, without side effects
+static bool isPureExpression(Expression *expr);
+
+// true if the value is always a number (or the instruction computing it fails)
+static bool isNumber(RValue *value, int depth = 0)
+{
+    if (value->isConstant())
+    {
+        int vt = value->asConstant()->constValue.vt;
+        return vt == VT_INTEGER || vt == VT_DECIMAL;
+    }
+    else if (!value->isTemporary() || depth > 8)
+    {
+        return false;
+    }
+
+    Expression *expr = value->asTemporary()->expr;
+    if (expr->op == OP_ADD)
+    {
+        // adding anything but two numbers either concatenates or fails
+        return isNumber(expr->src(0), depth + 1) && isNumber(expr->src(1), depth + 1);
+    }
+    return isPureExpression(expr);
+}
+
+static bool isPureExpression(Expression *expr)
+{
+    switch (expr->op)
+    {
+        case OP_NEG:
+        case OP_BOOL_NOT:
+        case OP_BIT_NOT:
+        case OP_INC:
+        case OP_DEC:
+        case OP_BOOL:
+        case OP_BIT_OR:
+        case OP_XOR:
+        case OP_BIT_AND:
+        case OP_EQ:
+        case OP_NE:
+        case OP_LT:
+        case OP_GT:
+        case OP_GE:
+        case OP_LE:
+        case OP_SHL:
+        case OP_SHR:
+        case OP_SUB:
+        case OP_MUL:
+        case OP_DIV:
+        case OP_REM:
+        case OP_CHECK_INT:
+        case OP_CHECK_DECIMAL:
+            return true;
+        case OP_ADD:
+            // Adding a list to a list creates a new one, and adding an object or list to a string converts its current
+            // contents, so additions are only pure if one side is a number and neither can happen.
+            return isNumber(expr->src(0)) || isNumber(expr->src(1));
+        default:
+            return false;
+    }
+}
+
+static inline bool isCommutative(Expression *expr)
+{
+    switch (expr->op)
+    {
+        case OP_BIT_OR:
+        case OP_XOR:
+        case OP_BIT_AND:
+        case OP_EQ:
+        case OP_NE:
+        case OP_MUL:
+            return true;
+        case OP_ADD:
+            // string concatenation isn't commutative
+            return isNumber(expr->src(0)) && isNumber(expr->src(1));
+        default:
+            return false;
+    }
+}
+
+// Constants are compared by value, since each use of a literal in a script gets its own Constant, and so are references
+// to global variables. Anything else is only equal to itself.
+static bool sameValue(RValue *a, RValue *b)
+{
+    if (a == b) return true;
+    if (a->isGlobalVarRef() && b->isGlobalVarRef()) return a->asGlobalVarRef()->id == b->asGlobalVarRef()->id;
+    if (!a->isConstant() || !b->isConstant()) return false;
+
+    const ScriptVariant *x = &a->asConstant()->constValue, *y = &b->asConstant()->constValue;
+    if (x->vt != y->vt) return false;
+    switch (x->vt)
+    {
+        case VT_INTEGER: return x->lVal == y->lVal;
+        case VT_DECIMAL: return memcmp(&x->dblVal, &y->dblVal, sizeof(double)) == 0; // 0.0 isn't -0.0
+        case VT_STR: return ScriptVariant_IsEqual(x, y);
+        case VT_EMPTY: return true;
+        default: return false;
+    }
+}
+
+static uint32_t hashValue(RValue *value)
+{
+    if (value->isConstant())
+    {
+        const ScriptVariant *var = &value->asConstant()->constValue;
+        switch (var->vt)
+        {
+            case VT_INTEGER: return var->lVal * 2654435761u;
+            case VT_DECIMAL: { uint64_t bits; memcpy(&bits, &var->dblVal, sizeof(bits)); return bits ^ (bits >> 32); }
+            case VT_STR: return StrCache_GetEntry(var->strVal)->hash;
+            default: return var->vt;
+        }
+    }
+    else if (value->isGlobalVarRef())
+    {
+        return value->asGlobalVarRef()->id;
+    }
+    uintptr_t ptr = (uintptr_t) value;
+    return (uint32_t) ((ptr >> 4) * 2654435761u);
+}
+
+/* Table of the pure expressions available at the current point of a walk over the dominator tree. Each bucket is a
+   chain of entries linked from newest to oldest, and entries are only ever removed newest first, when the walk leaves
+   the block that added them, so removing one just restores the bucket to the chain it had before. */
+class ValueTable
+{
+private:
+    struct Entry {
+        Expression *expr;
+        uint32_t hash;
+        int next; // older entry in the same bucket, or -1
+    };
+    ArrayList<Entry> entries;
+    int *buckets;
+    uint32_t numBuckets;
+
+    static uint32_t hash(Expression *expr)
+    {
+        uint32_t h0 = hashValue(expr->src(0)), h1 = expr->operands.size() > 1 ? hashValue(expr->src(1)) : 0;
+        // swapping the operands of a commutative operation has to give the same hash
+        uint32_t h = isCommutative(expr) ? h0 + h1 : h0 * 31 + h1;
+        return (h ^ (h >> 15)) * 2246822519u + expr->op;
+    }
+
+    static bool equal(Expression *a, Expression *b)
+    {
+        if (a->op != b->op || a->operands.size() != b->operands.size()) return false;
+        if (a->operands.size() == 1) return sameValue(a->src(0), b->src(0));
+        return (sameValue(a->src(0), b->src(0)) && sameValue(a->src(1), b->src(1))) ||
+               (isCommutative(a) && sameValue(a->src(0), b->src(1)) && sameValue(a->src(1), b->src(0)));
+    }
+
+public:
+    ValueTable(int maxEntries)
+    {
+        numBuckets = 16;
+        while (numBuckets < (uint32_t) maxEntries) numBuckets *= 2;
+        buckets = (int*) malloc(numBuckets * sizeof(int));
+        memset(buckets, -1, numBuckets * sizeof(int));
+    }
+
+    ~ValueTable() { free(buckets); }
+
+    // returns an equal expression in the table, or adds this one and returns NULL
+    Expression *findOrAdd(Expression *expr)
+    {
+        uint32_t h = hash(expr);
+        int *bucket = &buckets[h & (numBuckets - 1)];
+        for (int i = *bucket; i >= 0; i = entries.getPtr(i)->next)
+        {
+            Entry *entry = entries.getPtr(i);
+            if (entry->hash == h && equal(entry->expr, expr))
+                return entry->expr;
+        }
+        Entry entry = {expr, h, *bucket};
+        entries.append(entry);
+        *bucket = entries.size() - 1;
+        return NULL;
+    }
+
+    inline uint32_t size() { return entries.size(); }
+
+    // removes the entries added since the table had this size
+    void truncate(uint32_t size)
+    {
+        while (entries.size() > size)
+        {
+            Entry entry = entries.removeLast();
+            buckets[entry.hash & (numBuckets - 1)] = entry.next;
+        }
+    }
+};
+
+// true if the instruction reads an object, list or global variable
+static inline bool isMemoryRead(Instruction *inst)
+{
+    return inst->op == OP_GET || inst->op == OP_GET_GLOBAL;
+}
+
+// true if the instruction can modify an object, list or global variable
+static inline bool isMemoryWrite(Instruction *inst)
+{
+    return inst->isFunctionCall() || inst->op == OP_SET || inst->op == OP_EXPORT;
+}
+
+// Pure expressions are looked up in a table that's scoped to the dominator tree. Reads of objects, lists and globals
+// are only looked up in a second table that's emptied at the start of each block and by anything that might write to
+// them, since there's no cheap way to know what happens to them on every path between blocks.
+static void numberValuesInBlock(BasicBlock *block, ValueTable *table, ValueTable *reads,
+                                List<Instruction*> *instructionList)
+{
+    uint32_t tableSize = table->size();
+    reads->truncate(0);
+    for (Node<Instruction*> *node = block->start->getNext(), *next; node != block->end; node = next)
+    {
+        next = node->getNext();
+        Instruction *inst = node->value;
+        if (isMemoryWrite(inst))
+        {
+            reads->truncate(0);
+            continue;
+        }
+
+        Expression *existing;
+        if (inst->isExpression() && isPureExpression(inst->asExpression()))
+            existing = table->findOrAdd(inst->asExpression());
+        else if (isMemoryRead(inst))
+            existing = reads->findOrAdd(inst->asExpression());
+        else
+            continue;
+
+        Expression *expr = inst->asExpression();
+        if (existing)
+        {
+            expr->value()->replaceBy(existing->value());
+            foreach_list(expr->operands, RValue*, srcIter)
+            {
+                srcIter.value()->unref(expr);
+            }
+            instructionList->removeNode(node);
+        }
+    }
+
+    // values computed here are available in the blocks this one dominates
+    foreach_list(block->domChildren, BasicBlock*, iter)
+    {
+        numberValuesInBlock(iter.value(), table, reads, instructionList);
+    }
+    table->truncate(tableSize);
+}
+
+/* Dominator-based value numbering, as in "Value Numbering" by Briggs, Cooper and Simpson: a pure expression is
+   replaced by an earlier one with the same opcode and operands if that one is in the same block or one that dominates
+   it, so that it's been computed on every path that reaches the later one. */
+void SSABuilder::numberValues()
+{
+    computeDominators();
+    ValueTable table(instructionList.size()), reads(instructionList.size());
+    numberValuesInBlock(basicBlockList.firstNode()->value, &table, &reads, &instructionList);
+}
+
+// true if the instruction can stop the script with an error
+static bool mayFail(Instruction *inst)
+{
+    switch (inst->op)
+    {
+        case OP_NOOP:
+        case OP_BB_START:
+        case OP_PHI:
+        case OP_RETURN:
+        case OP_MOV:
+        case OP_GET_GLOBAL:
+        case OP_BOOL_NOT:
+        case OP_BOOL:
+        case OP_EQ:
+        case OP_NE:
+        case OP_LT:
+        case OP_GT:
+        case OP_GE:
+        case OP_LE:
+        case OP_MKOBJECT:
+        case OP_MKLIST:
+        case OP_EXPORT:
+            return false;
+        case OP_NEG:
+            return !isNumber(inst->src(0));
+        case OP_ADD:
+        case OP_SUB:
+        case OP_MUL:
+            return !isNumber(inst->src(0)) || !isNumber(inst->src(1));
+        default:
+            return !inst->isJump();
+    }
+}
+
+// adds the blocks in a loop and in the loops nested in it to a set
+static void collectLoopBlocks(Loop *loop, BitSet *blocks)
+{
+    blocks->set(loop->header->id);
+    foreach_list(loop->nodes, BasicBlock*, iter)
+    {
+        blocks->set(iter.value()->id);
+    }
+    foreach_list(loop->children, Loop*, iter)
+    {
+        collectLoopBlocks(iter.value(), blocks);
+    }
+}
+
+// what a loop writes to and where it can be left, for deciding what can be moved out of it
+struct LoopSummary {
+    BitSet *blocks;
+    bool hasCalls; // a function call can write to anything
+    ArrayList<Instruction*> writes; // OP_SET and OP_EXPORT instructions
+    ArrayList<BasicBlock*> exits; // blocks that leave the loop, return, or go back to the header
+};
+
+// true if a write in the loop could change what a read of an object, list or global variable gives
+static bool isWrittenInLoop(Expression *read, LoopSummary *loop)
+{
+    if (loop->hasCalls) return true;
+    for (uint32_t i = 0; i < loop->writes.size(); i++)
+    {
+        Instruction *write = loop->writes.get(i);
+        if (read->op == OP_GET_GLOBAL)
+        {
+            if (write->op == OP_EXPORT && write->asExport()->dst->id == read->src(0)->asGlobalVarRef()->id)
+                return true;
+        }
+        else if (write->op == OP_SET)
+        {
+            // Without knowing which containers are the same, the only writes that certainly don't change the value
+            // are to a different constant key.
+            RValue *readKey = read->src(1), *writtenKey = write->src(1);
+            if (!readKey->isConstant() || !writtenKey->isConstant() ||
+                readKey->asConstant()->constValue.vt != writtenKey->asConstant()->constValue.vt ||
+                sameValue(readKey, writtenKey))
+                return true;
+        }
+    }
+    return false;
+}
+
+// true if the instruction gives the same value on every iteration of the loop
+static bool isLoopInvariant(Instruction *inst, LoopSummary *loop)
+{
+    if (!inst->isExpression()) return false;
+    Expression *expr = inst->asExpression();
+    if (expr->op == OP_GET || expr->op == OP_GET_GLOBAL)
+    {
+        if (isWrittenInLoop(expr, loop)) return false;
+    }
+    else if (!isPureExpression(expr))
+    {
+        return false;
+    }
+
+    foreach_list(expr->operands, RValue*, iter)
+    {
+        RValue *src = iter.value();
+        if (src->isTemporary() && loop->blocks->test(src->asTemporary()->expr->block->id))
+            return false;
+    }
+    return true;
+}
+
+// true if the instruction runs on every iteration of the loop, before anything that can fail or write to memory
+static bool runsFirstInLoop(Node<Instruction*> *node, BasicBlock *header, LoopSummary *loop)
+{
+    BasicBlock *block = node->value->block;
+    for (uint32_t i = 0; i < loop->exits.size(); i++)
+    {
+        if (!block->dominates(loop->exits.get(i))) return false;
+    }
+
+    for (Node<Instruction*> *prev = node->getPrevious(); prev != block->start; prev = prev->getPrevious())
+    {
+        if (mayFail(prev->value) || isMemoryWrite(prev->value)) return false;
+    }
+
+    // check every block that can run between the start of an iteration and this one
+    BitSet visited(loop->blocks->getSize(), true);
+    ArrayList<BasicBlock*> worklist;
+    visited.set(block->id);
+    if (block != header)
+    {
+        foreach_list(block->preds, BasicBlock*, iter)
+        {
+            worklist.append(iter.value());
+        }
+    }
+    while (worklist.size() > 0)
+    {
+        BasicBlock *pred = worklist.removeLast();
+        if (visited.test(pred->id)) continue;
+        visited.set(pred->id);
+        for (Node<Instruction*> *n = pred->start->getNext(); n != pred->end; n = n->getNext())
+        {
+            if (mayFail(n->value) || isMemoryWrite(n->value)) return false;
+        }
+        if (pred == header) continue;
+        foreach_list(pred->preds, BasicBlock*, iter)
+        {
+            worklist.append(iter.value());
+        }
+    }
+    return true;
+}
+
+static void hoistFromLoop(Loop *loop, List<BasicBlock*> *blocks, List<Instruction*> *instructionList)
+{
+    // inner loops first, so that what they move into the loop around them can move further out from there
+    foreach_list(loop->children, Loop*, iter)
+    {
+        hoistFromLoop(iter.value(), blocks, instructionList);
+    }
+
+    BasicBlock *header = loop->header;
+    if (header->domPreorder < 0) return;
+    BitSet inLoop(blocks->size(), true);
+    collectLoopBlocks(loop, &inLoop);
+
+    // Instructions are moved to the end of the block before the loop, which has to be the only way into the loop and
+    // can't lead anywhere else.
+    BasicBlock *preheader = NULL;
+    foreach_list(header->preds, BasicBlock*, iter)
+    {
+        if (inLoop.test(iter.value()->id)) continue;
+        if (preheader) return;
+        preheader = iter.value();
+    }
+    if (!preheader || preheader->succs.size() != 1) return;
+
+    LoopSummary summary;
+    summary.blocks = &inLoop;
+    summary.hasCalls = false;
+    foreach_plist(blocks, BasicBlock*, iter)
+    {
+        BasicBlock *block = iter.value();
+        if (!inLoop.test(block->id)) continue;
+        bool isExit = (block->end->getPrevious()->value->op == OP_RETURN);
+        foreach_list(block->succs, BasicBlock*, succIter)
+        {
+            if (succIter.value() == header || !inLoop.test(succIter.value()->id))
+                isExit = true;
+        }
+        if (isExit) summary.exits.append(block);
+
+        for (Node<Instruction*> *node = block->start->getNext(); node != block->end; node = node->getNext())
+        {
+            Instruction *inst = node->value;
+            if (inst->isFunctionCall())
+                summary.hasCalls = true;
+            else if (inst->op == OP_SET || inst->op == OP_EXPORT)
+                summary.writes.append(inst);
+        }
+    }
+
+    // Moving an instruction can make the ones using it invariant, and they can be in blocks that were already visited.
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        foreach_plist(blocks, BasicBlock*, iter)
+        {
+            BasicBlock *block = iter.value();
+            if (!inLoop.test(block->id) || block->domPreorder < 0) continue;
+            for (Node<Instruction*> *node = block->start->getNext(), *next; node != block->end; node = next)
+            {
+                next = node->getNext();
+                Instruction *inst = node->value;
+                if (!isLoopInvariant(inst, &summary)) continue;
+                // something that can fail is only moved if the loop would have failed at the same point anyway
+                if (mayFail(inst) && !runsFirstInLoop(node, header, &summary)) continue;
+
+                instructionList->removeNode(node);
+                Node<Instruction*> *insertPoint = preheader->end->getPrevious();
+                while (insertPoint->value->isJump())
+                    insertPoint = insertPoint->getPrevious();
+                instructionList->setCurrent(insertPoint);
+                instructionList->insertAfter(inst, NULL);
+                inst->block = preheader;
+                changed = true;
+            }
+        }
+    }
+}
+
+/* Loop-invariant code motion: an instruction that gives the same value on every iteration of a loop is moved to the
+   block that enters the loop, so that it runs once. Pure expressions that can't fail are moved from anywhere in the
+   loop, since running them when the loop wouldn't have is harmless. Anything else is only moved if it's certain to run
+   before the loop does anything else that can fail or be seen from outside. */
+void SSABuilder::hoistLoopInvariants()
+{
+    computeDominators();
+    foreach_list(loops, Loop*, iter)
+    {
+        hoistFromLoop(iter.value(), &basicBlockList, &instructionList);
+    }
+}
+
+// computes the result of a unary or binary operation on constants
+static CCResult evaluateOp(OpCode op, ScriptVariant *result, const ScriptVariant *src0, const ScriptVariant *src1)
+{
+    switch (op)
+    {
+    // unary
+    case OP_NEG: return ScriptVariant_Neg(result, src0);
+    case OP_BOOL_NOT: return ScriptVariant_Boolean_Not(result, src0);
+    case OP_BIT_NOT: return ScriptVariant_Bit_Not(result, src0);
+    case OP_INC: return ScriptVariant_Inc(result, src0);
+    case OP_DEC: return ScriptVariant_Dec(result, src0);
+    case OP_BOOL: return ScriptVariant_ToBoolean(result, src0);
+    // binary
+    case OP_BIT_OR: return ScriptVariant_Bit_Or(result, src0, src1);
+    case OP_XOR: return ScriptVariant_Xor(result, src0, src1);
+    case OP_BIT_AND: return ScriptVariant_Bit_And(result, src0, src1);
+    case OP_EQ: return ScriptVariant_Eq(result, src0, src1);
+    case OP_NE: return ScriptVariant_Ne(result, src0, src1);
+    case OP_LT: return ScriptVariant_Lt(result, src0, src1);
+    case OP_GT: return ScriptVariant_Gt(result, src0, src1);
+    case OP_GE: return ScriptVariant_Ge(result, src0, src1);
+    case OP_LE: return ScriptVariant_Le(result, src0, src1);
+    case OP_SHL: return ScriptVariant_Shl(result, src0, src1);
+    case OP_SHR: return ScriptVariant_Shr(result, src0, src1);
+    case OP_ADD: return ScriptVariant_Add(result, src0, src1);
+    case OP_SUB: return ScriptVariant_Sub(result, src0, src1);
+    case OP_MUL: return ScriptVariant_Mul(result, src0, src1);
+    case OP_DIV: return ScriptVariant_Div(result, src0, src1);
+    case OP_REM: return ScriptVariant_Rem(result, src0, src1);
+    // type checks
+    case OP_CHECK_INT:
+        if (src0->vt != VT_INTEGER) return CC_FAIL;
+        *result = *src0;
+        return CC_OK;
+    case OP_CHECK_DECIMAL:
+        if (ScriptVariant_DecimalValue(src0, &result->dblVal) != CC_OK) return CC_FAIL;
+        result->vt = VT_DECIMAL;
+        return CC_OK;
+    default: return CC_FAIL;
+    }
+}
+
+// True if evaluateOp() can compute the operation without failing or allocating. Operations that would fail are left
+// for the script to fail on when it runs them, which might be never.
+static bool canFold(OpCode op, const ScriptVariant *src0, const ScriptVariant *src1)
+{
+    bool numbers = (src0->vt == VT_INTEGER || src0->vt == VT_DECIMAL) &&
+                   (!src1 || src1->vt == VT_INTEGER || src1->vt == VT_DECIMAL);
+    bool integers = (src0->vt == VT_INTEGER && (!src1 || src1->vt == VT_INTEGER));
+    switch (op)
+    {
+        case OP_BOOL_NOT:
+        case OP_BOOL:
+        case OP_EQ:
+        case OP_NE:
+            return true;
+        case OP_NEG:
+        case OP_LT:
+        case OP_GT:
+        case OP_GE:
+        case OP_LE:
+        case OP_ADD:
+        case OP_SUB:
+        case OP_MUL:
+            return numbers;
+        case OP_BIT_NOT:
+        case OP_INC:
+        case OP_DEC:
+        case OP_BIT_OR:
+        case OP_XOR:
+        case OP_BIT_AND:
+        case OP_SHL:
+        case OP_SHR:
+            return integers;
+        case OP_DIV:
+        case OP_REM:
+            if (!(op == OP_DIV ? numbers : integers)) return false;
+            if (src1->vt == VT_DECIMAL) return src1->dblVal != 0.0;
+            return src1->lVal != 0 && !(src1->lVal == -1 && src0->vt == VT_INTEGER && src0->lVal == INT32_MIN);
+        case OP_CHECK_INT:
+            return src0->vt == VT_INTEGER;
+        case OP_CHECK_DECIMAL:
+            return numbers;
+        default:
+            return false;
+    }
+}
+
+/* Sparse conditional constant propagation, as in "Constant Propagation with Conditional Branches" by Wegman and
+   Zadeck. Every value starts out unknown and every block unreachable, and both only ever move one way: a value
+   becomes constant when it's first computed from constants, and varying when it's computed from anything else or a phi
+   merges two different constants. Phis only merge the operands coming from edges that have been found to be taken,
+   and a branch on a constant only makes one of its targets reachable, so code that never runs can't keep a value from
+   being constant. */
+class ConstantPropagation
+{
+private:
+    enum LatticeState { UNKNOWN, CONSTANT, VARYING };
+    struct LatticeValue {
+        LatticeState state;
+        Constant *constant;
+    };
+    enum BranchOutcome { BRANCH_UNKNOWN, BRANCH_TAKEN, BRANCH_NOT_TAKEN, BRANCH_EITHER };
+
+    SSABuilder *func;
+    LatticeValue *values; // indexed by temporary id
+    BitSet executableBlocks;
+    bool *executableEdges; // one for each entry in the predecessor list of each block
+    int *firstEdge; // index in executableEdges of the first predecessor of each block
+    ArrayList<BasicBlock*> blockWorklist;
+    ArrayList<Temporary*> valueWorklist;
+
+    LatticeValue valueOf(RValue *value)
+    {
+        LatticeValue result = {VARYING, NULL};
+        if (value->isConstant())
+        {
+            result.state = CONSTANT;
+            result.constant = value->asConstant();
+        }
+        else if (value->isTemporary())
+        {
+            result = values[value->asTemporary()->id];
+        }
+        return result;
+    }
+
+    // lowers a value, which is also done if it's set to a different constant
+    void lower(Temporary *temp, LatticeValue newValue)
+    {
+        LatticeValue *value = &values[temp->id];
+        if (value->state == VARYING || newValue.state == UNKNOWN) return;
+        if (value->state == CONSTANT)
+        {
+            if (newValue.state == CONSTANT && sameValue(value->constant, newValue.constant)) return;
+            newValue.state = VARYING;
+        }
+        *value = newValue;
+        valueWorklist.append(temp);
+    }
+
+    bool isEdgeExecutable(BasicBlock *from, BasicBlock *to)
+    {
+        int i = firstEdge[to->id];
+        foreach_list(to->preds, BasicBlock*, iter)
+        {
+            if (iter.value() == from && executableEdges[i]) return true;
+            i++;
+        }
+        return false;
+    }
+
+    void markEdge(BasicBlock *from, BasicBlock *to)
+    {
+        bool newEdge = false;
+        int i = firstEdge[to->id];
+        foreach_list(to->preds, BasicBlock*, iter)
+        {
+            if (iter.value() == from && !executableEdges[i])
+            {
+                executableEdges[i] = true;
+                newEdge = true;
+            }
+            i++;
+        }
+
+        if (!executableBlocks.test(to->id))
+        {
+            executableBlocks.set(to->id);
+            blockWorklist.append(to);
+        }
+        else if (newEdge)
+        {
+            // the phis have another operand to merge
+            for (Node<Instruction*> *node = to->start->getNext(); node->value->isPhi(); node = node->getNext())
+            {
+                visitExpression(node->value->asExpression());
+            }
+        }
+    }
+
+    void visitPhi(Phi *phi)
+    {
+        LatticeValue merged = {UNKNOWN, NULL};
+        int i = 0;
+        foreach_list(phi->operands, RValue*, iter)
+        {
+            BasicBlock *source = phi->sourceBlocks[i++];
+            if (!isEdgeExecutable(source, phi->block)) continue;
+            LatticeValue operand = valueOf(iter.value());
+            if (operand.state == UNKNOWN || iter.value() == phi->value()) continue;
+            if (operand.state == VARYING ||
+                (merged.state == CONSTANT && !sameValue(merged.constant, operand.constant)))
+            {
+                merged.state = VARYING;
+                break;
+            }
+            merged = operand;
+        }
+        lower(phi->value(), merged);
+    }
+
+    void visitExpression(Expression *expr)
+    {
+        LatticeValue current = values[expr->value()->id];
+        if (current.state == VARYING) return;
+        if (expr->isPhi())
+        {
+            visitPhi(expr->asPhi());
+            return;
+        }
+
+        LatticeValue result = {VARYING, NULL};
+        if (expr->op == OP_MOV)
+        {
+            result = valueOf(expr->src(0));
+        }
+        else if ((expr->op >= OP_NEG && expr->op <= OP_REM) || // the unary and binary operators
+                 expr->op == OP_CHECK_INT || expr->op == OP_CHECK_DECIMAL)
+        {
+            LatticeValue src0 = valueOf(expr->src(0)),
+                         src1 = expr->operands.size() == 2 ? valueOf(expr->src(1)) : src0;
+            if (src0.state == UNKNOWN || src1.state == UNKNOWN)
+            {
+                if (src0.state != VARYING && src1.state != VARYING) return;
+            }
+            else if (src0.state == CONSTANT && src1.state == CONSTANT)
+            {
+                // the operands can't change once they're constant, so neither can the result
+                if (current.state == CONSTANT) return;
+                const ScriptVariant *value0 = &src0.constant->constValue,
+                                    *value1 = expr->operands.size() == 2 ? &src1.constant->constValue : NULL;
+                ScriptVariant folded;
+                if (canFold(expr->op, value0, value1) && evaluateOp(expr->op, &folded, value0, value1) == CC_OK)
+                {
+                    result.state = CONSTANT;
+                    result.constant = func->addConstant(folded);
+                }
+            }
+        }
+        lower(expr->value(), result);
+    }
+
+    BranchOutcome branchOutcome(Jump *jump)
+    {
+        if (jump->op == OP_JMP) return BRANCH_TAKEN;
+        LatticeValue src0 = valueOf(jump->src(0)),
+                     src1 = jump->op == OP_BRANCH_EQUAL ? valueOf(jump->src(1)) : src0;
+        if (src0.state == UNKNOWN || src1.state == UNKNOWN) return BRANCH_UNKNOWN;
+        if (src0.state == VARYING || src1.state == VARYING) return BRANCH_EITHER;
+
+        bool taken;
+        if (jump->op == OP_BRANCH_EQUAL)
+            taken = ScriptVariant_IsEqual(&src0.constant->constValue, &src1.constant->constValue);
+        else
+            taken = ScriptVariant_IsTrue(&src0.constant->constValue) == (jump->op == OP_BRANCH_TRUE);
+        return taken ? BRANCH_TAKEN : BRANCH_NOT_TAKEN;
+    }
+
+    // marks the edges out of a block that can be taken, given what's known about the branch conditions so far
+    void visitBranches(BasicBlock *block)
+    {
+        for (Node<Instruction*> *node = block->start->getNext(); node != block->end; node = node->getNext())
+        {
+            Instruction *inst = node->value;
+            if (inst->op == OP_RETURN) return;
+            if (!inst->isJump()) continue;
+            BranchOutcome outcome = branchOutcome(inst->asJump());
+            if (outcome == BRANCH_UNKNOWN) return;
+            if (outcome != BRANCH_NOT_TAKEN) markEdge(block, inst->asJump()->target);
+            if (outcome == BRANCH_TAKEN) return;
+        }
+
+        // fall through to the next block
+        Node<Instruction*> *next = block->end->getNext();
+        if (next) markEdge(block, next->value->block);
+    }
+
+    void removeInstruction(Node<Instruction*> *node)
+    {
+        unrefOperands(node->value);
+        func->instructionList.removeNode(node);
+    }
+
+    static void unrefOperands(Instruction *inst)
+    {
+        foreach_list(inst->operands, RValue*, iter)
+        {
+            iter.value()->unref(inst);
+        }
+    }
+
+    // Resolves branches with known outcomes, and removes whatever follows an unconditional jump or return in the same
+    // block, which never runs.
+    void rewriteBranches(BasicBlock *block)
+    {
+        bool stopped = false;
+        for (Node<Instruction*> *node = block->start->getNext(), *next; node != block->end; node = next)
+        {
+            next = node->getNext();
+            Instruction *inst = node->value;
+            if (stopped)
+            {
+                removeInstruction(node);
+                continue;
+            }
+            if (inst->op == OP_RETURN) stopped = true;
+            if (!inst->isJump()) continue;
+
+            BranchOutcome outcome = branchOutcome(inst->asJump());
+            if (outcome == BRANCH_NOT_TAKEN)
+            {
+                removeInstruction(node);
+            }
+            else if (outcome == BRANCH_TAKEN)
+            {
+                if (inst->op != OP_JMP)
+                {
+                    Jump *jump = new(func->memCtx) Jump(OP_JMP, inst->asJump()->target, NULL, NULL);
+                    jump->block = block;
+                    func->instructionList.setCurrent(node);
+                    func->instructionList.insertBefore(jump, NULL);
+                    removeInstruction(node);
+                }
+                stopped = true;
+            }
+        }
+    }
+
+    // removes the predecessors and phi operands for edges that are never taken
+    void removeDeadEdges(BasicBlock *block)
+    {
+        for (Node<Instruction*> *node = block->start->getNext(); node->value->isPhi(); node = node->getNext())
+        {
+            Phi *phi = node->value->asPhi();
+            int i = 0, kept = 0;
+            foreach_list(phi->operands, RValue*, iter)
+            {
+                BasicBlock *source = phi->sourceBlocks[i++];
+                if (executableBlocks.test(block->id) && isEdgeExecutable(source, block))
+                {
+                    phi->sourceBlocks[kept++] = source;
+                }
+                else
+                {
+                    iter.value()->unref(phi);
+                    iter.remove();
+                }
+            }
+        }
+
+        int i = firstEdge[block->id];
+        foreach_list(block->preds, BasicBlock*, iter)
+        {
+            if (!executableEdges[i++])
+                iter.remove();
+        }
+    }
+
+public:
+    ConstantPropagation(SSABuilder *func, int numValues)
+        : func(func), executableBlocks(func->basicBlockList.size(), true)
+    {
+        values = (LatticeValue*) calloc(numValues, sizeof(LatticeValue)); // all UNKNOWN
+        firstEdge = (int*) malloc(func->basicBlockList.size() * sizeof(int));
+        int numEdges = 0;
+        foreach_list(func->basicBlockList, BasicBlock*, iter)
+        {
+            firstEdge[iter.value()->id] = numEdges;
+            numEdges += iter.value()->preds.size();
+        }
+        executableEdges = (bool*) calloc(numEdges + 1, sizeof(bool));
+    }
+
+    ~ConstantPropagation()
+    {
+        free(values);
+        free(firstEdge);
+        free(executableEdges);
+    }
+
+    void solve()
+    {
+        BasicBlock *startBlock = func->basicBlockList.firstNode()->value;
+        executableBlocks.set(startBlock->id);
+        blockWorklist.append(startBlock);
+        while (blockWorklist.size() > 0 || valueWorklist.size() > 0)
+        {
+            while (blockWorklist.size() > 0)
+            {
+                BasicBlock *block = blockWorklist.removeLast();
+                for (Node<Instruction*> *node = block->start->getNext(); node != block->end; node = node->getNext())
+                {
+                    if (node->value->isExpression())
+                        visitExpression(node->value->asExpression());
+                }
+                visitBranches(block);
+            }
+
+            while (valueWorklist.size() > 0 && blockWorklist.size() == 0)
+            {
+                Temporary *temp = valueWorklist.removeLast();
+                foreach_list(temp->users, Instruction*, iter)
+                {
+                    Instruction *user = iter.value();
+                    if (!executableBlocks.test(user->block->id)) continue;
+                    if (user->isJump())
+                        visitBranches(user->block);
+                    else if (user->isExpression())
+                        visitExpression(user->asExpression());
+                }
+            }
+        }
+    }
+
+    void rewrite()
+    {
+        foreach_list(func->basicBlockList, BasicBlock*, iter)
+        {
+            if (executableBlocks.test(iter.value()->id))
+                rewriteBranches(iter.value());
+        }
+        foreach_list(func->basicBlockList, BasicBlock*, iter)
+        {
+            removeDeadEdges(iter.value());
+        }
+
+        foreach_list(func->instructionList, Instruction*, iter)
+        {
+            Instruction *inst = iter.value();
+            if (inst->op == OP_BB_START || inst->op == OP_NOOP) continue;
+            if (!executableBlocks.test(inst->block->id))
+            {
+                // nothing in a block that's never reached is needed
+                unrefOperands(inst);
+                iter.remove();
+                continue;
+            }
+            if (!inst->isExpression()) continue;
+
+            Expression *expr = inst->asExpression();
+            RValue *replacement = NULL;
+            LatticeValue value = values[expr->value()->id];
+            if (value.state == CONSTANT)
+            {
+                replacement = value.constant;
+            }
+            else if (expr->isPhi())
+            {
+                // a phi left with only one distinct operand isn't needed
+                foreach_list(expr->operands, RValue*, srcIter)
+                {
+                    RValue *src = srcIter.value();
+                    if (src == expr->value() || src == replacement) continue;
+                    if (replacement)
+                    {
+                        replacement = NULL;
+                        break;
+                    }
+                    replacement = src;
+                }
+            }
+            if (replacement)
+            {
+                expr->value()->replaceBy(replacement);
+                unrefOperands(expr);
+                iter.remove();
+            }
+        }
+
+        // a jump over nothing but removed blocks can just fall through instead
+        foreach_list(func->basicBlockList, BasicBlock*, iter)
+        {
+            BasicBlock *block = iter.value();
+            Node<Instruction*> *last = block->end->getPrevious();
+            if (last->value->op != OP_JMP) continue;
+            BasicBlock *target = last->value->asJump()->target;
+            Node<Instruction*> *node = block->end->getNext();
+            while (node && node != target->start && node->value->op == OP_BB_START &&
+                   node->value->block->preds.isEmpty() && node->getNext() == node->value->block->end)
+            {
+                node = node->getNext()->getNext();
+            }
+            if (node == target->start)
+                removeInstruction(last);
+        }
+    }
+};
+
+void SSABuilder::propagateConstants()
+{
+    ConstantPropagation propagation(this, nextValueId);
+    propagation.solve();
+    propagation.rewrite();
+}
+
+// Copies the blocks and instructions of one function into another. Values and blocks of the source function are
+// mapped to their copies by id.
+class FunctionCopier
+{
+private:
+    SSABuilder *from, *to;
+    RValue **params; // what each parameter of the source function is replaced by
+    BasicBlock *returnTarget; // if not NULL, returns are copied as jumps to this block
+    InlineSite *site; // the site that the source function's own code becomes part of
+    Temporary **values;
+    BasicBlock **blocks;
+    ArrayList<InlineSite*> siteOriginals, siteCopies;
+
+    RValue *mapValue(RValue *value);
+    InlineSite *mapSite(InlineSite *original);
+    void copyLoops(List<Loop*> *loops, Loop *parent);
+public:
+    // the returns that were replaced by jumps, and the value each one returned
+    ArrayList<Jump*> returnJumps;
+    ArrayList<RValue*> returnValues;
+
+    FunctionCopier(SSABuilder *from, SSABuilder *to, RValue **params, BasicBlock *returnTarget, InlineSite *site);
+    ~FunctionCopier();
+    // copies the source function's blocks in after the given block, making them part of the given loop
+    void copyBody(BasicBlock *after, Loop *loop);
+    inline BasicBlock *copyOf(BasicBlock *block) { return blocks[block->id]; }
+};
+
+FunctionCopier::FunctionCopier(SSABuilder *from, SSABuilder *to, RValue **params, BasicBlock *returnTarget,
+                               InlineSite *site)
+    : from(from), to(to), params(params), returnTarget(returnTarget), site(site)
+{
+    values = new Temporary*[from->nextValueId];
+    blocks = new BasicBlock*[from->nextBBId];
+}
+
+FunctionCopier::~FunctionCopier()
+{
+    delete[] values;
+    delete[] blocks;
+}
+
+RValue *FunctionCopier::mapValue(RValue *value)
+{
+    if (value->isTemporary())
+    {
+        return values[value->asTemporary()->id];
+    }
+    else if (value->isParam())
+    {
+        return params[value->asParam()->index];
+    }
+    else if (value->isConstant())
+    {
+        // each function gives up its references to its string constants once it's linked
+        ScriptVariant constValue = value->asConstant()->constValue;
+        if (constValue.vt == VT_STR)
+            StrCache_Ref(constValue.strVal);
+        return to->addConstant(constValue);
+    }
+    else if (value->isGlobalVarRef())
+    {
+        return new(to->memCtx) GlobalVarRef(value->asGlobalVarRef()->id);
+    }
+    else
+    {
+        return new(to->memCtx) Undef();
+    }
+}
+
+// Returns the site that code copied from a site in the source function becomes part of. Sites are copied along with
+// the code, since the source function's memory can be freed before the copy's.
+InlineSite *FunctionCopier::mapSite(InlineSite *original)
+{
+    if (!original) return site;
+    for (uint32_t i = 0; i < siteOriginals.size(); i++)
+    {
+        if (siteOriginals.get(i) == original)
+            return siteCopies.get(i);
+    }
+
+    InlineSite *copy = ralloc(to->memCtx, InlineSite);
+    copy->function = original->function;
+    copy->caller = mapSite(original->caller);
+    siteOriginals.append(original);
+    siteCopies.append(copy);
+    return copy;
+}
+
+void FunctionCopier::copyLoops(List<Loop*> *loops, Loop *parent)
+{
+    foreach_plist(loops, Loop*, iter)
+    {
+        Loop *loop = iter.value();
+        Loop *copy = new(to->memCtx) Loop(copyOf(loop->header), parent);
+        if (parent)
+            parent->children.insertAfter(copy);
+        else
+            to->loops.insertAfter(copy);
+        foreach_list(loop->nodes, BasicBlock*, blockIter)
+        {
+            BasicBlock *block = copyOf(blockIter.value());
+            block->loop = copy;
+            copy->nodes.insertAfter(block);
+        }
+        copyLoops(&loop->children, copy);
+    }
+}
+
+void FunctionCopier::copyBody(BasicBlock *after, Loop *loop)
+{
+    // create the blocks in the same order
+    foreach_list(from->instructionList, Instruction*, iter)
+    {
+        Instruction *inst = iter.value();
+        if (inst->op != OP_BB_START) continue;
+        BasicBlock *block = to->createBBAfter(after);
+        block->isSealed = true;
+        block->hasAssignment = inst->block->hasAssignment;
+        blocks[inst->block->id] = block;
+        after = block;
+    }
+    foreach_list(from->basicBlockList, BasicBlock*, iter)
+    {
+        BasicBlock *block = iter.value();
+        foreach_list(block->preds, BasicBlock*, predIter)
+        {
+            copyOf(block)->addPred(copyOf(predIter.value()));
+        }
+    }
+
+    // copy the loop-nesting forest under the given loop
+    copyLoops(&from->loops, loop);
+    foreach_list(from->basicBlockList, BasicBlock*, iter)
+    {
+        BasicBlock *block = iter.value();
+        if (block->loop) continue;
+        copyOf(block)->loop = loop;
+        if (loop) loop->nodes.insertAfter(copyOf(block));
+    }
+
+    // Copy the instructions without their operands first, so that every value has a copy by the time it's used. Phis
+    // can use values that are defined after them.
+    ArrayList<Instruction*> originals, copies;
+    foreach_list(from->instructionList, Instruction*, iter)
+    {
+        Instruction *inst = iter.value();
+        if (inst->op == OP_BB_START || inst->op == OP_NOOP) continue;
+
+        BasicBlock *block = copyOf(inst->block);
+        Instruction *copy;
+        if (inst->isPhi())
+        {
+            Phi *phi = inst->asPhi();
+            Phi *phiCopy = new(to->memCtx) Phi(to->valueId());
+            phiCopy->sourceBlocks = ralloc_array(to->memCtx, BasicBlock*, phi->operands.size());
+            for (int i = 0; i < phi->operands.size(); i++)
+            {
+                phiCopy->sourceBlocks[i] = copyOf(phi->sourceBlocks[i]);
+            }
+            copy = phiCopy;
+        }
+        else if (inst->isFunctionCall())
+        {
+            FunctionCall *call = inst->asFunctionCall();
+            FunctionCall *callCopy = new(to->memCtx) FunctionCall(call->functionName, to->valueId());
+            callCopy->op = call->op;
+            if (call->op == OP_CALL)
+                callCopy->functionRef = call->functionRef;
+            else
+                callCopy->builtinRef = call->builtinRef;
+            copy = callCopy;
+        }
+        else if (inst->op == OP_CHECK_INT || inst->op == OP_CHECK_DECIMAL)
+        {
+            TypeCheck *check = inst->asTypeCheck();
+            copy = new(to->memCtx) TypeCheck(check->op, to->valueId(), NULL,
+                                             check->fileName ? ralloc_strdup(to->memCtx, check->fileName) : NULL,
+                                             check->line);
+        }
+        else if (inst->isExpression())
+        {
+            copy = new(to->memCtx) Expression(inst->op, to->valueId());
+        }
+        else if (inst->isJump())
+        {
+            copy = new(to->memCtx) Jump(inst->op, copyOf(inst->asJump()->target), NULL, NULL);
+        }
+        else if (inst->op == OP_RETURN && returnTarget)
+        {
+            Jump *jump = new(to->memCtx) Jump(OP_JMP, returnTarget, NULL, NULL);
+            returnTarget->addPred(block);
+            returnJumps.append(jump);
+            copy = jump;
+        }
+        else if (inst->op == OP_EXPORT)
+        {
+            copy = new(to->memCtx) Export(new(to->memCtx) GlobalVarRef(inst->asExport()->dst->id));
+        }
+        else
+        {
+            copy = new(to->memCtx) Instruction(inst->op);
+        }
+
+        if (inst->isExpression())
+            values[inst->asExpression()->dst->id] = copy->asExpression()->dst;
+        copy->inlineSite = mapSite(inst->inlineSite);
+        to->insertInstruction(copy, block);
+        originals.append(inst);
+        copies.append(copy);
+    }
+
+    for (uint32_t i = 0; i < originals.size(); i++)
+    {
+        Instruction *inst = originals.get(i), *copy = copies.get(i);
+        if (inst->op == OP_RETURN && returnTarget)
+        {
+            ScriptVariant null = {{.ptrVal = NULL}, VT_EMPTY};
+            returnValues.append(inst->operands.isEmpty() ? to->addConstant(null) : mapValue(inst->src(0)));
+            continue;
+        }
+        foreach_list(inst->operands, RValue*, iter)
+        {
+            copy->appendOperand(mapValue(iter.value()));
+        }
+    }
+}
+
+// true if the instruction can allocate an object, list or string
+static bool mayAllocate(Instruction *inst)
+{
+    switch (inst->op)
+    {
+        case OP_MKOBJECT:
+        case OP_MKLIST:
+        case OP_CONCAT:
+        case OP_CALL_BUILTIN:
+        case OP_CALL_METHOD:
+            return true;
+        case OP_ADD:
+            return !isNumber(inst->src(0)) || !isNumber(inst->src(1));
+        default:
+            return false;
+    }
+}
+
+bool SSABuilder::isInlinable(bool fromOtherScript)
+{
+    // the copy of the start block is entered from the caller, so nothing else can jump to it
+    if (instructionList.isEmpty() || !instructionList.firstNode()->value->block->preds.isEmpty())
+        return false;
+
+    int size = 0;
+    bool hasReturn = false, blockEnded = false;
+    foreach_list(instructionList, Instruction*, iter)
+    {
+        Instruction *inst = iter.value();
+        if (inst->op == OP_BB_START)
+        {
+            blockEnded = false;
+            continue;
+        }
+        else if (inst->op == OP_NOOP)
+        {
+            continue;
+        }
+
+        // don't copy unreachable code after a jump or return in the same block
+        if (blockEnded || inst->op == OP_CALL || ++size > INLINE_MAX_INSTRUCTIONS)
+            return false;
+        // An allocation whose result is unused in the caller would be removed along with the rest of the dead code,
+        // so the allocation profiler would no longer see it.
+        if (mayAllocate(inst))
+            return false;
+        if (fromOtherScript && (inst->op == OP_GET_GLOBAL || inst->op == OP_EXPORT))
+            return false;
+        if (inst->op == OP_RETURN)
+            hasReturn = true;
+        if (inst->op == OP_JMP || inst->op == OP_RETURN)
+            blockEnded = true;
+    }
+
+    // the last block can't fall through into the code after the copy
+    return hasReturn && blockEnded;
+}
+
+SSABuilder *SSABuilder::clone(void *memCtx)
+{
+    SSABuilder *copy = new(memCtx) SSABuilder(memCtx, functionName);
+    copy->paramCount = paramCount;
+    RValue **params = new RValue*[paramCount];
+    for (int i = 0; i < paramCount; i++)
+    {
+        params[i] = new(memCtx) Param(i);
+    }
+
+    FunctionCopier copier(this, copy, params, NULL, NULL);
+    copier.copyBody(NULL, NULL);
+    delete[] params;
+    return copy;
+}
+
+static Loop *loopWithHeader(List<Loop*> *loops, BasicBlock *header)
+{
+    foreach_plist(loops, Loop*, iter)
+    {
+        Loop *loop = iter.value();
+        if (loop->header == header) return loop;
+        Loop *inner = loopWithHeader(&loop->children, header);
+        if (inner) return inner;
+    }
+    return NULL;
+}
+
+// The call's block is split in two after the call, and the copy of the callee goes in between. The copies of the
+// callee's returns jump to the second half, where a phi picks the return value if there is more than one.
+void SSABuilder::inlineCall(FunctionCall *call, SSABuilder *callee)
+{
+    BasicBlock *block = call->block;
+    Loop *loop = loopWithHeader(&loops, block);
+    if (!loop) loop = block->loop;
+
+    BasicBlock *rest = createBBAfter(block);
+    rest->isSealed = true;
+    rest->hasAssignment = block->hasAssignment;
+    rest->loop = loop;
+    if (loop) loop->nodes.insertAfter(rest);
+
+    // the successors of the block now come after the second half
+    foreach_list(basicBlockList, BasicBlock*, iter)
+    {
+        foreach_list(iter.value()->preds, BasicBlock*, predIter)
+        {
+            if (predIter.value() == block)
+                predIter.update(rest);
+        }
+    }
+    foreach_list(instructionList, Instruction*, iter)
+    {
+        if (!iter.value()->isPhi()) continue;
+        Phi *phi = iter.value()->asPhi();
+        for (int i = 0; i < phi->operands.size(); i++)
+        {
+            if (phi->sourceBlocks[i] == block)
+                phi->sourceBlocks[i] = rest;
+        }
+    }
+
+    // move the instructions after the call to the second half
+    Node<Instruction*> *callNode = block->start;
+    while (callNode->value != call)
+        callNode = callNode->getNext();
+    for (Node<Instruction*> *node = callNode->getNext(); node != block->end;)
+    {
+        Node<Instruction*> *next = node->getNext();
+        Instruction *inst = node->value;
+        instructionList.removeNode(node);
+        insertInstruction(inst, rest);
+        node = next;
+    }
+
+    RValue **args = new RValue*[callee->paramCount];
+    int i = 0;
+    foreach_list(call->operands, RValue*, iter)
+    {
+        args[i++] = iter.value();
+    }
+
+    // the copy is part of the inlined function, not this one, as far as backtraces and profiles are concerned
+    InlineSite *site = ralloc(memCtx, InlineSite);
+    site->function = call->functionRef;
+    site->caller = call->inlineSite;
+    FunctionCopier copier(callee, this, args, rest, site);
+    copier.copyBody(block, loop);
+    copier.copyOf(callee->instructionList.firstNode()->value->block)->addPred(block);
+    delete[] args;
+
+    RValue *result;
+    if (copier.returnValues.size() == 1)
+    {
+        result = copier.returnValues.get(0);
+    }
+    else
+    {
+        Phi *phi = new(memCtx) Phi(valueId());
+        phi->sourceBlocks = ralloc_array(memCtx, BasicBlock*, copier.returnValues.size());
+        for (uint32_t i = 0; i < copier.returnValues.size(); i++)
+        {
+            phi->appendOperand(copier.returnValues.get(i));
+            phi->sourceBlocks[i] = copier.returnJumps.get(i)->block;
+        }
+        insertInstructionAtStart(phi, rest);
+        result = phi->value();
+    }
+
+    call->dst->replaceBy(result);
+    foreach_list(call->operands, RValue*, iter)
+    {
+        iter.value()->unref(call);
+    }
+    instructionList.removeNode(callNode);
+}
+
+// dead code elimination pass
+void SSABuilder::removeDeadCode()
+{
+    instructionList.gotoFirst();
+    foreach_list(instructionList, Instruction *, iter)
+    {
+        Instruction *inst = iter.value();
+        if (inst->isExpression())
+        {
+            Expression *expr = inst->asExpression();
+            if (expr->isDead())
+            {
+                // RValue *undefined = new(memCtx) Undef();
+                foreach_list(expr->operands, RValue*, iter)
+                {
+                    iter.value()->unref(expr);
+                }
+                iter.remove();
+                continue;
+            }
+        }
+    }
+}
+
+static inline ValueType meetTypes(ValueType a, ValueType b)
+{
+    if (a == TYPE_NONE) return b;
+    if (b == TYPE_NONE || a == b) return a;
+    return TYPE_UNKNOWN;
+}
+
+static ValueType typeOfVariant(VARTYPE vt)
+{
+    switch (vt)
+    {
+        case VT_INTEGER: return TYPE_INTEGER;
+        case VT_DECIMAL: return TYPE_DECIMAL;
+        case VT_STR:     return TYPE_STRING;
+        case VT_OBJECT:  return TYPE_OBJECT;
+        case VT_LIST:    return TYPE_LIST;
+        default:         return TYPE_UNKNOWN;
+    }
+}
+
+static inline bool isNumberType(ValueType type)
+{
+    return type == TYPE_INTEGER || type == TYPE_DECIMAL;
+}
+
+// type of an operand, using the types inferred so far for temporaries
+static inline ValueType operandType(Instruction *inst, int index, ValueType *types)
+{
+    RValue *value = inst->src(index);
+    return value->isTemporary() ? types[value->asTemporary()->id] : value->knownType();
+}
+
+// Returns the type of an expression's result from the types of its operands, or TYPE_NONE if it depends on an operand
+// whose type isn't known yet. An operation that fails stops the script, so only the types of results that it can
+// produce without failing matter.
+static ValueType resultType(Expression *expr, ValueType *types)
+{
+    ValueType src0 = TYPE_NONE, src1 = TYPE_NONE;
+    switch (expr->op)
+    {
+        // these always give an integer or fail
+        case OP_BOOL_NOT:
+        case OP_BOOL:
+        case OP_BIT_NOT:
+        case OP_INC:
+        case OP_DEC:
+        case OP_BIT_OR:
+        case OP_XOR:
+        case OP_BIT_AND:
+        case OP_EQ:
+        case OP_NE:
+        case OP_LT:
+        case OP_GT:
+        case OP_GE:
+        case OP_LE:
+        case OP_SHL:
+        case OP_SHR:
+        case OP_REM:
+        case OP_CHECK_INT:
+            return TYPE_INTEGER;
+        case OP_CHECK_DECIMAL:
+            return TYPE_DECIMAL;
+        case OP_CONCAT:
+            return TYPE_STRING;
+        case OP_MKOBJECT:
+            return TYPE_OBJECT;
+        case OP_MKLIST:
+            return TYPE_LIST;
+        case OP_CALL_BUILTIN:
+            return typeOfVariant(getBuiltinResultType(expr->asFunctionCall()->builtinRef));
+        case OP_CALL_METHOD:
+            return typeOfVariant(getMethodResultType(expr->asFunctionCall()->builtinRef));
+        case OP_MOV:
+            return operandType(expr, 0, types);
+        case OP_PHI:
+        {
+            ValueType type = TYPE_NONE;
+            for (int i = 0; i < expr->operands.size(); i++)
+            {
+                type = meetTypes(type, operandType(expr, i, types));
+            }
+            return type;
+        }
+        case OP_NEG:
+            src0 = operandType(expr, 0, types);
+            if (src0 == TYPE_NONE) return TYPE_NONE;
+            return isNumberType(src0) ? src0 : TYPE_UNKNOWN;
+        case OP_ADD:
+            src0 = operandType(expr, 0, types);
+            src1 = operandType(expr, 1, types);
+            // adding anything to a string concatenates them
+            if (src0 == TYPE_STRING || src1 == TYPE_STRING) return TYPE_STRING;
+            if (src0 == TYPE_LIST && src1 == TYPE_LIST) return TYPE_LIST;
+            // fall through
+        case OP_SUB:
+        case OP_MUL:
+        case OP_DIV:
+            if (src0 == TYPE_NONE) src0 = operandType(expr, 0, types);
+            if (src1 == TYPE_NONE) src1 = operandType(expr, 1, types);
+            if (src0 == TYPE_NONE || src1 == TYPE_NONE) return TYPE_NONE;
+            if (src0 == TYPE_INTEGER && src1 == TYPE_INTEGER) return TYPE_INTEGER;
+            if (isNumberType(src0) && isNumberType(src1)) return TYPE_DECIMAL;
+            return TYPE_UNKNOWN;
+        default:
+            return TYPE_UNKNOWN;
+    }
+}
+
+// Optimistic analysis: every temporary starts with no type and moves down the lattice (no type, then one type, then
+// any type) until nothing changes, so that a loop variable seeded with an integer and only incremented stays an integer.
+void SSABuilder::inferTypes()
+{
+    ValueType *types = new ValueType[nextValueId];
+    for (int i = 0; i < nextValueId; i++)
+    {
+        types[i] = TYPE_NONE;
+    }
+
+    bool changed;
+    do
+    {
+        changed = false;
+        foreach_list(instructionList, Instruction*, iter)
+        {
+            if (!iter.value()->isExpression()) continue;
+            Expression *expr = iter.value()->asExpression();
+            int id = expr->value()->id;
+            ValueType type = meetTypes(types[id], resultType(expr, types));
+            if (type != types[id])
+            {
+                types[id] = type;
+                changed = true;
+            }
+        }
+    } while (changed);
+
+    foreach_list(instructionList, Instruction*, iter)
+    {
+        if (!iter.value()->isExpression()) continue;
+        Temporary *value = iter.value()->asExpression()->value();
+        value->type = (types[value->id] == TYPE_NONE) ? TYPE_UNKNOWN : types[value->id];
+    }
+    delete[] types;
+}
+
+static const char *typeName(ValueType type)
+{
+    switch (type)
+    {
+        case TYPE_INTEGER: return "an integer";
+        case TYPE_DECIMAL: return "a decimal";
+        case TYPE_STRING:  return "a string";
+        case TYPE_OBJECT:  return "an object";
+        case TYPE_LIST:    return "a list";
+        default:           return "a value of unknown type";
+    }
+}
+
+bool SSABuilder::checkDeclaredTypes()
+{
+    bool ok = true;
+    foreach_list(instructionList, Instruction*, iter)
+    {
+        Instruction *inst = iter.value();
+        if (inst->op != OP_CHECK_INT && inst->op != OP_CHECK_DECIMAL) continue;
+
+        TypeCheck *check = inst->asTypeCheck();
+        RValue *src = check->src(0);
+        ValueType type = src->knownType();
+        if (type == TYPE_UNKNOWN || (type == TYPE_INTEGER && check->op == OP_CHECK_DECIMAL))
+        {
+            // the check has to be done when the script runs
+            continue;
+        }
+        else if (type != (check->op == OP_CHECK_INT ? TYPE_INTEGER : TYPE_DECIMAL))
+        {
+            printf("Script error: %s, line %d: %s is assigned to a variable declared '%s'\n",
+                   check->fileName, check->line, typeName(type), check->op == OP_CHECK_INT ? "int" : "float");
+            ok = false;
+            continue;
+        }
+
+        check->value()->replaceBy(src);
+        src->unref(check);
+        iter.remove();
+    }
+    return ok;
+}
+
+// a phi in a loop header that starts at 'init' before the loop and changes by 'step' on every iteration
+struct InductionVariable {
+    Phi *phi;
+    RValue *init;
+    Expression *next;
+    int32_t step;
+};
+
+static inline bool isIntegerConstant(RValue *value, int32_t *intVal)
+{
+    if (!value->isConstant() || value->asConstant()->constValue.vt != VT_INTEGER) return false;
+    *intVal = value->asConstant()->constValue.lVal;
+    return true;
+}
+
+static bool findInductionVariable(Phi *phi, BasicBlock *preheader, InductionVariable *iv)
+{
+    if (phi->operands.size() != 2 || phi->value()->type != TYPE_INTEGER) return false;
+    int outside = (phi->sourceBlocks[0] == preheader) ? 0 : 1;
+    if (phi->sourceBlocks[outside] != preheader || !phi->src(1 - outside)->isTemporary()) return false;
+
+    Temporary *self = phi->value();
+    Expression *next = phi->src(1 - outside)->asTemporary()->expr;
+    int32_t step;
+    if (next->op == OP_INC && next->src(0) == self)
+        step = 1;
+    else if (next->op == OP_DEC && next->src(0) == self)
+        step = -1;
+    else if (next->op == OP_ADD && next->src(0) == self && isIntegerConstant(next->src(1), &step)) {}
+    else if (next->op == OP_ADD && next->src(1) == self && isIntegerConstant(next->src(0), &step)) {}
+    else if (next->op == OP_SUB && next->src(0) == self && isIntegerConstant(next->src(1), &step) &&
+             step != INT32_MIN)
+        step = -step;
+    else
+        return false;
+
+    iv->phi = phi;
+    iv->init = phi->src(outside);
+    iv->next = next;
+    iv->step = step;
+    return true;
+}
+
+// inserts an instruction at the end of a block, in front of the jumps that end it
+static void insertBeforeJumps(Instruction *inst, BasicBlock *block, List<Instruction*> *instructionList)
+{
+    Node<Instruction*> *insertPoint = block->end->getPrevious();
+    while (insertPoint->value->isJump())
+        insertPoint = insertPoint->getPrevious();
+    instructionList->setCurrent(insertPoint);
+    instructionList->insertAfter(inst, NULL);
+    inst->block = block;
+}
+
+// a * b for integers a and b, folded if they're both constants and computed in front of the loop otherwise
+static RValue *multiplyBeforeLoop(RValue *a, RValue *b, BasicBlock *preheader, SSABuilder *func)
+{
+    int32_t intVal;
+    if (isIntegerConstant(a, &intVal) && intVal == 1) return b;
+    if (isIntegerConstant(b, &intVal) && intVal == 1) return a;
+    if (a->isConstant() && b->isConstant())
+    {
+        ScriptVariant product;
+        evaluateOp(OP_MUL, &product, &a->asConstant()->constValue, &b->asConstant()->constValue);
+        return func->addConstant(product);
+    }
+    Expression *mul = new(func->memCtx) Expression(OP_MUL, func->valueId(), a, b);
+    mul->value()->type = TYPE_INTEGER;
+    insertBeforeJumps(mul, preheader, &func->instructionList);
+    return mul->value();
+}
+
+/* Replaces i * k, where i is an induction variable and k is an integer that doesn't change in the loop, with a new
+   induction variable that starts at init * k and changes by step * k. Integer arithmetic wraps around, so the sums
+   are always equal to the products they replace. */
+static bool reduceMultiplications(InductionVariable *iv, BasicBlock *preheader, BasicBlock *latch, BitSet *inLoop,
+                                  SSABuilder *func)
+{
+    bool changed = false;
+    Temporary *counter = iv->phi->value();
+    Node<Instruction*> *nextNode = NULL;
+    foreach_list(counter->users, Instruction*, iter)
+    {
+        Instruction *inst = iter.value();
+        if (inst->op != OP_MUL || !inLoop->test(inst->block->id)) continue;
+        Expression *mul = inst->asExpression();
+        RValue *factor = (mul->src(0) == counter) ? mul->src(1) : mul->src(0);
+        if (factor == counter || factor->knownType() != TYPE_INTEGER) continue;
+        if (factor->isTemporary() && inLoop->test(factor->asTemporary()->expr->block->id)) continue;
+        if (!factor->isTemporary() && !factor->isConstant()) continue;
+
+        Phi *phi = new(func->memCtx) Phi(func->valueId());
+        phi->value()->type = TYPE_INTEGER;
+        phi->sourceBlocks = ralloc_array(func->memCtx, BasicBlock*, 2);
+        func->insertInstructionAtStart(phi, iv->phi->block);
+
+        ScriptVariant stepValue;
+        ScriptVariant_Init(&stepValue);
+        stepValue.vt = VT_INTEGER;
+        stepValue.lVal = iv->step;
+        RValue *increment = multiplyBeforeLoop(func->addConstant(stepValue), factor, preheader, func);
+        Expression *add = new(func->memCtx) Expression(OP_ADD, func->valueId(), phi->value(), increment);
+        add->value()->type = TYPE_INTEGER;
+
+        // put the addition in front of the induction variable's own step, so that the step stays last in the loop
+        if (!nextNode)
+        {
+            for (nextNode = latch->start; nextNode != latch->end && nextNode->value != iv->next;)
+                nextNode = nextNode->getNext();
+        }
+        if (nextNode != latch->end)
+        {
+            func->instructionList.setCurrent(nextNode);
+            func->instructionList.insertBefore(add, NULL);
+            add->block = latch;
         }
         else
         {
-            block->incompletePhis.gotoLast();
-            block->incompletePhis.insertAfter(phi, variable);
+            insertBeforeJumps(add, latch, &func->instructionList);
         }
-        val = phi->value();
-    }
-    else if (block->preds.size() == 1)
-    {
-        // Optimize the common case of one predecessor: No phi needed
-        val = readVariable(variable, block->preds.retrieve());
+
+        phi->appendOperand(multiplyBeforeLoop(iv->init, factor, preheader, func));
+        phi->sourceBlocks[0] = preheader;
+        phi->appendOperand(add->value());
+        phi->sourceBlocks[1] = latch;
+
+        /* A phi in the header can't take its value from the new phi on the back edge, because the new phi's own move
+           can overwrite it first. Phis that carry the product to the next iteration get a copy made in the latch. */
+        ArrayList<Phi*> headerPhis;
+        foreach_list(mul->value()->users, Instruction*, userIter)
+        {
+            Instruction *user = userIter.value();
+            if (user->isPhi() && user->block == iv->phi->block)
+                headerPhis.append(user->asPhi());
+        }
+        Expression *copy = NULL;
+        for (uint32_t i = 0; i < headerPhis.size(); i++)
+        {
+            Phi *user = headerPhis.get(i);
+            for (int j = 0; j < user->operands.size(); j++)
+            {
+                if (user->sourceBlocks[j] != latch || user->src(j) != mul->value()) continue;
+                if (!copy)
+                {
+                    copy = new(func->memCtx) Expression(OP_MOV, func->valueId(), mul->value());
+                    copy->value()->type = TYPE_INTEGER;
+                    insertBeforeJumps(copy, latch, &func->instructionList);
+                }
+                user->setSrc(j, copy->value());
+            }
+        }
+
+        // the multiplication is now dead, and removed with the rest of the dead code
+        mul->value()->replaceBy(phi->value());
+        changed = true;
     }
-    else
+    return changed;
+}
+
+// true if the induction variable can never be negative: it counts up by 1 from a value that isn't negative, and the
+// loop ends before it goes past an integer bound, so it can't overflow
+static bool isNonNegativeCounter(InductionVariable *iv, BitSet *inLoop, ArrayList<Temporary*> *nonNegative)
+{
+    if (iv->step != 1) return false;
+    Node<Instruction*> *last = iv->phi->block->end->getPrevious();
+    if (last->value->op != OP_BRANCH_FALSE || inLoop->test(last->value->asJump()->target->id)) return false;
+    RValue *test = last->value->src(0);
+    if (!test->isTemporary()) return false;
+    Expression *compare = test->asTemporary()->expr;
+    if (compare->op != OP_LT || compare->src(0) != iv->phi->value() ||
+        compare->src(1)->knownType() != TYPE_INTEGER)
+        return false;
+
+    int32_t intVal;
+    if (isIntegerConstant(iv->init, &intVal)) return intVal >= 0;
+    for (uint32_t i = 0; i < nonNegative->size(); i++)
     {
-        // Break potential cycles with operandless phi
-        Phi *phi = new(memCtx) Phi(valueId());
-        insertInstructionAtStart(phi, block);
-        writeVariable(variable, block, phi->value());
-        val = addPhiOperands(variable, block, phi);
+        if (nonNegative->get(i) == iv->init) return true;
     }
-    writeVariable(variable, block, val);
-    return val;
+    return false;
 }
 
-RValue *SSABuilder::addPhiOperands(const char *variable, BasicBlock *block, Phi *phi)
+// Finds the block that enters a loop and the block that goes back to its header, if there's only one of each and the
+// block entering the loop leads nowhere else. Returns false otherwise.
+static bool findLoopEdges(Loop *loop, BitSet *inLoop, BasicBlock **preheader, BasicBlock **latch)
 {
-    // Determine operands from predecessors
-    phi->sourceBlocks = ralloc_array(memCtx, BasicBlock*, block->preds.size());
-    int i = 0;
-    foreach_list(block->preds, BasicBlock*, iter)
+    *preheader = *latch = NULL;
+    foreach_list(loop->header->preds, BasicBlock*, iter)
     {
         BasicBlock *pred = iter.value();
-        RValue *operand = readVariable(variable, pred);
-        phi->appendOperand(operand);
-        phi->sourceBlocks[i++] = pred;
+        BasicBlock **slot = inLoop->test(pred->id) ? latch : preheader;
+        if (*slot) return false;
+        *slot = pred;
     }
-    return tryRemoveTrivialPhi(phi);
+    return *preheader && *latch && (*preheader)->succs.size() == 1;
 }
 
-RValue *SSABuilder::tryRemoveTrivialPhi(Phi *phi)
+// finds the induction variables among the phis at the start of a loop header
+static void findInductionVariables(BasicBlock *header, BasicBlock *preheader, ArrayList<InductionVariable> *ivs)
 {
-    // printf("tryRemoveTrivialPhi: "); phi->print();
-    RValue *same = NULL;
-    foreach_list(phi->operands, RValue*, iter)
-    {
-        RValue *op = iter.value();
-        if (op == same || op == phi->value())
-            continue; // Unique value or self−reference
-        if (same != NULL) {
-            // printf("not trivial: "); same->printDst(); printf(" and "); op->printDst(); printf("\n");
-            return phi->value(); // The phi merges at least two values: not trivial
-        }
-        same = op;
-    }
-    if (same == NULL)
+    for (Node<Instruction*> *node = header->start->getNext(); node->value->op == OP_PHI; node = node->getNext())
     {
-        same = new(memCtx) Undef(); // The phi is unreachable or in the start block
+        InductionVariable iv;
+        if (findInductionVariable((Phi*) node->value, preheader, &iv))
+            ivs->append(iv);
     }
-    // printf("trivial phi; replace with "); same->printDst(); printf("\n");
-    // remember all users except the phi itself
-    List<Phi*> phiUsers;
-    foreach_list(phi->value()->users, Instruction*, iter)
+}
+
+static void reduceStrengthInLoop(Loop *loop, SSABuilder *func, ArrayList<Temporary*> *nonNegative, bool *changed)
+{
+    // outer loops first, so that inner loops can count from the outer loops' counters
+    BasicBlock *header = loop->header;
+    if (header->domPreorder >= 0)
     {
-        Instruction *use = iter.value();
-        if (use->isPhi() && use != phi)
+        BitSet inLoop(func->basicBlockList.size(), true);
+        collectLoopBlocks(loop, &inLoop);
+
+        BasicBlock *preheader, *latch;
+        if (findLoopEdges(loop, &inLoop, &preheader, &latch))
         {
-            phiUsers.insertAfter(use->asPhi(), NULL);
+            ArrayList<InductionVariable> ivs;
+            findInductionVariables(header, preheader, &ivs);
+
+            for (uint32_t i = 0; i < ivs.size(); i++)
+            {
+                InductionVariable *iv = ivs.getPtr(i);
+
+                // A second counter with the same start and step always has the same value as an earlier one, so it
+                // can be replaced by it.
+                bool redundant = false;
+                for (uint32_t j = 0; j < i && !redundant; j++)
+                {
+                    InductionVariable *other = ivs.getPtr(j);
+                    if (other->phi && other->step == iv->step && sameValue(other->init, iv->init))
+                    {
+                        iv->phi->value()->replaceBy(other->phi->value());
+                        iv->phi = NULL;
+                        redundant = *changed = true;
+                    }
+                }
+                if (redundant) continue;
+
+                if (reduceMultiplications(iv, preheader, latch, &inLoop, func))
+                    *changed = true;
+                if (isNonNegativeCounter(iv, &inLoop, nonNegative))
+                    nonNegative->append(iv->phi->value());
+            }
         }
     }
-    phi->value()->replaceBy(same); // Reroute all uses of phi to same and remove phi
-    foreach_list(currentDef, RValue*, iter)
-    {
-        // replace variable value with same
-        if (iter.value() == phi->value())
-            iter.update(same);
-    }
-    
-    // Try to recursively remove all phi users, which might have become trivial
-    foreach_list(phiUsers, Phi*, iter)
+
+    foreach_list(loop->children, Loop*, iter)
     {
-        tryRemoveTrivialPhi(iter.value());
+        reduceStrengthInLoop(iter.value(), func, nonNegative, changed);
     }
-    return same;
 }
 
-void SSABuilder::sealBlock(BasicBlock *block)
+// true if the value is an integer that is never negative
+static bool isNonNegative(RValue *value, ArrayList<Temporary*> *nonNegativeCounters, int depth = 0)
 {
-    foreach_list(block->incompletePhis, Phi*, iter)
+    int32_t intVal;
+    if (isIntegerConstant(value, &intVal)) return intVal >= 0;
+    if (!value->isTemporary() || value->knownType() != TYPE_INTEGER || depth > 8) return false;
+
+    Expression *expr = value->asTemporary()->expr;
+    switch (expr->op)
     {
-        addPhiOperands(iter.name(), block, iter.value());
+        case OP_BOOL_NOT:
+        case OP_BOOL:
+        case OP_EQ:
+        case OP_NE:
+        case OP_LT:
+        case OP_GT:
+        case OP_GE:
+        case OP_LE:
+            return true;
+        case OP_BIT_AND:
+            return isNonNegative(expr->src(0), nonNegativeCounters, depth + 1) ||
+                   isNonNegative(expr->src(1), nonNegativeCounters, depth + 1);
+        case OP_SHR: // shifts in zeros
+        case OP_REM:
+        case OP_MOV:
+        case OP_CHECK_INT:
+            return isNonNegative(expr->src(0), nonNegativeCounters, depth + 1);
+        case OP_DIV:
+            return isNonNegative(expr->src(0), nonNegativeCounters, depth + 1) &&
+                   isIntegerConstant(expr->src(1), &intVal) && intVal > 0;
+        case OP_PHI:
+            for (uint32_t i = 0; i < nonNegativeCounters->size(); i++)
+            {
+                if (nonNegativeCounters->get(i) == value) return true;
+            }
+            foreach_list(expr->operands, RValue*, iter)
+            {
+                if (!isNonNegative(iter.value(), nonNegativeCounters, depth + 1)) return false;
+            }
+            return true;
+        default:
+            return false;
     }
-    block->isSealed = true; // sealedBlocks.add(block)
 }
 
-// create BB and insert after the given block
-BasicBlock *SSABuilder::createBBAfter(BasicBlock *existingBB)
+// returns n if value is 2^n, or -1
+static int log2OfPowerOfTwo(int32_t value)
 {
-    BasicBlock *newBB = new(memCtx) BasicBlock(nextBBId++);
-    basicBlockList.gotoLast();
-    basicBlockList.insertAfter(newBB, NULL);
-    if (existingBB) instructionList.setCurrent(existingBB->end);
-
-    // insert start/end instructions into instruction list
-    Instruction *start = new(memCtx) BlockDecl(newBB), *end = new(memCtx) NoOp();
-    instructionList.insertAfter(start, NULL);
-    newBB->start = instructionList.currentNode();
-    instructionList.insertAfter(end, NULL);
-    newBB->end = instructionList.currentNode();
-    return newBB;
+    if (value <= 0 || (value & (value - 1))) return -1;
+    int n = 0;
+    while (value > 1)
+    {
+        value >>= 1;
+        n++;
+    }
+    return n;
 }
 
-// insert instruction at end of basic block
-void SSABuilder::insertInstruction(Instruction *inst, BasicBlock *bb)
+/* Strength reduction, after type inference: multiplications of a loop's counter become additions that are carried
+   from one iteration to the next, counters that always equal another counter are merged into it, and integer division
+   and remainder of values that can't be negative by powers of 2 become shifts and masks. */
+void SSABuilder::reduceStrength()
 {
-    instructionList.setCurrent(bb->end);
-    instructionList.insertBefore(inst, NULL);
-    inst->block = bb;
-}
+    computeDominators();
+    ArrayList<Temporary*> nonNegativeCounters;
+    bool changed = false;
+    foreach_list(loops, Loop*, iter)
+    {
+        reduceStrengthInLoop(iter.value(), this, &nonNegativeCounters, &changed);
+    }
 
-// insert instruction at start of basic block
-void SSABuilder::insertInstructionAtStart(Instruction *inst, BasicBlock *bb)
-{
-    instructionList.setCurrent(bb->start);
-    instructionList.insertAfter(inst, NULL);
-    inst->block = bb;
-}
+    foreach_list(instructionList, Instruction*, iter)
+    {
+        Instruction *inst = iter.value();
+        int32_t divisor;
+        if ((inst->op != OP_DIV && inst->op != OP_REM) || !isIntegerConstant(inst->src(1), &divisor)) continue;
+        int shift = log2OfPowerOfTwo(divisor);
+        if (shift < 0 || !isNonNegative(inst->src(0), &nonNegativeCounters)) continue;
+
+        ScriptVariant operand;
+        ScriptVariant_Init(&operand);
+        operand.vt = VT_INTEGER;
+        operand.lVal = (inst->op == OP_DIV) ? shift : divisor - 1;
+        inst->op = (inst->op == OP_DIV) ? OP_SHR : OP_BIT_AND;
+        inst->setSrc(1, addConstant(operand));
+    }
 
-// insert instruction at end of basic block
-Constant *SSABuilder::addConstant(ScriptVariant sv)
-{
-    // TODO: prevent duplicates
-    constantList.gotoLast();
-    Constant *c = new(memCtx) Constant(sv);
-    constantList.insertAfter(c, NULL);
-    return c;
+    if (changed)
+        removeDeadCode();
 }
 
-void SSABuilder::printInstructionList()
+// true if the instruction is a call to the length() method, which can't change anything
+static inline bool isLengthCall(Instruction *inst)
 {
-    foreach_list(instructionList, Instruction*, iter)
-    {
-        iter.value()->print();
-    }
+    return inst->op == OP_CALL_METHOD && inst->operands.size() == 1 &&
+           strcmp(inst->asFunctionCall()->functionName, "length") == 0;
 }
 
-// replace calls to cc_constant("SOME_ENGINE_CONSTANT_NAME") with the actual constant value
-void SSABuilder::foldConstantCalls()
+static void eliminateBoundsChecksInLoop(Loop *loop, SSABuilder *func, ArrayList<Temporary*> *nonNegative)
 {
-    instructionList.gotoFirst();
-    foreach_list(instructionList, Instruction *, iter)
+    BasicBlock *header = loop->header;
+    BitSet inLoop(func->basicBlockList.size(), true);
+    collectLoopBlocks(loop, &inLoop);
+    BasicBlock *preheader, *latch;
+    if (header->domPreorder >= 0 && findLoopEdges(loop, &inLoop, &preheader, &latch))
     {
-        Instruction *inst = iter.value();
-        if (inst->isFunctionCall())
+        // Only a function call can change the length of a list, so if the loop doesn't call anything but length(),
+        // a length checked in the header is still the length everywhere else in the same iteration.
+        bool hasCalls = false;
+        foreach_list(func->basicBlockList, BasicBlock*, iter)
         {
-            FunctionCall *call = inst->asFunctionCall();
-            if (strcmp(call->functionName, "cc_constant") == 0 && call->operands.size() == 1)
+            BasicBlock *block = iter.value();
+            if (!inLoop.test(block->id)) continue;
+            for (Node<Instruction*> *node = block->start->getNext(); node != block->end; node = node->getNext())
             {
-                call->operands.gotoFirst();
-                if (call->operands.retrieve()->isConstant())
-                {
-                    ScriptVariant *constantName = &call->operands.retrieve()->asConstant()->constValue;
-                    ScriptVariant constant = {{.ptrVal = NULL}, VT_EMPTY};
-                    if (scriptConstantValue(constantName, &constant) == CC_OK)
-                    {
-                        Constant *constantValue = addConstant(constant);
-                        call->dst->replaceBy(constantValue);
+                if (node->value->isFunctionCall() && !isLengthCall(node->value))
+                    hasCalls = true;
+            }
+        }
 
-                        // have to remove the call instruction here since DCE doesn't touch function calls
-                        call->operands.retrieve()->unref(call);
-                        iter.remove();
-                    }
-                }
+        ArrayList<InductionVariable> ivs;
+        findInductionVariables(header, preheader, &ivs);
+        for (uint32_t i = 0; i < ivs.size(); i++)
+        {
+            InductionVariable *iv = ivs.getPtr(i);
+            if (!isNonNegativeCounter(iv, &inLoop, nonNegative)) continue;
+            Temporary *counter = iv->phi->value();
+            nonNegative->append(counter);
+            if (hasCalls) continue;
+
+            // the loop is left unless counter < list.length(), with the length taken on every iteration
+            Expression *compare = header->end->getPrevious()->value->src(0)->asTemporary()->expr;
+            RValue *bound = compare->src(1);
+            if (!bound->isTemporary() || bound->asTemporary()->expr->block != header ||
+                !isLengthCall(bound->asTemporary()->expr))
+                continue;
+            RValue *list = bound->asTemporary()->expr->src(0);
+
+            // everything in the loop after the header runs only while the counter is a valid index
+            foreach_list(counter->users, Instruction*, userIter)
+            {
+                Instruction *access = userIter.value();
+                if ((access->op == OP_GET || access->op == OP_SET) && access->src(0) == list &&
+                    access->src(1) == counter && access->block != header && inLoop.test(access->block->id))
+                    access->indexInBounds = true;
             }
         }
     }
+
+    foreach_list(loop->children, Loop*, iter)
+    {
+        eliminateBoundsChecksInLoop(iter.value(), func, nonNegative);
+    }
 }
 
-// dead code elimination pass
-void SSABuilder::removeDeadCode()
+/* Bounds-check elimination: in a loop like "for (i = 0; i < list.length(); i++)", list[i] can't be out of bounds in the
+   body, since the counter starts at a valid index, only goes up by 1, and the length is checked before every
+   iteration. Accesses like that are marked so that the checks of the index are left out when the container is a list,
+   unless the loop calls a function that could change the list's length. */
+void SSABuilder::eliminateBoundsChecks()
 {
-    instructionList.gotoFirst();
-    foreach_list(instructionList, Instruction *, iter)
+    computeDominators();
+    ArrayList<Temporary*> nonNegativeCounters;
+    foreach_list(loops, Loop*, iter)
     {
-        Instruction *inst = iter.value();
-        if (inst->isExpression())
+        eliminateBoundsChecksInLoop(iter.value(), this, &nonNegativeCounters);
+    }
+}
+
+// Finds the blocks that can be reached from 'from', or from any block without predecessors, without passing through
+// 'avoid'.
+static BitSet *reachableAvoiding(BasicBlock *from, BasicBlock *avoid, List<BasicBlock*> *blocks)
+{
+    BitSet *reached = new BitSet(blocks->size(), true);
+    ArrayList<BasicBlock*> worklist;
+    worklist.append(from);
+    foreach_plist(blocks, BasicBlock*, iter)
+    {
+        if (iter.value()->preds.isEmpty())
+            worklist.append(iter.value());
+    }
+    while (worklist.size() > 0)
+    {
+        BasicBlock *block = worklist.removeLast();
+        if (block == avoid || reached->test(block->id)) continue;
+        reached->set(block->id);
+        foreach_list(block->succs, BasicBlock*, iter)
         {
-            Expression *expr = inst->asExpression();
-            if (expr->isDead())
-            {
-                // RValue *undefined = new(memCtx) Undef();
-                foreach_list(expr->operands, RValue*, iter)
-                {
-                    iter.value()->unref(expr);
-                }
-                iter.remove();
-                continue;
-            }
+            worklist.append(iter.value());
         }
     }
+    return reached;
 }
 
 void SSABuilder::prepareForRegAlloc()
 {
+    computeDominators();
+
     // insert phi moves
     foreach_list(basicBlockList, BasicBlock*, iter)
     {
         BasicBlock *block = iter.value();
+
+        // for each source block of the phis here, the blocks reachable from this one without going through it
+        struct ReachableSet {
+            BasicBlock *srcBlock;
+            BitSet *reached;
+        };
+        ArrayList<ReachableSet> reachableSets;
+
         Node<Instruction*> *instNode = block->start;
         while ((instNode = instNode->getNext()))
         {
@@ -334,6 +2581,7 @@ void SSABuilder::prepareForRegAlloc()
                 BasicBlock *srcBlock = phi->sourceBlocks[i++];
                 Node<Instruction*> *insertPoint = srcBlock->end->getPrevious();
                 Expression *move = new(memCtx) Expression(OP_MOV, valueId(), phiSrc);
+                move->value()->type = phiSrc->knownType(); // it can replace phiSrc in other instructions
                 move->block = srcBlock;
                 while (insertPoint->value->isJump())
                     insertPoint = insertPoint->getPrevious();
@@ -346,7 +2594,6 @@ void SSABuilder::prepareForRegAlloc()
                 move->isPhiMove = true;
 
                 // replace other references if we can, to improve register allocation
-                int numBBs = basicBlockList.size();
                 if (!phiSrc->isTemporary()) continue; // no advantage to this if src isn't a temp
                 foreach_list(phiSrc->users, Instruction*, refIter)
                 {
@@ -355,8 +2602,24 @@ void SSABuilder::prepareForRegAlloc()
                     // If user is a jump in this block, it's at the end so the phi move
                     // dominates it. We can also replace if the phi move dominates the
                     // user without passing through the phi.
-                    if ((inst2->block == srcBlock && inst2->isJump()) ||
-                        (inst2->block != srcBlock && srcBlock->dominates(inst2->block, block, numBBs)))
+                    bool replace = (inst2->block == srcBlock && inst2->isJump());
+                    if (inst2->block != srcBlock && srcBlock->dominates(inst2->block))
+                    {
+                        BitSet *reached = NULL;
+                        for (uint32_t j = 0; j < reachableSets.size() && !reached; j++)
+                        {
+                            if (reachableSets.get(j).srcBlock == srcBlock)
+                                reached = reachableSets.get(j).reached;
+                        }
+                        if (!reached)
+                        {
+                            ReachableSet newSet = {srcBlock, reachableAvoiding(block, srcBlock, &basicBlockList)};
+                            reachableSets.append(newSet);
+                            reached = newSet.reached;
+                        }
+                        replace = !reached->test(inst2->block->id);
+                    }
+                    if (replace)
                     {
                         // replace the reference
                         foreach_list(inst2->operands, RValue*, srcIter2)
@@ -372,11 +2635,10 @@ void SSABuilder::prepareForRegAlloc()
                 }
             }
         }
-        
-        // build successor lists
-        foreach_list(block->preds, BasicBlock*, predIter)
+
+        for (uint32_t i = 0; i < reachableSets.size(); i++)
         {
-            predIter.value()->succs.insertAfter(block, NULL);
+            delete reachableSets.get(i).reached;
         }
     }
     
@@ -427,6 +2689,83 @@ void SSABuilder::prepareForRegAlloc()
     }
 }
 
+// the last instruction before 'node' in its block that isn't removed from the final code, or NULL
+static Node<Instruction*> *previousNonTrivial(Node<Instruction*> *node, BasicBlock *block)
+{
+    for (node = node->getPrevious(); node != block->start; node = node->getPrevious())
+    {
+        if (!node->value->isTrivial()) return node;
+    }
+    return NULL;
+}
+
+// the block that execution falls through to from the end of this one, or NULL
+static BasicBlock *nextBlockInCode(BasicBlock *block)
+{
+    Node<Instruction*> *next = block->end->getNext();
+    return next ? next->value->block : NULL;
+}
+
+static inline bool isIntegerInRegister(RValue *value, int reg)
+{
+    return value->isTemporary() && value->asTemporary()->reg == reg && value->knownType() == TYPE_INTEGER;
+}
+
+/* A for loop like "for (i = 0; i < n; i++)" ends with a block that increments i and jumps back to the block that tests
+   it. When the test is only a comparison of the integer counter to an integer bound, the increment, comparison and
+   branch can be done by one OP_FORLOOP_* instruction that jumps straight to the start of the body, so only the first
+   iteration goes through the test block. Since the counter has to be in the same register before and after the
+   increment, this is done after register allocation. */
+void SSABuilder::fuseCountedLoops()
+{
+    foreach_list(basicBlockList, BasicBlock*, iter)
+    {
+        BasicBlock *latch = iter.value();
+        Node<Instruction*> *jumpNode = previousNonTrivial(latch->end, latch);
+        if (!jumpNode || jumpNode->value->op != OP_JMP) continue;
+        BasicBlock *header = jumpNode->value->asJump()->target;
+        Node<Instruction*> *stepNode = previousNonTrivial(jumpNode, latch);
+        if (header == latch || !stepNode) continue;
+        Instruction *step = stepNode->value;
+        if (step->op != OP_INC && step->op != OP_DEC) continue;
+        int counterReg = step->asExpression()->value()->reg;
+        if (!isIntegerInRegister(step->src(0), counterReg)) continue;
+
+        // the header has to be nothing but the comparison and a branch out of the loop
+        Node<Instruction*> *branchNode = previousNonTrivial(header->end, header);
+        if (!branchNode || branchNode->value->op != OP_BRANCH_FALSE) continue;
+        Node<Instruction*> *compareNode = previousNonTrivial(branchNode, header);
+        if (!compareNode || previousNonTrivial(compareNode, header)) continue;
+        Instruction *compare = compareNode->value, *branch = branchNode->value;
+        if (!compare->isExpression() || branch->src(0) != compare->asExpression()->value() ||
+            !isIntegerInRegister(compare->src(0), counterReg) || compare->src(1)->knownType() != TYPE_INTEGER)
+            continue;
+
+        OpCode op;
+        if (step->op == OP_INC && compare->op == OP_LT) op = OP_FORLOOP_LT;
+        else if (step->op == OP_INC && compare->op == OP_LE) op = OP_FORLOOP_LE;
+        else if (step->op == OP_DEC && compare->op == OP_GT) op = OP_FORLOOP_GT;
+        else if (step->op == OP_DEC && compare->op == OP_GE) op = OP_FORLOOP_GE;
+        else continue;
+
+        BasicBlock *body = nextBlockInCode(header), *exit = branch->asJump()->target;
+        if (!body) continue;
+
+        Jump *forLoop = new(memCtx) Jump(op, body, step->src(0), compare->src(1));
+        forLoop->block = latch;
+        instructionList.setCurrent(stepNode);
+        instructionList.insertBefore(forLoop, NULL);
+        step->src(0)->unref(step);
+        instructionList.removeNode(stepNode);
+
+        // leaving the loop now happens here instead of in the header
+        if (nextBlockInCode(latch) == exit)
+            instructionList.removeNode(jumpNode);
+        else
+            jumpNode->value->asJump()->target = exit;
+    }
+}
+
 // predecessor: the basic block right before the loop
 Loop::Loop(BasicBlock *header, Loop *parent)
 {
@@ -457,17 +2796,17 @@ GlobalVarRef *GlobalState::readGlobalVariable(const char *varName, void *memCtx)
 }
 
 SSABuildUtil::SSABuildUtil(SSABuilder *builder, GlobalState *globalState)
-    : builder(builder), globalState(globalState), currentBlock(NULL)
+    : builder(builder), globalState(globalState), currentBlock(NULL), fileName(NULL), line(0)
 {
     currentLoop = NULL;
 }
 
 // declare a parameter to this function
-void SSABuildUtil::addParam(const char *name)
+void SSABuildUtil::addParam(const char *name, VARTYPE declaredType)
 {
     Param *param = new(builder->memCtx) Param(builder->paramCount);
     builder->paramCount++;
-    declareVariable(name);
+    declareVariable(name, declaredType);
     writeVariable(name, param);
 }
 
@@ -475,43 +2814,10 @@ void SSABuildUtil::addParam(const char *name)
 Constant *SSABuildUtil::applyOp(OpCode op, ScriptVariant *src0, ScriptVariant *src1)
 {
     ScriptVariant result;
-    CCResult success;
-
-    switch (op)
+    if (evaluateOp(op, &result, src0, src1) == CC_OK)
     {
-    // unary
-    case OP_NEG: success = ScriptVariant_Neg(&result, src0); break;
-    case OP_BOOL_NOT: success = ScriptVariant_Boolean_Not(&result, src0); break;
-    case OP_BIT_NOT: success = ScriptVariant_Bit_Not(&result, src0); break;
-    case OP_INC: success = ScriptVariant_Inc(&result, src0); break;
-    case OP_DEC: success = ScriptVariant_Dec(&result, src0); break;
-    case OP_BOOL: success = ScriptVariant_ToBoolean(&result, src0); break;
-    // binary
-    case OP_BIT_OR: success = ScriptVariant_Bit_Or(&result, src0, src1); break;
-    case OP_XOR: success = ScriptVariant_Xor(&result, src0, src1); break;
-    case OP_BIT_AND: success = ScriptVariant_Bit_And(&result, src0, src1); break;
-    case OP_EQ: success = ScriptVariant_Eq(&result, src0, src1); break;
-    case OP_NE: success = ScriptVariant_Ne(&result, src0, src1); break;
-    case OP_LT: success = ScriptVariant_Lt(&result, src0, src1); break;
-    case OP_GT: success = ScriptVariant_Gt(&result, src0, src1); break;
-    case OP_GE: success = ScriptVariant_Ge(&result, src0, src1); break;
-    case OP_LE: success = ScriptVariant_Le(&result, src0, src1); break;
-    case OP_SHL: success = ScriptVariant_Shl(&result, src0, src1); break;
-    case OP_SHR: success = ScriptVariant_Shr(&result, src0, src1); break;
-    case OP_ADD:
-        success = ScriptVariant_Add(&result, src0, src1);
-        if (success == CC_OK && result.vt == VT_STR)
+        if (result.vt == VT_STR)
             StrCache_Ref(result.strVal);
-        break;
-    case OP_SUB: success = ScriptVariant_Sub(&result, src0, src1); break;
-    case OP_MUL: success = ScriptVariant_Mul(&result, src0, src1); break;
-    case OP_DIV: success = ScriptVariant_Div(&result, src0, src1); break;
-    case OP_REM: success = ScriptVariant_Rem(&result, src0, src1); break;
-    default: success = CC_FAIL;
-    }
-
-    if (success == CC_OK)
-    {
         return builder->addConstant(result);
     }
     return NULL;
@@ -546,6 +2852,20 @@ RValue *SSABuildUtil::mkUnaryOp(OpCode op, RValue *src)
     return result;
 }
 
+RValue *SSABuildUtil::mkTypeCheck(OpCode op, RValue *src)
+{
+    if (src->isConstant()) // pre-evaluate check
+    {
+        Constant *result = applyOp(op, &src->asConstant()->constValue, NULL);
+        if (result) return result;
+    }
+
+    char *file = fileName ? ralloc_strdup(builder->memCtx, fileName) : NULL;
+    TypeCheck *inst = new(builder->memCtx) TypeCheck(op, builder->valueId(), src, file, line);
+    builder->insertInstruction(inst, currentBlock);
+    return inst->value();
+}
+
 RValue *SSABuildUtil::mkBinaryOp(OpCode op, RValue *src0, RValue *src1)
 {
     RValue *result = NULL;
@@ -695,7 +3015,7 @@ Undef *SSABuildUtil::undef() // get an undefined value
 }
 
 // returns true on success, false if varName is already defined
-bool SSABuildUtil::declareVariable(const char *varName)
+bool SSABuildUtil::declareVariable(const char *varName, VARTYPE declaredType)
 {
     // see if there is already a variable defined with this name (error)
     Symbol *existingSymbol;
@@ -705,10 +3025,20 @@ bool SSABuildUtil::declareVariable(const char *varName)
     // variable is not defined, so create symbol and add it to symbol table
     Symbol *sym = (Symbol *) malloc(sizeof(Symbol));
     Symbol_Init(sym, varName, NULL);
+    sym->declaredType = declaredType;
     symbolTable.addSymbol(sym);
     return true;
 }
 
+// returns VT_EMPTY for variables that can hold any type, including globals and undefined variables
+VARTYPE SSABuildUtil::declaredType(const char *varName)
+{
+    Symbol *sym;
+    if (symbolTable.findSymbol(varName, &sym))
+        return sym->declaredType;
+    return VT_EMPTY;
+}
+
 // returns true if varName is valid in current scope
 bool SSABuildUtil::writeVariable(const char *varName, RValue *value)
 {
@@ -716,6 +3046,10 @@ bool SSABuildUtil::writeVariable(const char *varName, RValue *value)
     bool found = symbolTable.findSymbol(varName, &sym);
     if (found)
     {
+        if (sym->declaredType == VT_INTEGER)
+            value = mkTypeCheck(OP_CHECK_INT, value);
+        else if (sym->declaredType == VT_DECIMAL)
+            value = mkTypeCheck(OP_CHECK_DECIMAL, value);
         builder->writeVariable(varName, currentBlock, value);
         return true;
     }
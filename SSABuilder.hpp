@@ -51,6 +51,9 @@ enum OpCode
     OP_DIV,
     OP_REM,
 
+    // string concatenation of any number of operands
+    OP_CONCAT,
+
     // function call
     OP_CALL,
     OP_CALL_BUILTIN,
@@ -65,12 +68,66 @@ enum OpCode
     // write to global variable
     OP_EXPORT,
 
+    // Type checks on values written to variables declared int or float in a script with "#pragma strict_types". The
+    // result is the operand, converted to a decimal for OP_CHECK_DECIMAL if it's an integer.
+    OP_CHECK_INT,
+    OP_CHECK_DECIMAL,
+
+    // Forms of the ops above for integer or decimal operands, which skip the type checks. These are only used in
+    // ExecFunctions, where FunctionBuilder picks them for instructions whose operands are known to have those types.
+    OP_INC_I,
+    OP_DEC_I,
+    OP_ADD_II,
+    OP_SUB_II,
+    OP_MUL_II,
+    OP_EQ_II,
+    OP_NE_II,
+    OP_LT_II,
+    OP_GT_II,
+    OP_GE_II,
+    OP_LE_II,
+    OP_BIT_AND_II,
+    OP_SHR_II,
+    OP_ADD_DD,
+    OP_SUB_DD,
+    OP_MUL_DD,
+    OP_DIV_DD,
+    OP_LT_DD,
+    OP_GT_DD,
+    OP_GE_DD,
+    OP_LE_DD,
+
+    // Forms of OP_GET and OP_SET for an index that's known to be an integer in bounds if the container is a list. The
+    // container is still checked, and other containers go through the usual OP_GET and OP_SET code.
+    OP_GET_LIST,
+    OP_SET_LIST,
+
+    // Loop back edges of counted loops, which step an integer counter by 1 (LT, LE) or -1 (GT, GE), compare it to a
+    // bound and jump to the start of the loop body if the comparison is true. SSABuilder::fuseCountedLoops() puts
+    // these in place of an increment or decrement and a jump back to the loop's test.
+    OP_FORLOOP_LT,
+    OP_FORLOOP_LE,
+    OP_FORLOOP_GT,
+    OP_FORLOOP_GE,
+
     // error
     OP_ERR,
 };
 
 const char *getOpCodeName(OpCode op);
 
+// what is known at compile time about the type of a value
+enum ValueType
+{
+    TYPE_NONE, // no value has been seen yet (only used during type inference)
+    TYPE_INTEGER,
+    TYPE_DECIMAL,
+    TYPE_STRING,
+    TYPE_OBJECT,
+    TYPE_LIST,
+    TYPE_UNKNOWN, // could be any type
+};
+
 // RValue and its subclasses
 class RValue;
 class Temporary;
@@ -84,6 +141,7 @@ class Expression;
 class BlockDecl;
 class Phi;
 class FunctionCall;
+class TypeCheck;
 class Jump;
 class Export;
 
@@ -123,6 +181,7 @@ public:
     virtual bool isGlobalVarRef();
     virtual bool isUndefined();
     virtual bool isBoolValue();
+    virtual ValueType knownType();
 
     inline Constant *asConstant();
     inline Temporary *asTemporary();
@@ -147,10 +206,12 @@ class Temporary : public RValue
 public:
     int id;
     Expression *expr;
-    inline Temporary(int id, Expression *expr) : RValue(), id(id), expr(expr), reg(-1) {}
+    ValueType type; // set by SSABuilder::inferTypes()
+    inline Temporary(int id, Expression *expr) : RValue(), id(id), expr(expr), type(TYPE_UNKNOWN), reg(-1) {}
     virtual bool isTemporary();
     virtual void printDst();
     virtual bool isBoolValue();
+    virtual ValueType knownType();
     
     // for register allocation
     // Interval livei;
@@ -182,6 +243,7 @@ public:
     virtual bool isConstant();
     virtual void printDst();
     virtual bool isBoolValue();
+    virtual ValueType knownType();
 };
 
 // a parameter (input value) to the function
@@ -217,6 +279,14 @@ public:
         : varName(NULL), parent(parent), key(key) {}
 };
 
+struct ExecFunction;
+
+// a copy of a function's body in the code of a function it was inlined into
+struct InlineSite {
+    ExecFunction *function; // the inlined function
+    InlineSite *caller; // the copy that the call to it was part of, or NULL if the call was in the function's own code
+};
+
 class Instruction
 {
     DECLARE_RALLOC_CXX_OPERATORS(Instruction);
@@ -226,8 +296,11 @@ public:
     BasicBlock *block; // basic block
     int seqIndex; // for live ranges in register allocation
     bool isPhiMove; // this instruction is a move used by a phi in a successor block
+    bool indexInBounds; // for OP_GET and OP_SET: the key is a valid index if the container is a list
+    InlineSite *inlineSite; // the inlined copy this is part of, or NULL if it's part of the function's own code
 
-    inline Instruction(OpCode opCode) : op(opCode), block(NULL), seqIndex(-1), isPhiMove(false) {}
+    inline Instruction(OpCode opCode)
+        : op(opCode), block(NULL), seqIndex(-1), isPhiMove(false), indexInBounds(false), inlineSite(NULL) {}
 
     // trivial virtual destructor to silence compiler warnings
     virtual ~Instruction();
@@ -242,10 +315,13 @@ public:
     virtual bool isJump();
     inline bool isPhi() { return op == OP_PHI; }
     inline bool isFunctionCall() { return op == OP_CALL || op == OP_CALL_BUILTIN || op == OP_CALL_METHOD; }
+    // true if the operands are stored in the function's parameter list instead of in src0-src2
+    inline bool hasParamList() { return isFunctionCall() || op == OP_CONCAT; }
 
     inline Expression *asExpression();
     inline Phi *asPhi();
     inline FunctionCall *asFunctionCall();
+    inline TypeCheck *asTypeCheck();
     inline Jump *asJump();
     inline Export *asExport();
 
@@ -291,7 +367,6 @@ public:
     BasicBlock **sourceBlocks;
 };
 
-struct ExecFunction;
 class FunctionCall : public Expression
 {
 public:
@@ -305,6 +380,16 @@ public:
     virtual void print();
 };
 
+// OP_CHECK_INT or OP_CHECK_DECIMAL on a value written to a typed variable
+class TypeCheck : public Expression
+{
+public:
+    char *fileName; // where the value is written, for errors found by type inference
+    int line;
+    inline TypeCheck(OpCode opCode, int valueId, RValue *src, char *fileName, int line)
+        : Expression(opCode, valueId, src), fileName(fileName), line(line) {}
+};
+
 class Jump : public Instruction
 {
 public:
@@ -318,9 +403,10 @@ class Export : public Instruction
 {
 public:
     GlobalVarRef *dst;
-    inline Export(GlobalVarRef *dst, RValue *src) : Instruction(OP_EXPORT), dst(dst)
+    inline Export(GlobalVarRef *dst, RValue *src = NULL) : Instruction(OP_EXPORT), dst(dst)
     {
-        appendOperand(src);
+        if (src)
+            appendOperand(src);
     }
     void print();
 };
@@ -328,6 +414,7 @@ public:
 Expression *Instruction::asExpression() { return static_cast<Expression*>(this); }
 Phi *Instruction::asPhi() { return static_cast<Phi*>(this); }
 FunctionCall *Instruction::asFunctionCall() { return static_cast<FunctionCall*>(this); }
+TypeCheck *Instruction::asTypeCheck() { return static_cast<TypeCheck*>(this); }
 Jump *Instruction::asJump() { return static_cast<Jump*>(this); }
 Export *Instruction::asExport() { return static_cast<Export*>(this); }
 
@@ -359,9 +446,17 @@ public:
     // index in final instruction list where this block starts
     int startIndex;
 
+    // dominator tree, built by SSABuilder::computeDominators()
+    BasicBlock *idom; // immediate dominator; NULL for the start block and unreachable blocks
+    List<BasicBlock*> domChildren; // blocks whose immediate dominator is this one
+    int postorderIndex; // position in a depth-first postorder of the CFG, or -1 if unreachable
+    int domPreorder; // position in a preorder walk of the dominator tree, or -1 if unreachable
+    int domSubtreeEnd; // largest domPreorder of the blocks this one dominates
+
     inline BasicBlock(int id)
        : id(id), isSealed(false), hasAssignment(false), start(NULL),
-         end(NULL), loop(NULL), startIndex(-1)
+         end(NULL), loop(NULL), startIndex(-1), idom(NULL), postorderIndex(-1),
+         domPreorder(-1), domSubtreeEnd(-1)
     {}
 
     void addPred(BasicBlock *newPred);
@@ -370,10 +465,12 @@ public:
     void printName();
     void print();
 
-    // true if this dominates b, and the path from this to b doesn't include 'without'
-    bool dominates(BasicBlock *b, BasicBlock *without, int numBlocks);
-private:
-    bool dominates(BasicBlock *b, BasicBlock *without, BitSet *tested);
+    // true if every path from the start block to b goes through this one; a block dominates itself, and unreachable
+    // blocks don't dominate or get dominated by anything (only valid after SSABuilder::computeDominators())
+    inline bool dominates(BasicBlock *b)
+    {
+        return b->domPreorder >= 0 && domPreorder <= b->domPreorder && b->domPreorder <= domSubtreeEnd;
+    }
 };
 
 class Loop
@@ -388,9 +485,15 @@ public:
     Loop(BasicBlock *header, Loop *parent = NULL);
 };
 
+// largest function, counted in instructions, whose calls are replaced by a copy of its body
+#ifndef INLINE_MAX_INSTRUCTIONS
+#define INLINE_MAX_INSTRUCTIONS 12
+#endif
+
 class SSABuilder // SSA form of a script function
 {
     DECLARE_RALLOC_CXX_OPERATORS(SSABuilder);
+    friend class FunctionCopier;
 public:
     List<Instruction*> instructionList;
     List<BasicBlock*> basicBlockList;
@@ -441,9 +544,55 @@ public:
     // pre-evaluate calls to cc_constant()
     void foldConstantCalls();
 
+    // sparse conditional constant propagation: replace values that are constant on every path that can run, and
+    // remove the code that can't run
+    void propagateConstants();
+
+    // replace chains of string additions with OP_CONCAT
+    void fuseConcatenations();
+
+    // fill in the successor lists of the basic blocks from their predecessor lists
+    void buildSuccessorLists();
+
+    // build the dominator tree and number it for BasicBlock::dominates()
+    void computeDominators();
+
+    // global value numbering: replace pure expressions with an equal value computed in a dominating position
+    void numberValues();
+
+    // loop-invariant code motion: move what gives the same value on every iteration of a loop in front of the loop
+    void hoistLoopInvariants();
+
+    // True if calls to this function can be replaced by a copy of its body: it has to be small and can't call other
+    // script functions or allocate. A function that uses global variables can only be inlined into functions of its
+    // own script.
+    bool isInlinable(bool fromOtherScript);
+
+    // copy this function, allocating the copy in memCtx
+    SSABuilder *clone(void *memCtx);
+
+    // replace a call to another function with a copy of that function's body
+    void inlineCall(FunctionCall *call, SSABuilder *callee);
+
     // dead code elimination
     void removeDeadCode();
+
+    // find the types of the temporaries that can be proven to have only one type
+    void inferTypes();
+
+    // Removes the type checks on values already known to have the right type, after inferTypes(). Returns false after
+    // printing an error if a value known to have the wrong type is written to a variable declared int or float.
+    bool checkDeclaredTypes();
+
+    // strength reduction of multiplications by loop counters and of division by powers of 2, after inferTypes()
+    void reduceStrength();
+
+    // marks list accesses indexed by a loop counter that's checked against the list's length, after reduceStrength()
+    void eliminateBoundsChecks();
     void prepareForRegAlloc();
+
+    // after register allocation, replace the step and jump back at the end of counted loops with OP_FORLOOP_*
+    void fuseCountedLoops();
     
     void printInstructionList();
     inline int valueId() { return nextValueId++; }
@@ -481,18 +630,21 @@ private:
     Constant *applyOp(OpCode op, ScriptVariant *src0, ScriptVariant *src1); // used for constant folding
 public:
     BasicBlock *currentBlock;
+    const char *fileName; // position of the code being parsed, kept up to date by the parser
+    int line;
     Stack<BasicBlock*> breakTargets;
     Stack<BasicBlock*> continueTargets;
     
     SSABuildUtil(SSABuilder *builder, GlobalState *globalState);
     inline void setCurrentBlock(BasicBlock *block) { currentBlock = block; }
     
-    // declare a parameter to this function
-    void addParam(const char *name);
+    // declare a parameter to this function; see declareVariable() for declaredType
+    void addParam(const char *name, VARTYPE declaredType = VT_EMPTY);
     
     // these make an instruction, insert it at the end of the current block, and return it
     RValue *mkUnaryOp(OpCode op, RValue *src);
     RValue *mkBinaryOp(OpCode op, RValue *src0, RValue *src1);
+    RValue *mkTypeCheck(OpCode op, RValue *src); // op is OP_CHECK_INT or OP_CHECK_DECIMAL
     Constant *mkConstInt(int32_t val);
     Constant *mkConstString(char *val);
     Constant *mkConstFloat(double val);
@@ -516,7 +668,10 @@ public:
 
     Undef *undef(); // get an undefined value
 
-    bool declareVariable(const char *name);
+    // Values written to a variable declared with a type of VT_INTEGER or VT_DECIMAL are type checked, and integers
+    // written to a VT_DECIMAL variable are converted. Other variables can hold any type.
+    bool declareVariable(const char *name, VARTYPE declaredType = VT_EMPTY);
+    VARTYPE declaredType(const char *name);
     bool writeVariable(const char *variable, RValue *value);
     bool mkAssignment(LValue *lhs, RValue *rhs);
     RValue *readVariable(const char *variable);
@@ -1,6 +1,8 @@
 #ifndef SCRIPT_CONTAINER_HPP
 #define SCRIPT_CONTAINER_HPP
 
+#include <stddef.h>
+
 // A base class for ScriptObject and ScriptList.
 class ScriptContainer {
 protected:
@@ -14,6 +16,9 @@ public:
     virtual void print() = 0;
     virtual int toString(char *dst, int dstsize, bool json) = 0;
 
+    // returns the number of bytes allocated for this container, not counting the values it refers to
+    virtual size_t memoryUsage() = 0;
+
     inline bool isPersistent()
     {
         return persistent;
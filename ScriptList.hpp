@@ -32,6 +32,12 @@ public:
         return true;
     }
 
+    // like get(), for an index that's already known to be in bounds
+    inline void getInBounds(ScriptVariant *dst, uint32_t index)
+    {
+        *dst = *storage.getPtr(index);
+    }
+
     inline uint32_t size()
     {
         return storage.size();
@@ -52,6 +58,11 @@ public:
     void print() override;
     int toString(char *dst, int dstsize, bool json) override;
 
+    inline size_t memoryUsage() override
+    {
+        return sizeof(*this) + storage.getCapacity() * sizeof(ScriptVariant);
+    }
+
 private:
     // don't call this directly; use ObjectHeap_SetListMember() instead
     inline bool set(uint32_t index, const ScriptVariant &value)
@@ -70,18 +70,24 @@ ScriptObject::~ScriptObject()
 
 inline bool keysEqual(int key1, int key2, const StrCacheEntry *entry1)
 {
-    // Most keys are string constants, so (key1 == key2) will catch most true cases.
-    // Almost all non-equal field names will have different hashes, and comparing hashes is faster than strcmp.
-    // If neither of those has told us whether the keys are equal, finally call strcmp to find out for sure.
+    // Most keys are string constants, so (key1 == key2) will catch most true cases, or all of them if every string is
+    // interned.
+    // Almost all non-equal field names will have different hashes, and comparing hashes is faster than memcmp.
+    // If neither of those has told us whether the keys are equal, finally compare the contents to find out for sure.
     if (key1 == key2)
     {
         return true;
     }
+    else if (strCacheInternAll)
+    {
+        // interned strings are only equal if they're the same string
+        return false;
+    }
     else
     {
         const StrCacheEntry *entry2 = StrCache_GetEntry(key2);
-        return (entry1->hash == entry2->hash &&
-                0 == strcmp(entry1->str, entry2->str));
+        return (entry1->hash == entry2->hash && entry1->len == entry2->len &&
+                0 == memcmp(entry1->str, entry2->str, entry1->len));
     }
 }
 
@@ -175,6 +181,8 @@ bool ScriptObject::set(int key, const ScriptVariant *value)
     ObjectHashNode *node = getNodeForKey(key);
     if (node != NULL) // Key is already in the object, so just update the value.
     {
+        if (persistent)
+            ScriptVariant_Unref(&node->value);
         node->value = *value;
         return true;
     }
@@ -379,7 +387,7 @@ int ScriptObject::toString(char *dst, int dstsize, bool json)
         if (!first) SNPRINTF(", ");
         first = false;
 
-        SWRITE(escapeString(dst, dstsize, StrCache_Get(hashTable[i].key), StrCache_Len(hashTable[i].key)));
+        SWRITE(escapeString(dst, dstsize, StrCache_GetData(hashTable[i].key), StrCache_Len(hashTable[i].key)));
         SNPRINTF(": ");
 
         if (json || hashTable[i].value.vt == VT_STR)
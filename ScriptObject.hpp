@@ -45,6 +45,11 @@ public:
     void makePersistent() override; // make all values in map persistent
     void print() override;
     int toString(char *dst, int dstsize, bool json) override;
+
+    inline size_t memoryUsage() override
+    {
+        return sizeof(*this) + (sizeof(ObjectHashNode) << log2_hashTableSize);
+    }
 };
 
 #endif
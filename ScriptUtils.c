@@ -10,7 +10,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <stdint.h>
 #include "globals.h"
+#include "ScriptUtils.h"
 
 void printEscapedString(const char *string)
 {
@@ -51,40 +53,46 @@ void printEscapedString(const char *string)
 // gets the job done.
 int escapeString(char *dst, int dstSize, const char *src, int srcLength)
 {
-#define SNPRINTF(...) { int n = snprintf(dst, dstSize, __VA_ARGS__); dst += n; length += n; dstSize -= n; if (dstSize < 0) dstSize = 0; }
+    // writes a character if there's room for it and the null terminator, but counts it either way
+#define PUT(c) { if (length < dstSize - 1) dst[length] = (c); length++; }
+    static const char hexDigits[] = "0123456789abcdef";
     int length = 0;
     int i;
 
-    SNPRINTF("\"");
+    PUT('"');
     for (i = 0; i < srcLength; i++)
     {
         unsigned char c = src[i];
         switch (c)
         {
-            case '\t': SNPRINTF("\\t"); break;
-            case '\r': SNPRINTF("\\r"); break;
-            case '\n': SNPRINTF("\\n"); break;
-            case '\f': SNPRINTF("\\f"); break;
-            case '\v': SNPRINTF("\\v"); break;
-            case '\\': SNPRINTF("\\\\"); break;
-            case '"':  SNPRINTF("\\\""); break;
+            case '\t': PUT('\\'); PUT('t'); break;
+            case '\r': PUT('\\'); PUT('r'); break;
+            case '\n': PUT('\\'); PUT('n'); break;
+            case '\f': PUT('\\'); PUT('f'); break;
+            case '\v': PUT('\\'); PUT('v'); break;
+            case '\\': PUT('\\'); PUT('\\'); break;
+            case '"':  PUT('\\'); PUT('"'); break;
             default:
             {
                 if (isprint(c))
                 {
-                    SNPRINTF("%c", c);
+                    PUT(c);
                 }
                 else
                 {
-                    SNPRINTF("\\x%02x", c);
+                    PUT('\\'); PUT('x'); PUT(hexDigits[c >> 4]); PUT(hexDigits[c & 15]);
                 }
             }
         }
     }
+    PUT('"');
 
-    SNPRINTF("\"");
+    if (dstSize > 0)
+    {
+        dst[(length < dstSize) ? length : dstSize - 1] = '\0';
+    }
     return length;
-#undef SNPRINTF
+#undef PUT
 }
 
 // from source/utils.c in OpenBOR
@@ -114,4 +122,187 @@ int searchList(const char *list[], const char *value, int length)
     return -1;
 }
 
+static const char digitPairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+// writes the digits of n, two at a time, and returns the number of characters written (not null-terminated)
+static int formatUnsigned(char *buffer, uint64_t n)
+{
+    char digits[20];
+    char *p = digits + sizeof(digits);
+    while (n >= 100)
+    {
+        p -= 2;
+        memcpy(p, &digitPairs[(n % 100) * 2], 2);
+        n /= 100;
+    }
+    if (n >= 10)
+    {
+        p -= 2;
+        memcpy(p, &digitPairs[n * 2], 2);
+    }
+    else
+    {
+        *--p = (char) ('0' + n);
+    }
+    int length = (int) (digits + sizeof(digits) - p);
+    memcpy(buffer, p, length);
+    return length;
+}
+
+int formatInteger(char *buffer, int value)
+{
+    int length = 0;
+    uint32_t magnitude = (uint32_t) value;
+    if (value < 0)
+    {
+        buffer[length++] = '-';
+        magnitude = 0u - magnitude;
+    }
+    length += formatUnsigned(buffer + length, magnitude);
+    buffer[length] = '\0';
+    return length;
+}
+
+int formatDecimal(char *buffer, double value)
+{
+#if defined(__SIZEOF_INT128__)
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    int negative = (int) (bits >> 63);
+    int exponent = (int) ((bits >> 52) & 0x7ff);
+    uint64_t mantissa = bits & ((1ull << 52) - 1);
+    if (exponent == 0x7ff || value >= 1e13 || value <= -1e13)
+    {
+        return -1; // infinity, NaN, or too many digits for the fixed-point value to fit in 64 bits
+    }
+    if (exponent == 0)
+        exponent = 1; // subnormal
+    else
+        mantissa |= 1ull << 52;
+
+    // value is exactly mantissa * 2^-shift; round mantissa * 10^6 * 2^-shift to the nearest integer, breaking ties
+    // to even like printf does
+    int shift = 1075 - exponent;
+    unsigned __int128 product = (unsigned __int128) mantissa * 1000000;
+    uint64_t fixed = 0;
+    if (shift < 128)
+    {
+        unsigned __int128 half = (unsigned __int128) 1 << (shift - 1);
+        unsigned __int128 remainder = product & ((half << 1) - 1);
+        fixed = (uint64_t) (product >> shift);
+        if (remainder > half || (remainder == half && (fixed & 1)))
+            fixed++;
+    }
+
+    int length = 0;
+    if (negative)
+        buffer[length++] = '-';
+    length += formatUnsigned(buffer + length, fixed / 1000000);
+    buffer[length++] = '.';
+    uint32_t fraction = (uint32_t) (fixed % 1000000);
+    for (int i = 4; i >= 0; i -= 2)
+    {
+        memcpy(&buffer[length + i], &digitPairs[(fraction % 100) * 2], 2);
+        fraction /= 100;
+    }
+    length += 6;
+    buffer[length] = '\0';
+    return length;
+#else
+    return -1;
+#endif
+}
+
+int parseInteger(const char *str, int length, int64_t *value)
+{
+    const char *p = str, *end = str + length;
+    int negative = 0;
+    if (p < end && (*p == '+' || *p == '-'))
+    {
+        negative = (*p++ == '-');
+    }
+    if (p == end || end - p > 10)
+    {
+        return 0;
+    }
+
+    int64_t result = 0;
+    for (; p < end; p++)
+    {
+        if (*p < '0' || *p > '9') return 0;
+        result = result * 10 + (*p - '0');
+    }
+    *value = negative ? -result : result;
+    return 1;
+}
+
+int parseDecimal(const char *str, int length, double *value)
+{
+    static const double powersOf10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    const char *p = str, *end = str + length;
+    int negative = 0;
+    if (p < end && (*p == '+' || *p == '-'))
+    {
+        negative = (*p++ == '-');
+    }
+
+    // digits, with an optional decimal point, accumulated in an integer that must stay exactly representable
+    uint64_t mantissa = 0;
+    int exponent = 0, numDigits = 0, seenPoint = 0;
+    for (; p < end; p++)
+    {
+        if (*p == '.' && !seenPoint)
+        {
+            seenPoint = 1;
+            continue;
+        }
+        if (*p < '0' || *p > '9') break;
+        if (mantissa >= (1ull << 53) / 10) return 0;
+        mantissa = mantissa * 10 + (*p - '0');
+        exponent -= seenPoint;
+        numDigits++;
+    }
+    if (numDigits == 0)
+    {
+        return 0;
+    }
+
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        int expNegative = 0, expValue = 0;
+        const char *expStart;
+        if (++p < end && (*p == '+' || *p == '-'))
+        {
+            expNegative = (*p++ == '-');
+        }
+        for (expStart = p; p < end && *p >= '0' && *p <= '9' && p - expStart < 4; p++)
+        {
+            expValue = expValue * 10 + (*p - '0');
+        }
+        if (p == expStart) return 0;
+        exponent += expNegative ? -expValue : expValue;
+    }
+    if (p != end || exponent < -22 || exponent > 22)
+    {
+        return 0;
+    }
 
+    // both operands are exact, so the one rounding step gives the correctly rounded result
+    double result = (double) mantissa;
+    result = (exponent < 0) ? result / powersOf10[-exponent] : result * powersOf10[exponent];
+    *value = negative ? -result : result;
+    return 1;
+}
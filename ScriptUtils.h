@@ -1,6 +1,8 @@
 #ifndef SCRIPT_UTILS_H
 #define SCRIPT_UTILS_H
 
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -11,6 +13,18 @@ void printEscapedString(const char *string);
 // creates an "escaped" version of a string with quotes added around it and characters like '\n' escaped
 int escapeString(char *dst, int dstSize, const char *src, int srcLength);
 
+// Writes a number as a null-terminated string and returns its length. A buffer of FORMAT_NUMBER_BUFFER_SIZE chars is
+// always enough. Decimals are written like printf("%lf"); formatDecimal() returns -1 without writing anything for
+// values too large for its fast path, infinity and NaN.
+#define FORMAT_NUMBER_BUFFER_SIZE 32
+int formatInteger(char *buffer, int value);
+int formatDecimal(char *buffer, double value);
+
+// Fast paths for parsing numbers that only accept plain decimal notation and return 0 for anything else, including
+// values that they can't convert exactly. Callers should fall back to strtoll() or strtod() when they return 0.
+int parseInteger(const char *str, int length, int64_t *value);
+int parseDecimal(const char *str, int length, double *value);
+
 // optimized search in an arranged string table, return the index
 int searchList(const char *list[], const char *value, int length);
 
@@ -61,10 +61,10 @@ void ScriptVariant_ParseStringConstant(ScriptVariant *var, char *str)
     {
         int len = strlen(str);
         var->strVal = StrCache_Pop(len);
-        StrCache_Ref(var->strVal);
         var->vt = VT_STR;
         memcpy(StrCache_Get(var->strVal), str, len + 1);
-        StrCache_SetHash(var->strVal);
+        var->strVal = StrCache_Intern(var->strVal);
+        StrCache_Ref(var->strVal);
     }
 }
 
@@ -120,7 +120,11 @@ bool ScriptVariant_IsEqual(const ScriptVariant *svar, const ScriptVariant *right
             case VT_DECIMAL:
                 return (svar->dblVal == rightChild->dblVal);
             case VT_STR:
-                return (strcmp(StrCache_Get(svar->strVal), StrCache_Get(rightChild->strVal)) == 0);
+                if (strCacheInternAll)
+                    return (svar->strVal == rightChild->strVal);
+                return (StrCache_Len(svar->strVal) == StrCache_Len(rightChild->strVal) &&
+                        memcmp(StrCache_GetData(svar->strVal), StrCache_GetData(rightChild->strVal),
+                               StrCache_Len(svar->strVal)) == 0);
             case VT_PTR:
                 return (svar->ptrVal == rightChild->ptrVal);
             case VT_OBJECT:
@@ -141,21 +145,42 @@ bool ScriptVariant_IsEqual(const ScriptVariant *svar, const ScriptVariant *right
     return false;
 }
 
+// copies as much of a string as fits in the buffer like snprintf() does, and returns its full length
+static int copyString(char *buffer, size_t bufsize, const char *str, int length)
+{
+    if (bufsize > 0)
+    {
+        size_t copyLength = ((size_t) length < bufsize) ? length : bufsize - 1;
+        memcpy(buffer, str, copyLength);
+        buffer[copyLength] = '\0';
+    }
+    return length;
+}
+
 // returns size of output string (or desired size, if greater than bufsize)
 int ScriptVariant_ToString(const ScriptVariant *svar, char *buffer, size_t bufsize)
 {
+    char number[FORMAT_NUMBER_BUFFER_SIZE];
     switch (svar->vt)
     {
     case VT_EMPTY:
         return snprintf(buffer, bufsize, "NULL");
     case VT_INTEGER:
-        return snprintf(buffer, bufsize, "%d", svar->lVal);
+        return copyString(buffer, bufsize, number, formatInteger(number, svar->lVal));
     case VT_DECIMAL:
-        return snprintf(buffer, bufsize, "%lf", svar->dblVal);
+    {
+        int length = formatDecimal(number, svar->dblVal);
+        if (length < 0)
+        {
+            return snprintf(buffer, bufsize, "%lf", svar->dblVal);
+        }
+        return copyString(buffer, bufsize, number, length);
+    }
     case VT_PTR:
         return snprintf(buffer, bufsize, "%p", svar->ptrVal);
     case VT_STR:
-        return snprintf(buffer, bufsize, "%s", StrCache_Get(svar->strVal));
+        // slices aren't null-terminated, so copy by length
+        return copyString(buffer, bufsize, StrCache_GetData(svar->strVal), StrCache_Len(svar->strVal));
     case VT_OBJECT:
     case VT_LIST:
         return ObjectHeap_Get(svar->objVal)->toString(buffer, bufsize, false);
@@ -171,7 +196,7 @@ int ScriptVariant_ToJSON(const ScriptVariant *svar, char *buffer, size_t bufsize
         case VT_EMPTY:
             return snprintf(buffer, bufsize, "null");
         case VT_STR:
-            return escapeString(buffer, bufsize, StrCache_Get(svar->strVal), StrCache_Len(svar->strVal));
+            return escapeString(buffer, bufsize, StrCache_GetData(svar->strVal), StrCache_Len(svar->strVal));
         case VT_OBJECT:
         case VT_LIST:
             return ObjectHeap_Get(svar->objVal)->toString(buffer, bufsize, true);
@@ -462,6 +487,90 @@ CCResult ScriptVariant_Shr(ScriptVariant *retvar, const ScriptVariant *svar, con
 }
 
 
+// true if this part of a concatenation should be kept as a separate string in a rope instead of being copied
+static inline bool isRopeLeaf(const ScriptVariant *part, bool useRopes)
+{
+    return useRopes && part->vt == VT_STR && StrCache_Len(part->strVal) >= STRCACHE_ROPE_MIN_LENGTH;
+}
+
+// If only one part of a concatenation isn't an empty string, and it's a small integer or a single character, returns
+// the immortal string for it. Otherwise returns -1.
+static int immortalConcatResult(int numParts, const ScriptVariant *parts, int length)
+{
+    const ScriptVariant *part = NULL;
+    for (int i = 0; i < numParts; i++)
+    {
+        if (parts[i].vt == VT_STR && StrCache_Len(parts[i].strVal) == 0) continue;
+        else if (part) return -1;
+        part = &parts[i];
+    }
+
+    if (part && part->vt == VT_INTEGER)
+    {
+        return StrCache_SmallInteger(part->lVal);
+    }
+    else if (length == 1)
+    {
+        char str[2];
+        ScriptVariant_ToString(part, str, sizeof(str));
+        return StrCache_Char(str[0]);
+    }
+    return -1;
+}
+
+CCResult ScriptVariant_Concat(ScriptVariant *retvar, int numParts, const ScriptVariant *parts)
+{
+    int length = 0;
+    for (int i = 0; i < numParts; i++)
+    {
+        length += ScriptVariant_LengthAsString(&parts[i]);
+    }
+
+    // converting a small integer or a character to a string with "" + x is common enough to be worth checking for
+    int immortal = immortalConcatResult(numParts, parts, length);
+    if (immortal >= 0)
+    {
+        retvar->strVal = immortal;
+        retvar->vt = VT_STR;
+        return CC_OK;
+    }
+
+    // Long strings are kept as they are and joined to the rest with ropes, since they're often being built up by
+    // repeated appending. The parts between them are copied into one new string, which is all there is for a short
+    // result.
+    bool useRopes = length >= STRCACHE_ROPE_MIN_LENGTH && !strCacheInternAll;
+    int result = -1;
+    for (int i = 0; i < numParts;)
+    {
+        int piece;
+        if (isRopeLeaf(&parts[i], useRopes))
+        {
+            piece = parts[i++].strVal;
+        }
+        else
+        {
+            int end, pieceLength = 0;
+            for (end = i; end < numParts && !isRopeLeaf(&parts[end], useRopes); end++)
+            {
+                pieceLength += ScriptVariant_LengthAsString(&parts[end]);
+            }
+            piece = StrCache_Pop(pieceLength);
+            char *dst = StrCache_Get(piece);
+            int offset = 0;
+            for (; i < end; i++)
+            {
+                offset += ScriptVariant_ToString(&parts[i], dst + offset, pieceLength - offset + 1);
+            }
+            piece = StrCache_Intern(piece);
+        }
+        result = (result < 0) ? piece : StrCache_Concat(result, piece);
+    }
+
+    retvar->strVal = result;
+    retvar->vt = VT_STR;
+    return CC_OK;
+}
+
 CCResult ScriptVariant_Add(ScriptVariant *retvar, const ScriptVariant *svar, const ScriptVariant *rightChild)
 {
     double dbl1, dbl2;
@@ -478,15 +587,8 @@ CCResult ScriptVariant_Add(ScriptVariant *retvar, const ScriptVariant *svar, con
     }
     else if (svar->vt == VT_STR || rightChild->vt == VT_STR)
     {
-        int length = ScriptVariant_LengthAsString(svar) + ScriptVariant_LengthAsString(rightChild);
-        int strVal = StrCache_Pop(length);
-        char *dst = StrCache_Get(strVal);
-        int offset = ScriptVariant_ToString(svar, dst, length + 1);
-        ScriptVariant_ToString(rightChild, dst + offset, length - offset + 1);
-        StrCache_SetHash(strVal);
-
-        retvar->strVal = strVal;
-        retvar->vt = VT_STR;
+        ScriptVariant parts[2] = {*svar, *rightChild};
+        return ScriptVariant_Concat(retvar, 2, parts);
     }
     else if (svar->vt == VT_LIST && rightChild->vt == VT_LIST)
     {
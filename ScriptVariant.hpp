@@ -71,6 +71,9 @@ CCResult ScriptVariant_Mul(ScriptVariant *retvar, const ScriptVariant *svar, con
 CCResult ScriptVariant_Div(ScriptVariant *retvar, const ScriptVariant *svar, const ScriptVariant *rightChild);
 CCResult ScriptVariant_Rem(ScriptVariant *retvar, const ScriptVariant *svar, const ScriptVariant *rightChild);
 
+// converts each part to a string and concatenates them, the same as adding them one at a time from the left
+CCResult ScriptVariant_Concat(ScriptVariant *retvar, int numParts, const ScriptVariant *parts);
+
 // note that these are changed from OpenBOR - they now return new value instead of modifying in place
 CCResult ScriptVariant_Neg(ScriptVariant *dst, const ScriptVariant *svar);
 CCResult ScriptVariant_Boolean_Not(ScriptVariant *dst, const ScriptVariant *svar);
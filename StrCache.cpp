@@ -5,6 +5,8 @@
 #include "StrCache.hpp"
 #include "ArrayList.hpp"
 #include "stringhash.h"
+#include "AllocProfiler.hpp"
+#include "ScriptUtils.h"
 
 /*
 The string cache is intended to reduce memory usage; since not all variants are
@@ -13,6 +15,35 @@ strings, there's no need to give all of them an array.
 We actually keep two string caches: one for persistent strings like constants,
 and one for temporary strings created while execting a script. We clear the
 temporary cache every time a script is done executing.
+
+A long string built by concatenation starts out as a rope that refers to the
+two strings it concatenates, and is only flattened into a single buffer when
+it's read. Ropes are always temporary, since making one persistent flattens
+it. The strings a rope refers to don't need to be referenced: until the
+temporary strings are cleared, only a garbage collection can free them, and
+marking a rope marks them too.
+
+A substring is a slice that points into the contents of its parent string
+and references it to keep it alive. Since the parent is then persistent, its
+contents never move. A slice is copied into its own storage the first time
+it's read by something that needs a null terminator, unless it happens to
+run to the end of its parent.
+
+Every one-character string and the strings of small integers are immortal:
+they're created the first time they're needed, given a reference that's
+never released, and shared by everything that produces them after that.
+
+Strings shorter than STRCACHE_INLINE_SIZE are stored in their cache entry.
+Longer temporary strings are carved out of an arena that is reset when the
+temporary strings are cleared, and copied to their own allocation when they
+become persistent or survive a garbage collection. Only very long strings are
+allocated individually from the start.
+
+A hash index from contents to cache index lets StrCache_FindString() find an
+existing string without scanning the whole cache. Normally the index holds the
+strings with a nonzero refcount. If all strings are interned, it holds every
+string, and StrCache_Intern() uses it to make sure that no two strings have the
+same contents.
 */
 
 #define __reallocto(p, t, n, s) \
@@ -21,6 +52,40 @@ temporary cache every time a script is done executing.
 
 #define STRCACHE_INC      64
 
+// a collection is requested once this many strings have been created since the last one, or once as many have been
+// created as were alive after the last one, whichever is larger
+#define STRCACHE_GC_MIN_THRESHOLD   4096
+
+// initial number of buckets in the content index; the number is doubled whenever there are more indexed strings
+#define STRCACHE_INDEX_MIN_BUCKETS  256
+
+// value of StrCacheEntry::indexNext for strings that aren't in the index
+#define STRCACHE_NOT_INDEXED        -2
+
+// size of each chunk of the temporary string arena, and the length at which strings get their own allocation instead
+#define STRCACHE_ARENA_CHUNK_SIZE   65536
+#define STRCACHE_ARENA_MAX_STRING   4096
+
+// values of StrCacheEntry::storage
+enum StringStorage {
+    STORAGE_INLINE,
+    STORAGE_ARENA,
+    STORAGE_HEAP,
+    STORAGE_ROPE,
+    STORAGE_SLICE,
+};
+
+// the str of a rope points here, so that it isn't mistaken for a free entry
+static char ropeContents[1];
+
+struct ArenaChunk {
+    ArenaChunk *next; // the chunk filled before this one
+    size_t used;
+    char data[STRCACHE_ARENA_CHUNK_SIZE];
+};
+
+bool strCacheInternAll = false;
+
 class StrCache {
 private:
     StrCacheEntry *strcache;
@@ -28,6 +93,57 @@ private:
     int strcache_top;
     int *strcache_index;
     ArrayList<int> tempRefs; // list of indices i where the refcount of string i might be zero
+    int numLive; // number of strings currently allocated
+    int popsSinceGC; // number of strings created since the last collection
+    int gcThreshold; // value of popsSinceGC at which to request a collection
+    uint32_t gcEpoch; // strings whose gcMark equals this have been marked in the current collection
+    int *indexBuckets; // first string in each bucket of the content index, or -1
+    uint32_t numIndexBuckets; // always a power of 2
+    uint32_t numIndexed; // number of strings in the content index
+    ArenaChunk *arena; // chunk that temporary strings are currently allocated from
+    ArenaChunk *spareChunk; // kept when the arena is reset, so that the next script doesn't have to allocate one
+    ArrayList<int> ropeStack; // strings left to visit when flattening or marking a rope
+    int charStrings[256]; // immortal one-character strings, or -1 if not created yet
+    int smallIntStrings[STRCACHE_SMALL_INT_MAX - STRCACHE_SMALL_INT_MIN + 1]; // same for small integers
+
+    // forget the immortal strings, which are freed with everything else by clear()
+    void resetImmortalStrings();
+
+    // returns the immortal string in a slot of one of the tables above, creating it with these contents if needed
+    int immortalString(int *slot, const char *str, int length);
+
+    // pick the allocation count at which the next collection is requested
+    void resetGCThreshold();
+
+    // free a string and return its slot to the free list
+    void freeEntry(int index);
+
+    // allocate space for a temporary string
+    char *arenaAlloc(size_t size);
+
+    // free everything allocated from the arena; only call this when no string is stored there
+    void resetArena();
+
+    // give a string stored in the arena its own allocation
+    void moveToHeap(int index);
+
+    // take a free entry and initialize everything but the string storage
+    int popEntry(int length);
+
+    // build the contents of a rope, in its own allocation if it's persistent
+    void flatten(int index, bool persistent);
+
+    // mark every string a rope refers to
+    void markRope(int index);
+
+    // copy a slice into its own storage
+    void detachSlice(int index);
+
+    // maintain the content index
+    void addToIndex(int index);
+    void removeFromIndex(int index);
+    void growIndex();
+    int findInIndex(const char *str, int length, uint32_t hash);
 
 public:
     StrCache();
@@ -53,8 +169,36 @@ public:
     // get an index for a new string
     int pop(int length);
 
+    // create a rope concatenating two strings
+    int concat(int left, int right);
+
+    // create a string from part of another
+    int slice(int index, int start, int length);
+
     // get the string with this index
-    char *get(int index);
+    inline char *get(int index)
+    {
+        if (unlikely(strcache[index].storage == STORAGE_ROPE))
+        {
+            flatten(index, false);
+        }
+        else if (unlikely(strcache[index].storage == STORAGE_SLICE) &&
+                 strcache[index].str[strcache[index].len] != '\0')
+        {
+            detachSlice(index);
+        }
+        return strcache[index].str;
+    }
+
+    // get the contents of the string with this index, which might not be null-terminated
+    inline const char *data(int index)
+    {
+        if (unlikely(strcache[index].storage == STORAGE_ROPE))
+        {
+            flatten(index, false);
+        }
+        return strcache[index].str;
+    }
 
     // get the length of the string at this index
     int len(int index);
@@ -66,6 +210,35 @@ public:
     inline void setHash(int index);
     
     int findString(const char *str);
+
+    // if all strings are interned, replaces the string with an existing equal one
+    int intern(int index);
+
+    // turns interning of all strings on or off; fails if any strings exist
+    bool setInternAll(bool internAll);
+
+    // mark a string as reachable in the current collection
+    inline void mark(int index)
+    {
+        strcache[index].gcMark = gcEpoch;
+        if (unlikely(strcache[index].storage == STORAGE_ROPE))
+        {
+            markRope(index);
+        }
+    }
+
+    // frees all strings with a refcount of 0 that weren't marked, then starts a new epoch
+    void collectUnmarked();
+
+    // get an immortal string
+    int charString(unsigned char c);
+    int smallIntString(int value);
+
+    // returns true if a collection should be run
+    inline bool shouldCollect()
+    {
+        return popsSinceGC >= gcThreshold;
+    }
 };
 
 StrCache::StrCache()
@@ -74,6 +247,16 @@ StrCache::StrCache()
     strcache_size = 0;
     strcache_top = -1;
     strcache_index = NULL;
+    numLive = 0;
+    popsSinceGC = 0;
+    gcThreshold = STRCACHE_GC_MIN_THRESHOLD;
+    gcEpoch = 1;
+    indexBuckets = NULL;
+    numIndexBuckets = 0;
+    numIndexed = 0;
+    arena = NULL;
+    spareChunk = NULL;
+    resetImmortalStrings();
 }
 
 // init the string cache
@@ -90,6 +273,11 @@ void StrCache::init()
     }
     strcache_size = STRCACHE_INC;
     strcache_top = strcache_size - 1;
+
+    numIndexBuckets = STRCACHE_INDEX_MIN_BUCKETS;
+    indexBuckets = (int*) malloc(numIndexBuckets * sizeof(int));
+    memset(indexBuckets, -1, numIndexBuckets * sizeof(int));
+    numIndexed = 0;
 }
 
 //clear the string cache
@@ -100,7 +288,7 @@ void StrCache::clear()
     {
         for (i = 0; i < strcache_size; i++)
         {
-            if (strcache[i].str)
+            if (strcache[i].str && strcache[i].storage == STORAGE_HEAP)
             {
                 free(strcache[i].str);
             }
@@ -114,28 +302,132 @@ void StrCache::clear()
         free(strcache_index);
         strcache_index = NULL;
     }
+    free(indexBuckets);
+    indexBuckets = NULL;
+    numIndexBuckets = 0;
+    numIndexed = 0;
+    resetArena();
+    free(spareChunk);
+    spareChunk = NULL;
     strcache_size = 0;
     strcache_top = -1;
+    numLive = 0;
+    resetGCThreshold();
+    resetImmortalStrings();
 }
 
 // frees all strings with a refcount of 0
 void StrCache::clearTemporary()
 {
-    int numTemps = tempRefs.size();
-    for (int i = 0; i < numTemps; i++)
+    // freeing a slice can make its parent temporary, so this list can grow as it's cleared
+    for (uint32_t i = 0; i < tempRefs.size(); i++)
     {
         int index = tempRefs.get(i);
 
         // If strcache[index].str is NULL, it means the index was added twice to tempRefs. No harm done.
         if (strcache[index].ref == 0 && strcache[index].str != NULL)
         {
-            free(strcache[index].str);
-            strcache[index].str = NULL;
-            strcache_index[++strcache_top] = index;
+            freeEntry(index);
         }
     }
 
     tempRefs.clear();
+    resetArena();
+    resetGCThreshold();
+}
+
+void StrCache::collectUnmarked()
+{
+    uint32_t numTemps = tempRefs.size(), numKept = 0;
+    for (uint32_t i = 0; i < numTemps; i++)
+    {
+        int index = tempRefs.get(i);
+
+        // freed strings (duplicate indices) and strings that have become persistent can be dropped from the list
+        if (strcache[index].ref > 0 || strcache[index].str == NULL) continue;
+
+        if (strcache[index].gcMark == gcEpoch)
+        {
+            // survivors leave the arena so that it can be reset
+            if (strcache[index].storage == STORAGE_ARENA)
+            {
+                moveToHeap(index);
+            }
+            tempRefs.set(numKept++, index);
+        }
+        else
+        {
+            freeEntry(index);
+        }
+    }
+    tempRefs.removeRange(numKept, numTemps);
+    resetArena();
+
+    // starting a new epoch unmarks every string at once; 0 is skipped since new strings start with that mark
+    if (++gcEpoch == 0) gcEpoch = 1;
+    resetGCThreshold();
+}
+
+void StrCache::freeEntry(int index)
+{
+    if (strcache[index].indexNext != STRCACHE_NOT_INDEXED)
+    {
+        removeFromIndex(index);
+    }
+    if (strcache[index].storage == STORAGE_HEAP)
+    {
+        free(strcache[index].str);
+    }
+    else if (strcache[index].storage == STORAGE_SLICE)
+    {
+        unref(strcache[index].sliceParent);
+    }
+    strcache[index].str = NULL;
+    strcache_index[++strcache_top] = index;
+    --numLive;
+}
+
+char *StrCache::arenaAlloc(size_t size)
+{
+    if (arena == NULL || arena->used + size > STRCACHE_ARENA_CHUNK_SIZE)
+    {
+        ArenaChunk *chunk = spareChunk ? spareChunk : (ArenaChunk*) malloc(sizeof(ArenaChunk));
+        spareChunk = NULL;
+        chunk->next = arena;
+        chunk->used = 0;
+        arena = chunk;
+    }
+    char *ptr = arena->data + arena->used;
+    arena->used += size;
+    return ptr;
+}
+
+void StrCache::resetArena()
+{
+    while (arena)
+    {
+        ArenaChunk *next = arena->next;
+        if (spareChunk == NULL)
+            spareChunk = arena;
+        else
+            free(arena);
+        arena = next;
+    }
+}
+
+void StrCache::moveToHeap(int index)
+{
+    StrCacheEntry *entry = &strcache[index];
+    char *str = (char*) malloc(entry->len + 1);
+    memcpy(str, entry->str, entry->len + 1);
+    entry->str = str;
+    entry->storage = STORAGE_HEAP;
+}
+
+void StrCache::resetGCThreshold()
+{
+    popsSinceGC = 0;
+    gcThreshold = (numLive > STRCACHE_GC_MIN_THRESHOLD) ? numLive : STRCACHE_GC_MIN_THRESHOLD;
 }
 
 // reallocs a string in the cache to a new size
@@ -143,15 +435,46 @@ void StrCache::resize(int index, int size)
 {
     //assert(index<strcache_size);
     //assert(size>0);
-    strcache[index].str = (char*) realloc(strcache[index].str, size + 1);
-    strcache[index].str[size] = 0;
-    strcache[index].len = size;
+    if (strcache[index].storage == STORAGE_SLICE)
+    {
+        detachSlice(index);
+    }
+    get(index); // flattens ropes
+    StrCacheEntry *entry = &strcache[index];
+    if (entry->storage == STORAGE_HEAP)
+    {
+        entry->str = (char*) realloc(entry->str, size + 1);
+    }
+    else
+    {
+        char *str = (char*) malloc(size + 1);
+        memcpy(str, entry->str, (entry->len < size) ? entry->len : size);
+        entry->str = str;
+        entry->storage = STORAGE_HEAP;
+    }
+    entry->str[size] = 0;
+    entry->len = size;
 }
 
 // increments a string's reference count
 void StrCache::ref(int index)
 {
-    strcache[index].ref++;
+    if (strcache[index].ref++ == 0)
+    {
+        // persistent strings can outlive the arena and the strings a rope refers to
+        if (strcache[index].storage == STORAGE_ARENA)
+        {
+            moveToHeap(index);
+        }
+        else if (strcache[index].storage == STORAGE_ROPE)
+        {
+            flatten(index, true);
+        }
+        if (!strCacheInternAll)
+        {
+            addToIndex(index);
+        }
+    }
 }
 
 // unrefs a string
@@ -163,11 +486,15 @@ void StrCache::unref(int index)
     if (strcache[index].ref == 0)
     {
         tempRefs.append(index);
+        if (!strCacheInternAll)
+        {
+            removeFromIndex(index);
+        }
     }
 }
 
 // get an index for a new string
-int StrCache::pop(int length)
+int StrCache::popEntry(int length)
 {
     int i;
     if (strcache_size == 0)
@@ -176,37 +503,197 @@ int StrCache::pop(int length)
     }
     if (strcache_top < 0) // realloc
     {
-        __reallocto(strcache, StrCacheEntry*, strcache_size, strcache_size + STRCACHE_INC);
-        __reallocto(strcache_index, int*, strcache_size, strcache_size + STRCACHE_INC);
-        for (i = 0; i < STRCACHE_INC; i++)
+        // double the size, so that the time spent copying entries stays proportional to the number of strings
+        int growth = strcache_size;
+        __reallocto(strcache, StrCacheEntry*, strcache_size, strcache_size + growth);
+        __reallocto(strcache_index, int*, strcache_size, strcache_size + growth);
+        for (i = 0; i < growth; i++)
         {
             strcache_index[i] = strcache_size + i;
             strcache[i + strcache_size].str = NULL;
         }
 
+        // the entries have moved, so inline strings have too
+        for (i = 0; i < strcache_size; i++)
+        {
+            if (strcache[i].str && strcache[i].storage == STORAGE_INLINE)
+            {
+                strcache[i].str = strcache[i].inlineStr;
+            }
+        }
+
         //printf("debug: dumping string cache....\n");
         //for (i=0; i<strcache_size; i++)
         //	printf("\t\"%s\"  %d\n", strcache[i].str, strcache[i].ref);
 
-        strcache_size += STRCACHE_INC;
-        strcache_top += STRCACHE_INC;
+        strcache_size += growth;
+        strcache_top += growth;
 
         //printf("debug: string cache resized to %d \n", strcache_size);
     }
     i = strcache_index[strcache_top--];
-    strcache[i].str = (char*) malloc(length + 1);
     strcache[i].len = length;
     strcache[i].ref = 0;
     strcache[i].hash = 0;
+    strcache[i].gcMark = 0;
+    strcache[i].indexNext = STRCACHE_NOT_INDEXED;
     tempRefs.append(i);
+    ++numLive;
+    ++popsSinceGC;
     return i;
 }
 
-// get the string with this index
-char *StrCache::get(int index)
+int StrCache::pop(int length)
 {
-    //assert(index<strcache_size);
-    return strcache[index].str;
+    int i = popEntry(length);
+    if (length < STRCACHE_INLINE_SIZE)
+    {
+        strcache[i].str = strcache[i].inlineStr;
+        strcache[i].storage = STORAGE_INLINE;
+    }
+    else if (length < STRCACHE_ARENA_MAX_STRING)
+    {
+        strcache[i].str = arenaAlloc(length + 1);
+        strcache[i].storage = STORAGE_ARENA;
+    }
+    else
+    {
+        strcache[i].str = (char*) malloc(length + 1);
+        strcache[i].storage = STORAGE_HEAP;
+    }
+    return i;
+}
+
+void StrCache::resetImmortalStrings()
+{
+    memset(charStrings, -1, sizeof(charStrings));
+    memset(smallIntStrings, -1, sizeof(smallIntStrings));
+}
+
+int StrCache::immortalString(int *slot, const char *str, int length)
+{
+    if (*slot < 0)
+    {
+        int i = pop(length);
+        memcpy(strcache[i].str, str, length);
+        strcache[i].str[length] = '\0';
+
+        // if all strings are interned, an equal string might already exist, and then that one becomes immortal
+        i = intern(i);
+        ref(i); // never unreferenced
+        *slot = i;
+    }
+    return *slot;
+}
+
+int StrCache::charString(unsigned char c)
+{
+    char str = c;
+    return immortalString(&charStrings[c], &str, 1);
+}
+
+int StrCache::smallIntString(int value)
+{
+    if (value < STRCACHE_SMALL_INT_MIN || value > STRCACHE_SMALL_INT_MAX)
+    {
+        return -1;
+    }
+
+    int *slot = &smallIntStrings[value - STRCACHE_SMALL_INT_MIN];
+    if (*slot < 0)
+    {
+        char str[FORMAT_NUMBER_BUFFER_SIZE];
+        immortalString(slot, str, formatInteger(str, value));
+    }
+    return *slot;
+}
+
+int StrCache::concat(int left, int right)
+{
+    assert(!strCacheInternAll);
+    int i = popEntry(strcache[left].len + strcache[right].len);
+    strcache[i].str = ropeContents;
+    strcache[i].storage = STORAGE_ROPE;
+    strcache[i].rope.left = left;
+    strcache[i].rope.right = right;
+    return i;
+}
+
+void StrCache::flatten(int index, bool persistent)
+{
+    int length = strcache[index].len;
+    uint8_t storage = (length < STRCACHE_ARENA_MAX_STRING && !persistent) ? STORAGE_ARENA : STORAGE_HEAP;
+    char *buffer = (storage == STORAGE_ARENA) ? arenaAlloc(length + 1) : (char*) malloc(length + 1);
+
+    // copy the leaves from left to right, without recursing since ropes built by a loop are as deep as it is long
+    char *dst = buffer;
+    ropeStack.append(strcache[index].rope.right);
+    ropeStack.append(strcache[index].rope.left);
+    while (ropeStack.size() > 0)
+    {
+        StrCacheEntry *entry = &strcache[ropeStack.removeLast()];
+        if (entry->storage == STORAGE_ROPE)
+        {
+            ropeStack.append(entry->rope.right);
+            ropeStack.append(entry->rope.left);
+        }
+        else
+        {
+            memcpy(dst, entry->str, entry->len);
+            dst += entry->len;
+        }
+    }
+    *dst = '\0';
+
+    strcache[index].str = buffer;
+    strcache[index].storage = storage;
+}
+
+void StrCache::detachSlice(int index)
+{
+    StrCacheEntry *entry = &strcache[index];
+    int parent = entry->sliceParent;
+    uint8_t storage = (entry->len < STRCACHE_ARENA_MAX_STRING && entry->ref == 0) ? STORAGE_ARENA : STORAGE_HEAP;
+    char *buffer = (storage == STORAGE_ARENA) ? arenaAlloc(entry->len + 1) : (char*) malloc(entry->len + 1);
+    memcpy(buffer, entry->str, entry->len);
+    buffer[entry->len] = '\0';
+    entry->str = buffer;
+    entry->storage = storage;
+    unref(parent);
+}
+
+int StrCache::slice(int index, int start, int length)
+{
+    if (strcache[index].storage == STORAGE_ROPE)
+    {
+        flatten(index, false);
+    }
+
+    // a slice of a slice is part of the same parent
+    int parent = (strcache[index].storage == STORAGE_SLICE) ? strcache[index].sliceParent : index;
+    ref(parent);
+    int i = popEntry(length);
+    strcache[i].str = strcache[index].str + start;
+    strcache[i].storage = STORAGE_SLICE;
+    strcache[i].sliceParent = parent;
+    return i;
+}
+
+void StrCache::markRope(int index)
+{
+    ropeStack.append(strcache[index].rope.left);
+    ropeStack.append(strcache[index].rope.right);
+    while (ropeStack.size() > 0)
+    {
+        StrCacheEntry *entry = &strcache[ropeStack.removeLast()];
+        if (entry->gcMark == gcEpoch) continue; // already marked, along with everything it refers to
+        entry->gcMark = gcEpoch;
+        if (entry->storage == STORAGE_ROPE)
+        {
+            ropeStack.append(entry->rope.left);
+            ropeStack.append(entry->rope.right);
+        }
+    }
 }
 
 int StrCache::len(int index)
@@ -217,25 +704,77 @@ int StrCache::len(int index)
 
 inline const StrCacheEntry *StrCache::getEntry(int index)
 {
+    // strings are only hashed when they're first used as a key, since most never are
+    setHash(index);
     return &strcache[index];
 }
 
 void StrCache::setHash(int index)
 {
-    if (strcache[index].hash == 0)
+    if (unlikely(strcache[index].hash == 0))
     {
-        strcache[index].hash = string_hash(strcache[index].str, strcache[index].len);
+        strcache[index].hash = string_hash(data(index), strcache[index].len);
     }
 }
 
-// see if a string is already in the cache
-// return its index if it is, or -1 if it isn't
-int StrCache::findString(const char *str)
+void StrCache::addToIndex(int index)
 {
-    int i;
-    for (i = 0; i < strcache_size; i++)
+    setHash(index);
+    if (++numIndexed > numIndexBuckets)
+    {
+        growIndex();
+    }
+    uint32_t bucket = strcache[index].hash & (numIndexBuckets - 1);
+    strcache[index].indexNext = indexBuckets[bucket];
+    indexBuckets[bucket] = index;
+}
+
+void StrCache::removeFromIndex(int index)
+{
+    int *link = &indexBuckets[strcache[index].hash & (numIndexBuckets - 1)];
+    while (*link != index)
     {
-        if (strcache[i].ref && strcmp(str, strcache[i].str) == 0)
+        assert(*link >= 0);
+        link = &strcache[*link].indexNext;
+    }
+    *link = strcache[index].indexNext;
+    strcache[index].indexNext = STRCACHE_NOT_INDEXED;
+    --numIndexed;
+}
+
+// doubles the number of buckets in the index
+void StrCache::growIndex()
+{
+    uint32_t newNumBuckets = numIndexBuckets * 2;
+    int *newBuckets = (int*) malloc(newNumBuckets * sizeof(int));
+    memset(newBuckets, -1, newNumBuckets * sizeof(int));
+    for (uint32_t i = 0; i < numIndexBuckets; i++)
+    {
+        int index = indexBuckets[i];
+        while (index >= 0)
+        {
+            int next = strcache[index].indexNext;
+            uint32_t bucket = strcache[index].hash & (newNumBuckets - 1);
+            strcache[index].indexNext = newBuckets[bucket];
+            newBuckets[bucket] = index;
+            index = next;
+        }
+    }
+    free(indexBuckets);
+    indexBuckets = newBuckets;
+    numIndexBuckets = newNumBuckets;
+}
+
+int StrCache::findInIndex(const char *str, int length, uint32_t hash)
+{
+    if (numIndexBuckets == 0)
+    {
+        return -1;
+    }
+
+    for (int i = indexBuckets[hash & (numIndexBuckets - 1)]; i >= 0; i = strcache[i].indexNext)
+    {
+        if (strcache[i].hash == hash && strcache[i].len == length && memcmp(strcache[i].str, str, length) == 0)
         {
             return i;
         }
@@ -243,6 +782,46 @@ int StrCache::findString(const char *str)
     return -1;
 }
 
+// see if a string is already in the cache
+// return its index if it is, or -1 if it isn't
+int StrCache::findString(const char *str)
+{
+    int length = strlen(str);
+    return findInIndex(str, length, string_hash(str, length));
+}
+
+int StrCache::intern(int index)
+{
+    if (!strCacheInternAll)
+    {
+        return index;
+    }
+    setHash(index);
+
+    StrCacheEntry *entry = &strcache[index];
+    int existing = findInIndex(entry->str, entry->len, entry->hash);
+    if (existing >= 0)
+    {
+        // a new string can't have been referenced yet, so it can be freed right away; its entry in tempRefs will be
+        // skipped like any duplicate
+        assert(entry->ref == 0);
+        freeEntry(index);
+        return existing;
+    }
+    addToIndex(index);
+    return index;
+}
+
+bool StrCache::setInternAll(bool internAll)
+{
+    if (numLive > 0)
+    {
+        return false;
+    }
+    strCacheInternAll = internAll;
+    return true;
+}
+
 
 static StrCache theCache;
 
@@ -265,14 +844,58 @@ void StrCache_Unref(int index)
 
 int StrCache_Pop(int length)
 {
+    if (AllocProfiler_ShouldSample())
+        AllocProfiler_Record(ALLOC_STRING, length + 1);
     return theCache.pop(length);
 }
 
+int StrCache_Concat(int left, int right)
+{
+    int length = theCache.len(left) + theCache.len(right);
+    if (AllocProfiler_ShouldSample())
+        AllocProfiler_Record(ALLOC_STRING, length + 1);
+    return theCache.concat(left, right);
+}
+
+int StrCache_Slice(int index, int start, int length)
+{
+    if (length == 1)
+    {
+        return theCache.charString(theCache.data(index)[start]);
+    }
+
+    // Interned strings have to be hashed and looked up as soon as they're made, which would take as long as copying.
+    if (length < STRCACHE_INLINE_SIZE || strCacheInternAll)
+    {
+        int newIndex = StrCache_Pop(length);
+        char *newString = StrCache_Get(newIndex);
+        memcpy(newString, theCache.data(index) + start, length);
+        newString[length] = '\0';
+        return StrCache_Intern(newIndex);
+    }
+    return theCache.slice(index, start, length);
+}
+
+int StrCache_Char(unsigned char c)
+{
+    return theCache.charString(c);
+}
+
+int StrCache_SmallInteger(int value)
+{
+    return theCache.smallIntString(value);
+}
+
 char *StrCache_Get(int index)
 {
     return theCache.get(index);
 }
 
+const char *StrCache_GetData(int index)
+{
+    return theCache.data(index);
+}
+
 int StrCache_Len(int index)
 {
     return theCache.len(index);
@@ -301,3 +924,32 @@ int StrCache_FindString(const char *str)
     return theCache.findString(str);
 }
 
+int StrCache_Intern(int index)
+{
+    return theCache.intern(index);
+}
+
+CCResult StrCache_SetInternAll(bool internAll)
+{
+    if (!theCache.setInternAll(internAll))
+    {
+        printf("Error: string interning can only be changed before any strings are created\n");
+        return CC_FAIL;
+    }
+    return CC_OK;
+}
+
+void StrCache_Mark(int index)
+{
+    theCache.mark(index);
+}
+
+void StrCache_CollectUnmarked()
+{
+    theCache.collectUnmarked();
+}
+
+bool StrCache_ShouldCollect()
+{
+    return theCache.shouldCollect();
+}
@@ -4,23 +4,95 @@
 #include <stdint.h>
 #include "depends.h"
 
+// strings shorter than this are stored in their cache entry, which makes an entry 48 bytes on 64-bit platforms
+#define STRCACHE_INLINE_SIZE 19
+
 typedef struct {
     int len;
     int ref;
-    char *str;
-    uint32_t hash;
+    char *str; // points to inlineStr, the temporary string arena, a separate allocation, or the contents of a slice's
+               // parent (not valid for ropes)
+    uint32_t hash; // 0 until the string is first used as a key
+    uint32_t gcMark; // equal to the collector's current epoch if the string was marked reachable
+    int indexNext; // next string in the same bucket of the content index, -1 at the end of a chain, or -2 if unindexed
+    uint8_t storage; // which of the places above str points to, or whether the string is a rope
+    union {
+        char inlineStr[STRCACHE_INLINE_SIZE];
+        struct {
+            int left;
+            int right;
+        } rope; // the strings a rope is the concatenation of
+        int sliceParent; // the string a slice is part of
+    };
 } StrCacheEntry;
 
+// concatenations at least this long create ropes instead of copying the strings
+#define STRCACHE_ROPE_MIN_LENGTH 64
+
+// True if every string is interned, so two strings are equal exactly when their indices are. Set with
+// StrCache_SetInternAll() before any strings are created.
+extern bool strCacheInternAll;
+
+/**
+ * A pointer returned by StrCache_Get() is only valid until the next call to StrCache_Pop(), StrCache_Ref(), or
+ * Interpreter_CollectGarbage(), since any of those can move the string.
+ */
+
 //clear the string cache
 void StrCache_ClearTemporary();
 void StrCache_ClearAll();
 void StrCache_Unref(int index);
 void StrCache_Ref(int index);
 int StrCache_Pop(int length);
+
+// Creates a rope: a string that is the concatenation of two others, whose contents aren't built until the string is
+// read with StrCache_Get() or StrCache_GetEntry(), or made persistent. Repeatedly appending to a string with this is
+// linear rather than quadratic. Not available if all strings are interned.
+int StrCache_Concat(int left, int right);
+
+// Creates a string from part of another, and interns it. Parts long enough to not be stored inline are slices that
+// share the contents of the other string and keep it alive, instead of copying them. A slice is only copied when
+// StrCache_Get() needs it to be null-terminated.
+int StrCache_Slice(int index, int start, int length);
+
+// range of integers whose decimal strings are returned by StrCache_SmallInteger()
+#ifndef STRCACHE_SMALL_INT_MIN
+#define STRCACHE_SMALL_INT_MIN -128
+#endif
+#ifndef STRCACHE_SMALL_INT_MAX
+#define STRCACHE_SMALL_INT_MAX 1023
+#endif
+
+// Return a string that is never freed, holding a single byte or the decimal form of an integer in the range above,
+// so that the builtins and operators that produce these don't create a new string every time. Each string is created
+// the first time it's asked for. StrCache_SmallInteger() returns -1 for integers outside the range.
+int StrCache_Char(unsigned char c);
+int StrCache_SmallInteger(int value);
+
 char *StrCache_Get(int index);
+
+// Returns the contents of a string, which unlike with StrCache_Get() might not be followed by a null terminator. Use
+// this with StrCache_Len() to read a string without copying it if it's a slice.
+const char *StrCache_GetData(int index);
+
 int StrCache_Len(int index);
+
+// returns the cache entry of a string, with its hash set
 const StrCacheEntry *StrCache_GetEntry(int index);
 void StrCache_SetHash(int index);
 int StrCache_FindString(const char *str);
 
+// Call this once the contents of a new string have been written, and use the index it returns from then on. If all
+// strings are interned, it replaces the new string with an existing one with the same contents.
+int StrCache_Intern(int index);
+
+// Turns interning of all strings on or off. Fails if any strings exist.
+CCResult StrCache_SetInternAll(bool internAll);
+
+// garbage collection of temporary strings: mark every string reachable from the roots, then call
+// StrCache_CollectUnmarked() to free the temporary strings that weren't marked
+void StrCache_Mark(int index);
+void StrCache_CollectUnmarked();
+bool StrCache_ShouldCollect();
+
 #endif
@@ -24,6 +24,7 @@ void Symbol_Init(Symbol *symbol, const char *theName, ScriptVariant *pvar)
         symbol->name[0] = 0;
     }
     ScriptVariant_Init(&(symbol->var));
+    symbol->declaredType = VT_EMPTY;
     if(pvar)
     {
         ScriptVariant_Copy(&(symbol->var), pvar);
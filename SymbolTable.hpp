@@ -17,6 +17,7 @@ struct Symbol
 {
     char  name[MAX_STR_LEN + 1];
     ScriptVariant var;
+    VARTYPE declaredType; // VT_INTEGER or VT_DECIMAL for typed variables, VT_EMPTY otherwise
 };
 
 void Symbol_Init(Symbol *symbol, const char *theName, ScriptVariant *pvar);
@@ -49,7 +49,7 @@ void dagDFS(BasicBlock *block)
         // add uses at p in Live
         foreach_list(inst->operands, RValue*, iter)
         {
-            if (!iter.value()->isTemporary()) break;
+            if (!iter.value()->isTemporary()) continue;
             live.set(iter.value()->asTemporary()->id);
         }
         last = last->getPrevious();
@@ -439,6 +439,7 @@ CCResult Lexer::getNextToken(Token *theNextToken)
         }
     }
     while (ppToken->theType == PP_TOKEN_WHITESPACE || ppToken->theType == PP_TOKEN_NEWLINE);
+    preprocessor.ctx->sawCode = true;
 
     theTokenPosition = preprocessor.lexer.theTokenPosition;
     pcurChar = preprocessor.lexer.pcurChar;
@@ -19,6 +19,7 @@
 #include <stdlib.h>
 #include <stdarg.h>
 #include <time.h>
+#include <ctype.h>
 #include <malloc.h>
 #include <errno.h>
 #include "List.hpp"
@@ -61,6 +62,8 @@ pp_context::pp_context()
     // initialize the conditional stack
     conditionals.all = 0ll;
     num_conditionals = 0;
+    strictTypes = false;
+    sawCode = false;
 
     // initialize the builtin macros other than __FILE__ and __LINE__
     snprintf(buf, sizeof(buf), "\"%.7s%.4s\"", datetime + 4, datetime + 20);
@@ -636,6 +639,21 @@ pp_token *pp_parser::emitToken()
     return success ? &this->token : NULL;
 }
 
+/**
+ * Gets the parser of the file that the last emitted token came from, which is
+ * the innermost file being #included, if any, or else the root file. Its
+ * lexer's position is the position of that token in the file.
+ */
+pp_parser *pp_parser::currentFile()
+{
+    pp_parser *parser = this;
+    while(parser->child && parser->child->type == PP_INCLUDE)
+    {
+        parser = parser->child;
+    }
+    return parser;
+}
+
 // this->token contains the first token of the macro/message if this->overread is true
 CCResult pp_parser::readLine(char *buf, size_t bufsize)
 {
@@ -888,6 +906,31 @@ CCResult pp_parser::parseDirective()
             return pp_error(this, "#error %s", text);
         }
     }
+    else if (!strcmp(directiveName, "pragma"))
+    {
+        char text[256] = {""};
+
+        if (CC_FAIL == readLine(text, sizeof(text)))
+        {
+            return CC_FAIL;
+        }
+
+        // "#pragma strict_types" makes the compiler check the types of variables declared int or float; like a C
+        // compiler, ignore pragmas we don't know
+        if (!strncmp(text, "strict_types", 12) && (text[12] == '\0' || isspace((unsigned char) text[12])))
+        {
+            // it applies to the whole script, so it has to come before any code
+            if (ctx->sawCode)
+            {
+                return pp_error(this, "#pragma strict_types must come before any code");
+            }
+            ctx->strictTypes = true;
+        }
+        else
+        {
+            pp_warning(this, "ignoring unknown pragma '%s'", text);
+        }
+    }
     else if (token.theType == PP_TOKEN_NEWLINE)
     {
         // null directive - do nothing
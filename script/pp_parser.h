@@ -59,6 +59,8 @@ public:
     List<void*> imports;               // list of files for the interpreter to "import"
     conditional_stack conditionals;    // the conditional stack
     int num_conditionals;              // current size of the conditional stack
+    bool strictTypes;                  // set by "#pragma strict_types"
+    bool sawCode;                      // true once a token has been passed on to the lexer
 public:
     pp_context();
     inline ~pp_context() { clear(); }
@@ -104,6 +106,7 @@ public:
     CCResult lexToken(bool skipWhitespace);
     bool isDefined(const char *name);
     pp_token *emitToken();
+    pp_parser *currentFile();
 private:
     int peekToken();
     CCResult lexTokenEssential(bool skipWhitespace);
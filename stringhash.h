@@ -1,42 +1,54 @@
-/* Copyright (C) 1994-2016 Lua.org, PUC-Rio.
- *
- * Permission is hereby granted, free of charge, to any person obtaining
- * a copy of this software and associated documentation files (the
- * "Software"), to deal in the Software without restriction, including
- * without limitation the rights to use, copy, modify, merge, publish,
- * distribute, sublicense, and/or sell copies of the Software, and to
- * permit persons to whom the Software is furnished to do so, subject to
- * the following conditions:
- *
- * The above copyright notice and this permission notice shall be
- * included in all copies or substantial portions of the Software.
- *
- * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
- * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
- * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
- * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
- * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
- * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
- * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
- */
-
 #ifndef STRINGHASH_H
 #define STRINGHASH_H
 
 #include <stdlib.h> // for size_t
 #include <stdint.h> // for uint32_t
+#include <string.h> // for memcpy
+#if defined(__SSE4_2__) && defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+/*
+Hashes every byte of a string, 8 bytes at a time, so that long strings that
+only differ in a few places still get different hashes. On x86-64 CPUs with
+SSE 4.2, each word is mixed in with the hardware CRC32 instruction.
+
+The result is never 0, so the string cache can use 0 to mean that a string
+hasn't been hashed yet.
+*/
+
+static inline uint64_t string_hash_word(uint64_t hash, uint64_t word)
+{
+#if defined(__SSE4_2__) && defined(__x86_64__)
+    return _mm_crc32_u64(hash, word);
+#else
+    hash = (hash ^ word) * 0x9e3779b97f4a7c15ull;
+    return hash ^ (hash >> 32);
+#endif
+}
 
-// string hashing function from Lua
 inline uint32_t string_hash(const char *str, size_t len)
 {
-    uint32_t hash = (uint32_t) len;
-    size_t step = (len >> 5) + 1;
-    for (; len >= step; len -= step)
+    uint64_t hash = len;
+    size_t remaining = len;
+    for (; remaining >= 8; remaining -= 8, str += 8)
+    {
+        uint64_t word;
+        memcpy(&word, str, 8);
+        hash = string_hash_word(hash, word);
+    }
+    if (remaining > 0)
     {
-        hash ^= ((hash << 5) + (hash >> 2) + (unsigned char)(str[len - 1]));
+        uint64_t word = 0;
+        memcpy(&word, str, remaining);
+        hash = string_hash_word(hash, word);
     }
-    return hash;
+
+    // make every bit of the result depend on every bit of the input, since hash tables use the low bits
+    hash ^= hash >> 29;
+    hash *= 0xbf58476d1ce4e5b9ull;
+    hash ^= hash >> 32;
+    return (uint32_t) hash ? (uint32_t) hash : 1;
 }
 
 #endif // defined(STRINGHASH_H)
-
@@ -0,0 +1,56 @@
+/* Checks that the allocation profiler attributes allocations to the
+   functions and operations that made them. */
+#include "test/expect.h"
+
+void makeObjects(int count)
+{
+    void last = 0;
+    for (int i = 0; i < count; i++)
+    {
+        last = {"index": i};
+    }
+    return last;
+}
+
+void makeStrings(int count)
+{
+    void last = "";
+    for (int i = 0; i < count; i++)
+    {
+        last = "string " + i;
+    }
+    return last;
+}
+
+void findSite(void sites, char functionName, char type)
+{
+    for (int i = 0; i < sites.length(); i++)
+    {
+        if (sites[i].function == functionName && sites[i].type == type)
+            return sites[i];
+    }
+    return 0;
+}
+
+void main()
+{
+    // sample every allocation so that the counts are exact
+    alloc_profile_start(1);
+    makeObjects(100);
+    makeStrings(50);
+    void sites = alloc_profile_stop();
+
+    void objects = findSite(sites, "makeObjects", "object");
+    expect(objects.count, 100);
+    expect(objects.operation, "mkobject");
+    expect(objects.bytes > 0, 1);
+
+    void strings = findSite(sites, "makeStrings", "string");
+    expect(strings.count, 50);
+    expect(strings.operation, "add");
+
+    // nothing is recorded after the profiler stops
+    makeObjects(10);
+    void stopped = alloc_profile_stop();
+    expect(stopped.length(), sites.length());
+}
@@ -0,0 +1,39 @@
+/* Chains of additions with a string operand are compiled to a single
+   concat instruction. Checks that the result is the same as adding one
+   operand at a time, including numeric additions before the first string. */
+#include "test/expect.h"
+
+void touch(void object)
+{
+    object.count = 2;
+    return "";
+}
+
+void check(int x, float y)
+{
+    expect("x=" + x + ", y=" + y, "x=3, y=0.500000");
+    expect(x + x + " items" + x, "6 items3");
+    expect(y + x + ": " + y + x, "3.500000: 0.5000003");
+    expect("[" + [1, 2] + "]" + {"a": 1}, "[[1, 2]]{\"a\": 1}");
+
+}
+
+void main()
+{
+    check(3, 0.5);
+
+    // the object is converted to a string before it's modified
+    void object = {"count": 1};
+    char described = "before " + object + touch(object) + " after " + object;
+    expect(described, "before {\"count\": 1} after {\"count\": 2}");
+
+    // long parts are joined with ropes instead of being copied
+    char nested = "";
+    for (int i = 0; i < 50; i++)
+    {
+        nested = "<" + i + ":" + nested + ":" + i + ">";
+    }
+    expect(nested.length(), 380);
+    expect(nested.substring(0, 8), "<49:<48:");
+    expect(nested.substring(372), ":48>:49>");
+}
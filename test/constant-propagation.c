@@ -0,0 +1,76 @@
+/* Values that are the same on every path that can run are replaced by
+   constants, and branches on them only keep the code that can run. The code
+   that's removed would fail if it ever ran. */
+#include "test/expect.h"
+
+#define DEBUG 0
+
+int pick(int param)
+{
+    int x;
+    if (param > 0)
+        x = 5;
+    else
+        x = 5;
+    return x * 2;
+}
+
+int countWithFlag()
+{
+    int flag = 1, count = 0;
+    int i = 0;
+    while (i < 3)
+    {
+        if (flag) count++;
+        else count = count / 0;
+        i++;
+    }
+    return count;
+}
+
+char describe(int mode)
+{
+    switch (mode)
+    {
+        case 1: return "one";
+        case 2: return "two";
+        default: return "other";
+    }
+}
+
+char describeTwo()
+{
+    int mode = 2;
+    switch (mode)
+    {
+        case 1: return "one";
+        case 2: return "two";
+        default: return "other";
+    }
+}
+
+void main()
+{
+    int zero = 0;
+    void notAnObject = 0;
+    if (DEBUG)
+    {
+        expect(notAnObject.x, 1);
+    }
+    if (zero)
+    {
+        expect(1 / zero, 1);
+    }
+    while (zero)
+    {
+        log(notAnObject.x);
+    }
+
+    expect(pick(1), 10);
+    expect(pick(-1), 10);
+    expect(countWithFlag(), 3);
+    expect(describe(1), "one");
+    expect(describe(3), "other");
+    expect(describeTwo(), "two");
+    expect(cc_constant("MAX_ENTS") > 0 ? "engine" : "none", "engine");
+}
@@ -0,0 +1,85 @@
+/* Loops that step an integer counter by 1 and compare it to an integer
+   bound end with a single instruction that steps, compares and jumps back.
+   The functions are typed so that their own code, and not just copies
+   inlined into main(), has the fused loops, and are too long to inline.
+   Checks the counts and the final counter values of such loops. */
+#pragma strict_types
+#include "test/expect.h"
+
+// the counter after the loop exits, plus twice the number of iterations times 100
+int countUp(int n)
+{
+    int count = 0;
+    int i;
+    for (i = 0; i < n; i++)
+        count += 2;
+    if (n < 0) count = -1;
+    if (n > 1000) count = -2;
+    return i + count * 100;
+}
+
+int lastUp(int n)
+{
+    int i;
+    int steps = 0;
+    for (i = 1; i <= n; i++)
+        steps += 2;
+    if (steps != 2 * (i - 1)) return -1;
+    if (n > 1000) return -2;
+    return i;
+}
+
+int sumDown(int n)
+{
+    int sum = 0;
+    int i;
+    for (i = n; i >= 0; i--)
+        sum += i;
+    if (n > 1000) return -1;
+    if (n < -1000) return -2;
+    return sum * 100 + i;
+}
+
+// skips the odd counter values with a continue that goes to the back edge
+int skipOdd(int n)
+{
+    int sum = 0;
+    int i;
+    for (i = n; i > 0; i--)
+    {
+        if (i % 2) continue;
+        sum += i;
+    }
+    if (n > 1000) return -1;
+    return sum * 100 + i;
+}
+
+// constant bounds
+int constantBounds()
+{
+    int pairs = 0;
+    int i, j;
+    for (i = 0; i < 3; i++)
+    {
+        for (j = i; j < 3; j++)
+        {
+            if (j == 1) continue;
+            pairs++;
+        }
+    }
+    return pairs * 100 + i * 10 + j;
+}
+
+void main()
+{
+    expect(countUp(5), 1005);
+    expect(countUp(0), 0);
+    expect(countUp(-3), -100);
+    expect(lastUp(4), 5);
+    expect(lastUp(0), 1);
+    expect(sumDown(4), 999);
+    expect(sumDown(-1), -1);
+    expect(skipOdd(7), 1200);
+    expect(skipOdd(8), 2000);
+    expect(constantBounds(), 433);
+}
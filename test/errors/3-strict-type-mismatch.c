@@ -0,0 +1,15 @@
+// should trigger an error since a string is assigned to an int variable
+#pragma strict_types
+
+int describe(int x)
+{
+    int y = x;
+    if (x > 3)
+        y = "large: " + x;
+    return y;
+}
+
+void main()
+{
+    describe(5);
+}
@@ -0,0 +1,12 @@
+// should trigger an error since the pragma comes after code it would apply to
+int half(int x)
+{
+    return x / 2;
+}
+
+#pragma strict_types
+
+void main()
+{
+    half(4);
+}
@@ -0,0 +1,37 @@
+/* The format() builtin, which builds a string from a format string and
+   its arguments in one allocation. */
+#include "test/expect.h"
+
+void main()
+{
+    expect(format("plain"), "plain");
+    expect(format("%s and %s", "this", "that"), "this and that");
+    expect(format("%d%%", 50), "50%");
+    expect(format("%d, %d", -7, 2147483647), "-7, 2147483647");
+    expect(format("%x", 255), "ff");
+    expect(format("%f", 1.5), "1.500000");
+    expect(format("%.2f", 3.14159), "3.14");
+    expect(format("%.0f", 2.5), "2");
+    expect(format("%.3f", 2), "2.000");
+
+    // width and alignment
+    expect(format("[%5d]", 42), "[   42]");
+    expect(format("[%-5d]", 42), "[42   ]");
+    expect(format("[%05d]", -42), "[-0042]");
+    expect(format("[%8.3f]", -1.5), "[  -1.500]");
+    expect(format("[%6s|%-6s]", "ab", "cd"), "[    ab|cd    ]");
+    expect(format("[%.3s]", "truncated"), "[tru]");
+    expect(format("[%2s]", "longer"), "[longer]");
+
+    // values of any type with %s and %j
+    expect(format("%s %s", [1, "a"], 2.25), "[1, \"a\"] 2.250000");
+    expect(format("%j", "quote\" tab\t"), "\"quote\\\" tab\\t\"");
+    expect(format("%j", 12), "12");
+    expect(format("name=%j", {"k": "v"}), "name={\"k\": \"v\"}");
+
+    char digits = "";
+    for (int i = 0; i < 20; i++) digits = digits + "0123456789";
+    char formatted = format("<%s>", digits);
+    expect(formatted.length(), 202);
+    expect(formatted.substring(195), "456789>");
+}
@@ -0,0 +1,45 @@
+/* Allocates enough garbage to trigger several collections while scripts are
+   running, and checks that values only reachable from temporaries,
+   parameters and script globals survive them. */
+#include "test/expect.h"
+
+void kept;
+
+void churn(int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        void garbage = {"index": i, "name": "garbage " + i};
+        void cycle = [garbage];
+        garbage.cycle = cycle;
+    }
+}
+
+void buildList(void list, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        list.append({"value": "item " + i});
+        churn(2);
+    }
+    return list;
+}
+
+void main()
+{
+    // only reachable from a temporary register of this function
+    void local = ["local " + 1, {"nested": "local " + 2}];
+
+    // only reachable from a script global
+    kept = {"member": ["global " + 3]};
+
+    void list = buildList([], 5000);
+    churn(10000);
+
+    expect(local[0], "local 1");
+    expect(local[1].nested, "local 2");
+    expect(kept.member[0], "global 3");
+    expect(list.length(), 5000);
+    expect(list[0].value, "item 0");
+    expect(list[4999].value, "item 4999");
+}
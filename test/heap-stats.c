@@ -0,0 +1,36 @@
+#include "test/expect.h"
+
+void main()
+{
+    void before = heap_stats();
+    void temps = [{}, {}, []];
+    void after = heap_stats();
+
+    // the 4 containers above plus the first stats object and its 2 histogram lists
+    expect(after.objects - before.objects, 3);
+    expect(after.lists - before.lists, 4);
+    expect(after.temporary - before.temporary, 7);
+    expect(after.object_bytes > before.object_bytes, 1);
+    expect(after.list_bytes > before.list_bytes, 1);
+
+    // storing a list in a persistent object promotes it and everything in it (the globals object is created first so
+    // that its own promotion isn't counted)
+    globals();
+    after = heap_stats();
+    globals().temps = temps;
+    void promoted = heap_stats();
+    expect(promoted.promotions - after.promotions, 4);
+    expect(promoted.persistent - after.persistent, 4);
+
+    // allocate enough garbage to run the collector at least once
+    void garbage = 0;
+    for (int i = 0; i < 20000; i++)
+    {
+        garbage = [i];
+    }
+    void collected = heap_stats();
+    expect(collected.gc_cycles > promoted.gc_cycles, 1);
+    expect(collected.temp_refs_high_water >= collected.temporary, 1);
+    expect(collected.mark_time_histogram.length(), 24);
+    expect(collected.sweep_time_histogram.length(), 24);
+}
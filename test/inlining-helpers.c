@@ -0,0 +1,21 @@
+// imported by inlining.c
+
+int scale = 2;
+
+int dot(void a, void b)
+{
+    return a.x * b.x + a.y * b.y;
+}
+
+char describe(int n)
+{
+    if (n < 0)
+        return "negative";
+    return "not negative";
+}
+
+// uses a global of this script, so it isn't inlined into other scripts
+int scaled(int n)
+{
+    return n * scale;
+}
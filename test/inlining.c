@@ -0,0 +1,70 @@
+/* Calls to small functions are replaced by copies of their bodies, including
+   functions imported from other scripts. */
+#include "test/expect.h"
+#import "test/inlining-helpers.c"
+
+int clamp(int x, int low, int high)
+{
+    if (x < low)
+        return low;
+    if (x > high)
+        return high;
+    return x;
+}
+
+void getX(void obj)
+{
+    return obj.x;
+}
+
+// becomes small enough to inline once the call to clamp() is inlined
+int clampByte(int x)
+{
+    return clamp(x, 0, 255);
+}
+
+int factorial(int n)
+{
+    if (n <= 1)
+        return 1;
+    return n * factorial(n - 1);
+}
+
+int countUp(int n)
+{
+    int i = 0;
+    while (i < n)
+        i++;
+    return i;
+}
+
+void main()
+{
+    expect(clamp(-5, 0, 10), 0);
+    expect(clamp(15, 0, 10), 10);
+    expect(clamp(7, 0, 10), 7);
+    expect(clampByte(300), 255);
+
+    int total = 0;
+    for (int i = -2; i < 3; i++)
+    {
+        total += clamp(i, 0, 1);
+    }
+    expect(total, 2);
+    expect(countUp(countUp(4) + 1), 5);
+
+    int steps = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        steps += countUp(i);
+    }
+    expect(steps, 6);
+
+    void point = {"x": 3, "y": 4};
+    expect(getX(point), 3);
+    expect(dot(point, point), 25);
+    expect(describe(-1), "negative");
+    expect(describe(1), "not negative");
+    expect(scaled(5), 10);
+    expect(factorial(5), 120);
+}
@@ -0,0 +1,47 @@
+/* List accesses indexed by a counter that's checked against the list's
+   length on every iteration skip the checks of the index. Checks that the
+   results don't change, including in loops where the checks have to stay. */
+#include "test/expect.h"
+
+void main()
+{
+    void values = [3, 1, 4, 1, 5, 9, 2, 6];
+    int sum = 0;
+    for (int i = 0; i < values.length(); i++)
+    {
+        sum += values[i];
+        values[i] = values[i] * 2;
+    }
+    expect(sum, 31);
+    expect(values[7], 12);
+
+    // differences from the previous element, starting from the second one
+    void diffs = [0, 0, 0, 0, 0, 0, 0, 0];
+    for (int i = 1; i < values.length(); i++)
+        diffs[i] = values[i] - values[i - 1];
+    expect(diffs[0], 0);
+    expect(diffs[5], 8);
+    expect(diffs[6], -14);
+
+    // rows of a grid
+    void grid = [[1, 2, 3], [4, 5], [6]];
+    int total = 0;
+    for (int y = 0; y < grid.length(); y++)
+    {
+        void row = grid[y];
+        for (int x = 0; x < row.length(); x++)
+            total += row[x] * (y + 1);
+    }
+    expect(total, 6 + 18 + 18);
+
+    // removing elements changes the length in the middle of an iteration
+    void list = [1, 2, 2, 3, 2];
+    int seen = 0;
+    for (int i = 0; i < list.length(); i++)
+    {
+        if (list[i] == 2) list.remove(i);
+        else seen += list[i];
+    }
+    expect(list.length(), 3);
+    expect(seen, 4);
+}
@@ -0,0 +1,99 @@
+/* Values that are the same on every iteration of a loop are computed once
+   before it. Checks that nothing is moved that could change during the loop
+   or that could fail where the loop itself wouldn't have. */
+#include "test/expect.h"
+
+int limit = 3;
+
+void bump(void obj)
+{
+    obj.x = obj.x + 1;
+}
+
+int sumScaled(int a, int b, int n)
+{
+    int total = 0;
+    int i = 0;
+    do
+    {
+        total += a * b + i;
+        i++;
+    } while (i < n);
+    return total;
+}
+
+int countToLimit()
+{
+    int count = 0;
+    for (int i = 0; i < limit; i++)
+    {
+        count++;
+        limit = 5;
+    }
+    return count;
+}
+
+int divideEach(int a, int b, int n)
+{
+    int result = 0;
+    for (int i = 0; i < n; i++)
+    {
+        result = a / b;
+    }
+    return result;
+}
+
+void main()
+{
+    expect(sumScaled(2, 3, 4), 30);
+
+    void obj = {"x": 1, "n": 3};
+    int i = 0, total = 0;
+    while (i < obj.n)
+    {
+        total += obj.x;
+        i++;
+    }
+    expect(total, 3);
+
+    i = 0; total = 0;
+    while (i < 3)
+    {
+        total += obj.x;
+        bump(obj);
+        i++;
+    }
+    expect(total, 6);
+
+    i = 0; total = 0;
+    do
+    {
+        total += obj.x;
+        obj.x = obj.x * 2;
+        i++;
+    } while (i < 3);
+    expect(total, 28);
+
+    expect(countToLimit(), 5);
+    limit = 3;
+
+    // the loop never runs, so dividing by zero or reading a member of a non-object would be wrong
+    expect(divideEach(1, 0, 0), 0);
+    void notAnObject = 0;
+    i = 0; total = 0;
+    while (i < 0)
+    {
+        total += notAnObject.x;
+        i++;
+    }
+    expect(total, 0);
+
+    for (i = 0; i < 3; i++)
+    {
+        for (int j = 0; j < 2; j++)
+        {
+            total += limit * 10 + obj.n;
+        }
+    }
+    expect(total, 198);
+}
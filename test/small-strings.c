@@ -0,0 +1,43 @@
+/* One-character strings and the strings of small integers are shared
+   instead of created every time. Makes enough of them to trigger garbage
+   collections, and keeps some in a global list and as object keys. */
+#include "test/expect.h"
+
+void kept;
+
+void main()
+{
+    kept = [];
+    void counts = {};
+    char text = "the quick brown fox jumps over the lazy dog";
+    for (int round = 0; round < 200; round++)
+    {
+        for (int i = 0; i < text.length(); i++)
+        {
+            char c = text.substring(i, i + 1);
+            if (counts.has_key(c))
+                counts[c] = counts[c] + 1;
+            else
+                counts[c] = 1;
+        }
+        kept.append("" + (round - 100));
+        kept.append(char_from_integer(65 + round % 26));
+    }
+    expect(counts.o, 800);
+    expect(counts[" "], 1600);
+    expect(kept[0], "-100");
+    expect(kept[1], "A");
+    expect(kept[398], "99");
+    expect(kept[399], "R");
+    kept = 0;
+
+    expect(char_from_integer(104) == "h", 1);
+    expect(to_string(-128), "-128");
+    expect(to_string(1023), "1023");
+    expect(to_string(1024), "1024");
+    expect(to_string(-129), "-129");
+    expect("" + 7 + "", "7");
+    expect("x" + "", "x");
+    expect("" + 2.5, "2.500000");
+    expect("a,b".split(",")[1], "b");
+}
@@ -0,0 +1,67 @@
+/* Multiplications of a loop counter become additions carried across
+   iterations, a second counter that always equals the first is merged
+   into it, and division and remainder of counters by powers of 2 become
+   shifts and masks. Checks that the results don't change. */
+#include "test/expect.h"
+
+void main()
+{
+    // tile indices in a grid
+    int width = 7, sum = 0;
+    for (int y = 0; y < 5; y++)
+        for (int x = 0; x < width; x++)
+            sum += y * width + x;
+    expect(sum, 34 * 35 / 2);
+
+    // the same multiplications counting down and by other steps
+    int down = 0;
+    for (int i = 10; i > 0; i--)
+        down += i * 3;
+    expect(down, 165);
+    int stepped = 0;
+    for (int i = 1; i < 20; i += 4)
+        stepped += 5 * i;
+    expect(stepped, 225);
+
+    // products that are still used after the loop
+    int lastProduct = 0;
+    for (int i = 0; i < 3; i++)
+        lastProduct = i * 3;
+    expect(lastProduct, 6);
+    int last = 0, total = 0;
+    for (int i = 0; i < 3; i++)
+    {
+        last = i * 4;
+        total += last;
+    }
+    expect(last, 8);
+    expect(total, 12);
+    int wrapped = 0;
+    for (int i = 0; i < 3; i++)
+        wrapped = i * 1073741824;
+    expect(wrapped, -2147483648);
+
+    // idx always equals i
+    int idx = 0, matches = 0;
+    for (int i = 0; i < 6; i++)
+    {
+        if (idx == i) matches++;
+        idx++;
+    }
+    expect(matches, 6);
+    expect(idx, 6);
+
+    int bits = 0;
+    for (int i = 0; i < 20; i++)
+        bits += (i / 4) * 100 + i % 8;
+    expect(bits, 4062);
+
+    // negative values keep the division and remainder
+    int signs = 0;
+    for (int i = 0; i < 3; i++)
+    {
+        int n = i - 5;
+        signs += n / 2 + n % 4;
+    }
+    expect(signs, -9);
+}
@@ -0,0 +1,44 @@
+/* With strict types, variables declared int or float only ever hold
+   integers or decimals, so arithmetic on them skips the type checks.
+   Integers assigned to float variables become decimals. */
+#pragma strict_types
+#include "test/expect.h"
+
+float average(int count, float total)
+{
+    return total / count;
+}
+
+float integrate(int steps)
+{
+    float sum, dx = 1 / 1.0 / steps;
+    for (int i = 0; i < steps; i++)
+    {
+        float x = i * dx;
+        sum += x * x * dx;
+    }
+    return sum;
+}
+
+void main()
+{
+    int n;
+    expect(n, 0);
+    float f = 3;
+    expect(f, 3.0);
+    f = n + 1;
+    expect(f, 1.0);
+
+    expect(average(4, 10), 2.5);
+    expect(integrate(4), 0.21875);
+
+    void list = [1, 2, 3];
+    int total = 0;
+    for (int i = 0; i < list.length(); i++)
+        total += list[i];
+    expect(total, 6);
+
+    // untyped variables still hold anything
+    char word = "strict";
+    expect(word.length(), 6);
+}
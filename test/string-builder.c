@@ -0,0 +1,55 @@
+/* Builds long strings by repeated concatenation, which creates ropes, and
+   checks them after flattening: as values, object keys, and across garbage
+   collections triggered while they're being built. */
+#include "test/expect.h"
+
+void kept;
+
+char repeat(char piece, int count)
+{
+    char result = "";
+    for (int i = 0; i < count; i++)
+    {
+        result = result + piece;
+    }
+    return result;
+}
+
+void main()
+{
+    char digits = "";
+    for (int i = 0; i < 100; i++)
+    {
+        digits = digits + (i % 10);
+    }
+    expect(digits.length(), 100);
+    expect(digits.substring(0, 12), "012345678901");
+    expect(digits.substring(95), "56789");
+
+    // prepending as well as appending
+    char both = "middle";
+    for (int i = 0; i < 20; i++)
+    {
+        both = "<" + both + ">";
+    }
+    expect(both.length(), 46);
+    expect(both == repeat("<", 20) + "middle" + repeat(">", 20), 1);
+
+    // long enough to trigger collections while intermediate ropes are alive
+    char big = "";
+    for (int i = 0; i < 20000; i++)
+    {
+        big = big + "x" + i;
+        void garbage = {"name": "garbage " + i};
+    }
+    expect(big.substring(0, 8), "x0x1x2x3");
+
+    // ropes stored in objects are flattened when they become persistent
+    char key = repeat("key", 30);
+    void object = {};
+    object[key] = 1;
+    kept = {"value": repeat("ab", 40)};
+    expect(object[repeat("key", 30)], 1);
+    expect(kept.value == repeat("ab", 40), 1);
+    expect(kept.value.length(), 80);
+}
@@ -0,0 +1,40 @@
+/* Compares strings built at runtime with literals, as values, object keys
+   and switch cases. Run with --intern-strings as well, where equal strings
+   always share an index. */
+#include "test/expect.h"
+
+int describe(char name)
+{
+    switch (name)
+    {
+        case "alpha":
+            return 1;
+        case "beta":
+            return 2;
+    }
+    return 0;
+}
+
+void main()
+{
+    char built = "al" + "pha";
+    char number = "item " + 5;
+
+    expect(built == "alpha", 1);
+    expect(built != "alpha", 0);
+    expect(number == "item 5", 1);
+    expect(number == "item 6", 0);
+    expect(("b" + "eta") == ("be" + "ta"), 1);
+
+    void object = {};
+    object[built] = 1;
+    object["item " + 5] = 2;
+    expect(object.alpha, 1);
+    expect(object[number], 2);
+    expect(object.has_key("al" + "pha"), 1);
+    expect(object.keys().length(), 2);
+
+    expect(describe(built), 1);
+    expect(describe("b" + "eta"), 2);
+    expect(describe(number), 0);
+}
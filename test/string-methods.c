@@ -0,0 +1,62 @@
+/* Searching, splitting, replacing, joining and trimming strings with the
+   native string and list methods. */
+#include "test/expect.h"
+
+void main()
+{
+    char text = "key = value; other key = another value; last = ";
+    expect(text.index_of("key"), 0);
+    expect(text.index_of("key", 1), 19);
+    expect(text.index_of("missing"), -1);
+    expect(text.index_of(""), 0);
+    expect(text.index_of(";", 12), 38);
+    expect(text.last_index_of("key"), 19);
+    expect(text.last_index_of("="), 45);
+    expect(text.last_index_of("missing"), -1);
+    expect("ab".index_of("abc"), -1);
+    expect(text.starts_with("key ="), 1);
+    expect(text.starts_with("value"), 0);
+    expect("a".starts_with("ab"), 0);
+    expect(text.starts_with(""), 1);
+
+    void pairs = text.split("; ");
+    expect(pairs.length(), 3);
+    expect(pairs[0], "key = value");
+    expect(pairs[1], "other key = another value");
+    expect(pairs[2], "last = ");
+    void fields = pairs[1].split(" = ");
+    expect(fields[0], "other key");
+    expect(fields[1], "another value");
+    expect("".split(",").length(), 1);
+    expect(",a,,b,".split(",").length(), 5);
+    expect(",a,,b,".split(",")[3], "b");
+
+    expect("  padded\t\n".trim(), "padded");
+    expect("   ".trim(), "");
+    expect("inner  space".trim(), "inner  space");
+
+    expect(text.replace(" = ", "="), "key=value; other key=another value; last=");
+    expect("aaaa".replace("aa", "b"), "bb");
+    expect("abc".replace("x", "y"), "abc");
+    expect("a.b.c".replace(".", ""), "abc");
+
+    expect(pairs.join("; ") == text, 1);
+    expect(["x", 1, 2.5].join(", "), "x, 1, 2.500000");
+    expect([].join(","), "");
+    expect(["only"].join(","), "only");
+
+    // a config file with comments and blank lines
+    char config = "# settings\nwidth = 320\n\nheight = 240\n  name = test  \n";
+    void settings = {};
+    void lines = config.split("\n");
+    for (int i = 0; i < lines.length(); i++)
+    {
+        char line = lines[i].trim();
+        if (line.length() == 0 || line.starts_with("#")) continue;
+        int equals = line.index_of("=");
+        settings[line.substring(0, equals).trim()] = line.substring(equals + 1).trim();
+    }
+    expect(settings.width, "320");
+    expect(settings.height, "240");
+    expect(settings.name, "test");
+}
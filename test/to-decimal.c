@@ -10,5 +10,9 @@ void main()
     expect(to_decimal("3.1e4"), 3.1e4);
     expect(to_decimal("3.1e+4"), 3.1e+4);
     expect(to_decimal("3.1e-4"), 3.1e-4);
+    expect(to_decimal(".5"), 0.5);
+    expect(to_decimal("-12.375"), -12.375);
+    expect(to_decimal("0.1"), 0.1);
+    expect(to_decimal("1e300"), 1e300);
 }
 
@@ -4,6 +4,12 @@ void main()
 {
     expect(to_string("str"), "str");
     expect(to_string(3), "3");
+    expect(to_string(-2147483648), "-2147483648");
+    expect(to_string(1234567.5), "1234567.500000");
+    expect(to_string(-0.25), "-0.250000");
+    expect(to_string(0.0078125), "0.007812");
+    expect(to_string(0.0000004), "0.000000");
+    expect(to_string(1e20), "100000000000000000000.000000");
     expect(to_string([]), "[]");
     expect(to_string({}), "{}");
 }
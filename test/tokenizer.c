@@ -0,0 +1,52 @@
+/* Splits a long string into words by repeatedly taking substrings, which
+   share the contents of the string they're taken from instead of copying
+   them. Checks the words as values, as object keys, and after they've
+   been stored in a list. */
+#include "test/expect.h"
+
+void countWords(char text, void words)
+{
+    void counts = {};
+    char rest = text;
+    while (rest.length() > 0)
+    {
+        int end = 0;
+        while (end < rest.length() && rest.char_at(end) != 32) end++;
+        char word = rest.substring(0, end);
+        words.append(word);
+        if (counts.has_key(word))
+            counts[word] = counts[word] + 1;
+        else
+            counts[word] = 1;
+        if (end == rest.length()) break;
+        rest = rest.substring(end + 1);
+    }
+    return counts;
+}
+
+void main()
+{
+    char text = "";
+    for (int i = 0; i < 30; i++)
+    {
+        text = text + "a_fairly_long_word_number_" + (i % 3) + " tiny ";
+    }
+    text = text + "end";
+
+    void words = [];
+    void counts = countWords(text, words);
+    expect(counts.a_fairly_long_word_number_0, 10);
+    expect(counts.a_fairly_long_word_number_2, 10);
+    expect(counts.tiny, 30);
+    expect(counts.end, 1);
+    expect(words.length(), 61);
+    expect(words[0] == "a_fairly_long_word_number_0", 1);
+    expect(words[60], "end");
+
+    // slices of slices, and slices that end before the end of their parent
+    char middle = text.substring(2, 40).substring(5, 30);
+    expect(middle, "y_long_word_number_0 tiny");
+    expect(middle.length(), 25);
+    expect(middle + "!", "y_long_word_number_0 tiny!");
+    expect(text.substring(text.length() - 8), "tiny end");
+}
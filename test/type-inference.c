@@ -0,0 +1,47 @@
+/* Arithmetic and comparisons on values known to be integers skip the type
+   checks. Checks that values that might not be integers still get the
+   generic operations. */
+#include "test/expect.h"
+
+int countdown(int n)
+{
+    int steps = 0;
+    for (int i = n; i > 0; i--)
+        steps++;
+    return steps;
+}
+
+void mixed(int useDecimal)
+{
+    void x = 3;
+    if (useDecimal)
+        x = 1.5;
+    return x * 2 + 1;
+}
+
+void main()
+{
+    expect(countdown(5), 5);
+    expect(mixed(0), 7);
+    expect(mixed(1), 4.0);
+
+    char word = "integers";
+    int total = 0;
+    for (int i = 0; i < word.length(); i++)
+    {
+        total += word.index_of("e") * 2 - 1;
+    }
+    expect(total, 40);
+
+    void label = 0;
+    for (int j = 0; j < 3; j++)
+    {
+        label = label + j;
+        label = label + ",";
+    }
+    expect(label, "0,1,2,");
+
+    int parsed = to_integer("41") + 1;
+    expect(parsed == 42, 1);
+    expect(parsed - 0.5, 41.5);
+}
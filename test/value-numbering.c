@@ -0,0 +1,48 @@
+/* Repeated expressions are computed once when that can't change the
+   result. Checks the cases where merging them would be wrong: reads of an
+   object after it's modified, string concatenation in either order, and
+   adding lists, which makes a new list each time. */
+#include "test/expect.h"
+
+int sumOfSquares(void a, void b)
+{
+    return a.x * a.x + b.y * b.y;
+}
+
+void main()
+{
+    int i = 4, j = 9;
+    int a = (i + 1) * (j - 2);
+    int b = (j - 2) * (i + 1);
+    expect(a + b, 70);
+    if (i > 1)
+    {
+        expect((i + 1) * (j - 2), 35);
+    }
+    expect(sumOfSquares({"x": 3}, {"y": 4}), 25);
+
+    void obj = {"x": 1};
+    int before = obj.x + 1;
+    obj.x = 10;
+    int after = obj.x + 1;
+    expect(before, 2);
+    expect(after, 11);
+
+    char s = "s";
+    expect(s + 1, "s1");
+    expect(1 + s, "1s");
+
+    void list = [1];
+    void copy1 = list + [];
+    void copy2 = list + [];
+    copy1.append(2);
+    expect(copy1.length(), 2);
+    expect(copy2.length(), 1);
+    expect(list.length(), 1);
+
+    void holder = {"list": [1, 2]};
+    char text1 = "" + holder.list;
+    holder.list.append(3);
+    char text2 = "" + holder.list;
+    expect(text1 == text2, 0);
+}